@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include "slice.h"
+
+namespace lsm {
+
+class Cache;
+
+// With a non-zero high_pri_pool_ratio, up to that fraction of the capacity
+// is reserved for Priority::kHigh entries and entries that were looked up
+// again; low-priority entries are inserted below it and evicted first.
+Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio = 0.0);
+
+// A CLOCK cache whose Lookup() and Release() are lock-free: entries live in
+// open-addressed tables with atomic reference counts, so cached reads never
+// contend on a mutex. Inserts and eviction still serialize per shard. The
+// tables are sized for entries of about estimated_entry_charge; once one is
+// full, further inserts are handed out uncached. Priority::kHigh entries
+// start with a longer CLOCK countdown than kLow ones.
+Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge);
+
+class Cache {
+public:
+    Cache() = default;
+
+    virtual ~Cache() = default;
+
+    Cache(const Cache&) = delete;
+    Cache& operator=(const Cache&) = delete;
+
+    // Opaque handle to an entry stored in the cache.
+    struct Handle {};
+
+    // Entries that must survive scans (index and filter blocks, blocks read
+    // by point lookups) are kHigh; blocks read by iterators are kLow.
+    enum class Priority { kHigh, kLow };
+
+    // Inserts key->value with given charge. Caller must Release() the handle.
+    // The deleter is called when the entry is evicted.
+    virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                           void (*deleter)(const Slice& key, void* value),
+                           Priority priority = Priority::kLow) = 0;
+
+    // Returns a handle for the key, or nullptr. Caller must Release() when done.
+    virtual Handle* Lookup(const Slice& key) = 0;
+
+    // REQUIRES: handle not yet released; returned by a method on *this.
+    virtual void Release(Handle* handle) = 0;
+
+    // REQUIRES: handle not yet released; returned by a method on *this.
+    virtual void* Value(Handle* handle) = 0;
+
+    // Erases key; underlying entry kept alive until all handles released.
+    virtual void Erase(const Slice& key) = 0;
+
+    // Returns a new numeric id for partitioning shared cache key spaces.
+    virtual uint64_t NewId() = 0;
+
+    // Removes all unused entries. Default implementation is a no-op.
+    virtual void Prune() {}
+
+    virtual size_t TotalCharge() const = 0;
+
+    // Calls callback with every entry in the cache, one shard at a time
+    // under that shard's lock, so callback must not use the cache. priority
+    // is kHigh for entries inserted so or, in a cache that tracks it, hit
+    // since.
+    virtual void ApplyToAllEntries(
+        const std::function<void(const Slice& key, void* value, size_t charge,
+                                 void (*deleter)(const Slice& key, void* value),
+                                 Priority priority)>& callback) = 0;
+};
+
+}
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include "options.h"
 #include "iterator.h"
 #include "status.h"
+#include "table_properties.h"
 
 namespace lsm {
 
@@ -33,9 +35,46 @@ public:
     virtual Status Get(const ReadOptions& options,
                        const Slice& key, std::string* value) = 0;
 
+    // Looks up every key against one snapshot of the DB and returns a status
+    // per key, with (*values)[i] set when the status of keys[i] is ok. Faster
+    // than a Get() per key: keys in the same table are looked up together,
+    // each data block is read once, and distinct blocks are read in parallel.
+    virtual std::vector<Status> MultiGet(const ReadOptions& options,
+                                         const std::vector<Slice>& keys,
+                                         std::vector<std::string>* values) = 0;
+
     // Returns a heap-allocated iterator. Must Seek before use.
     // Delete the iterator before deleting the DB.
     virtual Iterator* NewIterator(const ReadOptions& options) = 0;
+
+    // Stores the properties of every live table file in *props, keyed by
+    // file number. Served from metadata; no table data is scanned.
+    virtual Status GetPropertiesOfAllTables(TablePropertiesCollection* props) = 0;
+
+    // Adds table files written by SstFileWriter to the DB. The files must not
+    // overlap each other. Each is placed in the deepest level it fits and
+    // its keys become visible atomically with a new sequence number, newer
+    // than every existing write. Overlapping memtable data is flushed first.
+    virtual Status IngestExternalFiles(const IngestExternalFileOptions& options,
+                                       const std::vector<std::string>& files) = 0;
+
+    // Writes the file number, offset and priority of every block of this
+    // DB's tables in the block cache to fname, for LoadBlockCache() to read
+    // back, typically after a restart.
+    virtual Status DumpBlockCache(const std::string& fname) = 0;
+
+    // Reads the blocks listed in fname by DumpBlockCache() back into the
+    // block cache, file by file in offset order with large reads. Blocks
+    // of files that are no longer live, or that no longer start a block,
+    // are skipped.
+    virtual Status LoadBlockCache(const std::string& fname) = 0;
+
+    // Sets *value to the named property of the DB and returns true, or
+    // returns false for an unknown property. Properties:
+    //   "lsm.table-warmup-progress": "<tables warmed>/<tables to warm>"
+    //     for the warm-up of Options::table_warmup_threads; "0/0" without.
+    //   "lsm.num-files-at-level<N>": the number of tables at level N.
+    virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 };
 
 Status DestroyDB(const std::string& name, const Options& options);
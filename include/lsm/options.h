@@ -1,11 +1,15 @@
 #pragma once
 
 #include <cstddef>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace lsm {
 
+class Cache;
 class Comparator;
+class WriteBufferManager;
 
 struct Options {
     Options();
@@ -24,6 +28,36 @@ struct Options {
     static constexpr int kL0_StopWritesTrigger = 12;
     size_t max_file_size = 2 * 1024 * 1024;
 
+    // Size levels from the bottom up: the last level holds what it holds
+    // and each level above it a tenth of the next, up to a base level of
+    // at most 10 MB. Level-0 compactions write straight to the base level,
+    // and the levels above it stay empty. Keeps about 90% of the data in
+    // the last level whatever the DB size, so space amplification stays
+    // near 1.1x. When false, level targets are fixed at 10 MB for level 1
+    // and 10x more per level below.
+    bool level_compaction_dynamic_level_bytes = false;
+
+    enum CompactionPri {
+        kRoundRobin = 0x0,
+        kMinOverlappingRatio = 0x1,
+        kOldestSmallestSeqFirst = 0x2
+    };
+
+    // Which table of an oversized level a compaction starts from.
+    // kRoundRobin cycles through the level's key range. kMinOverlappingRatio
+    // takes the table overlapping the fewest bytes of the next level per
+    // byte of its own, which cuts the bytes rewritten per byte pushed down
+    // under random writes. kOldestSmallestSeqFirst takes the table holding
+    // the oldest data, for workloads that update hot ranges and leave the
+    // rest alone.
+    CompactionPri compaction_pri = kRoundRobin;
+
+    // A table in levels 1..kNumLevels-2 whose fraction of deletion entries
+    // (from its table properties) reaches this ratio is compacted even when
+    // its level is within budget, so tombstones reach the bottom and stop
+    // costing space and reads. 0 disables; 0.5 is a reasonable setting.
+    double deletion_compaction_ratio = 0;
+
     // If true, stop early on data corruption (may make more entries unreadable).
     bool paranoid_checks = false;
 
@@ -31,32 +65,205 @@ struct Options {
     // throughput but more memory usage and longer recovery on restart.
     size_t write_buffer_size = 4 * 1024 * 1024;
 
-    // Max open file descriptors (budget ~1 per 2MB of working set).
+    // Shared with other DBs to cap the memory of all their memtables
+    // together; see WriteBufferManager. A DB also switches memtables at
+    // write_buffer_size as usual.
+    std::shared_ptr<WriteBufferManager> write_buffer_manager;
+
+    // Max open file descriptors (budget ~1 per 2MB of working set). -1
+    // keeps every table open from when it is written, so lookups find it
+    // without a table cache probe; only for DBs whose files fit the
+    // process's descriptor limit.
     int max_open_files = 1000;
 
+    // Threads with which DB::Open opens every live table, reading its
+    // index and filter, so the first lookups after a restart do not pay
+    // for it. Keep max_open_files above the number of tables, or the table
+    // cache evicts what was warmed. 0 opens tables on first use.
+    int table_warmup_threads = 0;
+
+    // Data blocks from the start of each table that the warm-up also reads
+    // into the block cache.
+    int table_warmup_data_blocks = 0;
+
+    // Warm tables in the background after DB::Open returns instead of
+    // before; DB::GetProperty("lsm.table-warmup-progress") tracks it.
+    bool table_warmup_in_background = false;
+
+    // Open tables for user reads with O_DIRECT, bypassing the OS page cache.
+    // Each read is widened to 4 KB-aligned bounds. Only worth it with an
+    // application-level cache in front.
+    bool use_direct_reads = false;
+
+    // Write flush and compaction outputs, and read compaction inputs, with
+    // O_DIRECT, so a large compaction does not evict the pages that serve
+    // Get()s. File systems without O_DIRECT (e.g. tmpfs) fall back to
+    // buffered I/O.
+    bool use_direct_io_for_flush_and_compaction = false;
+
+    // Compactions read each input table in windows of this many bytes
+    // instead of block by block, and advise the OS that the file is read
+    // sequentially and that pages already merged can be dropped. 0 reads
+    // block by block.
+    size_t compaction_readahead_size = 2 * 1024 * 1024;
+
+    // Iterators without ReadOptions::readahead_size notice when they read
+    // consecutive blocks of a table and start prefetching the following
+    // bytes on a background I/O thread, doubling the prefetch from 8 KB up
+    // to this size while the scan continues. Point lookups and short scans
+    // are unaffected. 0 disables it.
+    size_t max_auto_readahead_size = 256 * 1024;
+
     // Approximate uncompressed size of user data per block.
     size_t block_size = 4 * 1024;
 
     // Keys between delta-encoding restart points. Leave at default unless tuning.
     int block_restart_interval = 16;
 
+    // If true, each data block carries a small hash table mapping user keys
+    // to restart intervals, letting point lookups skip the restart binary
+    // search. Blocks without it (or with too many restarts) fall back to it.
+    bool data_block_hash_index = false;
+
+    // Keys per hash bucket in the data block hash index, in (0, 1]. Lower
+    // values use more space but give fewer collisions.
+    double data_block_hash_table_util_ratio = 0.75;
+
     enum CompressionType {
         kNoCompression = 0x0,
-        kZstdCompression = 0x1
+        kZstdCompression = 0x1,
+        kLZCompression = 0x2      // built-in LZ77, no external dependency
     };
 
     CompressionType compression = kNoCompression;
 
+    // Per-level override of `compression`: entry i applies to tables written
+    // to level i, and the last entry to every deeper level. A typical policy
+    // leaves L0/L1 uncompressed (they are rewritten soon), uses kLZCompression
+    // in the middle and kZstdCompression at the bottom. Empty = use
+    // `compression` everywhere.
+    std::vector<CompressionType> compression_per_level;
+
+    // Resolves the compression used for tables written to `level`.
+    CompressionType CompressionForLevel(int level) const;
+
+    // Zstd dictionary compression. When non-zero and a table is written with
+    // kZstdCompression, its first data blocks are sampled to train a
+    // dictionary of at most this many bytes, stored in the table and shared by
+    // all its data blocks. Pays off for small blocks of similar values.
+    uint32_t zstd_max_dict_bytes = 0;
+
+    // Bytes of data blocks buffered as training samples before the first data
+    // block is written. 0 means 100 * zstd_max_dict_bytes.
+    uint32_t zstd_max_train_bytes = 0;
+
+    // Threads compressing the data blocks of each table being built. Values
+    // above 1 hand finished blocks to a worker pool while the building thread
+    // keeps adding keys and writes compressed blocks back in file order.
+    // Worth it when compression is CPU-bound, e.g. zstd at the lower levels.
+    int parallel_compression_threads = 1;
+
+    // Key-value separation. When true, flushes move values of at least
+    // min_blob_size bytes into blob files and tables keep only a small
+    // reference, so compactions stop rewriting large values.
+    bool enable_blob_files = false;
+    size_t min_blob_size = 4096;
+
+    // Compactions relocate values still referenced from blob files whose
+    // live fraction has fallen below this ratio. A blob file is deleted once
+    // none of its records are referenced.
+    double blob_gc_live_ratio = 0.5;
+
+    enum ChecksumType {
+        kCRC32c = 0x0,
+        kXXHash64 = 0x1
+    };
+
+    // Checksum written into the trailer of each new block. The type is
+    // recorded per block, so files written with either can always be read.
+    ChecksumType checksum = kCRC32c;
+
     int bloom_bits_per_key = 10;
 
     // Capacity of the block cache in bytes. If 0, no cache is used.
     size_t block_cache_capacity = 8 * 1024 * 1024;
+
+    // If set, the block cache, used instead of one built from the options
+    // below and typically shared by several DBs so their cached blocks stay
+    // within one capacity. The compressed and persistent tiers only back a
+    // block cache the DB builds itself.
+    std::shared_ptr<Cache> block_cache;
+
+    // Fraction of the block cache reserved for blocks read by point lookups
+    // and blocks hit more than once. Blocks read by iterators enter below
+    // that pool and are evicted first, so a long scan can fill the cache
+    // without flushing out the hot set. 0 makes the cache a plain LRU.
+    double block_cache_high_pri_pool_ratio = 0.5;
+
+    enum BlockCacheType {
+        kLRUBlockCache = 0x0,
+        kClockBlockCache = 0x1
+    };
+
+    // kClockBlockCache replaces the LRU block cache with a CLOCK cache whose
+    // lookups take no lock, for read-heavy workloads on many cores where
+    // the LRU shard mutexes contend. Its tables are sized for block_size
+    // entries, and it has no priority pools: point-lookup blocks only start
+    // with a longer CLOCK countdown than scan blocks.
+    BlockCacheType block_cache_type = kLRUBlockCache;
+
+    // Capacity in bytes of a second block cache tier that keeps blocks
+    // evicted from the block cache, compressed with the built-in lz
+    // compressor. A block cache miss checks it before reading the file and
+    // moves a hit back into the block cache. Since blocks shrink two- to
+    // threefold, memory spent here holds more of the hot set than the same
+    // memory added to block_cache_capacity, at the cost of decompressing on
+    // each hit. 0 disables it; it has no effect without a block cache.
+    size_t compressed_secondary_cache_capacity = 0;
+
+    // Directory on a fast local device for a persistent block cache tier,
+    // for when the tables themselves live on slower (e.g. network) storage.
+    // Blocks evicted from the block cache are appended to a preallocated
+    // file of persistent_cache_capacity bytes there, and a miss in the
+    // memory tiers checks it before reading the table. Its index is saved
+    // when the DB closes, so the cache is warm after a restart. Empty
+    // disables it; it has no effect without a block cache. One directory
+    // must not be shared by two open DBs.
+    std::string persistent_cache_path;
+    uint64_t persistent_cache_capacity = 1024ull * 1024 * 1024;
+
+    // If set, the DB lists the blocks it has in the block cache in this
+    // file when it closes, and DB::Open reloads them on a background
+    // thread, so hit rates recover without waiting for the workload to
+    // refill the cache; see DB::DumpBlockCache(). Only tables recovered by
+    // DB::Open are reloaded, and until the MANIFEST is replayed there are
+    // none.
+    std::string block_cache_dump_path;
+
+    // Capacity in bytes of a cache of individual table entries, keyed by
+    // table file and user key, that point lookups consult before reading
+    // the table: a hit skips the index, filter and block entirely. Holds
+    // values and tombstones found by Get() and MultiGet(). 0 disables it.
+    size_t row_cache_capacity = 0;
 };
 
 struct ReadOptions {
     bool verify_checksums = false;
 
     bool fill_cache = true;
+
+    // If non-zero, iterators read table files in windows of this many bytes
+    // instead of one block at a time. Speeds up long scans on devices with
+    // high per-request latency; each iterator holds a buffer of this size
+    // for every table it has open. 0 leaves readahead to
+    // Options::max_auto_readahead_size.
+    size_t readahead_size = 0;
+};
+
+struct IngestExternalFileOptions {
+    // If true, files are renamed into the DB directory instead of copied,
+    // and no longer exist at their original paths afterwards.
+    bool move_files = false;
 };
 
 struct WriteOptions {
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "options.h"
+#include "slice.h"
+#include "status.h"
+
+namespace lsm {
+
+// Describes a file produced by SstFileWriter.
+struct ExternalSstFileInfo {
+    std::string file_path;
+    std::string smallest_key;
+    std::string largest_key;
+    uint64_t num_entries = 0;
+    uint64_t file_size = 0;
+};
+
+// Writes a table file outside of any DB for DB::IngestExternalFiles, so
+// sorted data can be bulk loaded without going through the WAL, memtable
+// and compactions. Not thread-safe.
+class SstFileWriter {
+public:
+    // The comparator must match the one of the DB the file is ingested into.
+    // Tables are compressed as for the bottom level, where ingested files
+    // usually land.
+    explicit SstFileWriter(const Options& options);
+    ~SstFileWriter();
+
+    SstFileWriter(const SstFileWriter&) = delete;
+    SstFileWriter& operator=(const SstFileWriter&) = delete;
+
+    Status Open(const std::string& file_path);
+
+    // REQUIRES: key is larger than any previously added key.
+    Status Put(const Slice& key, const Slice& value);
+    Status Delete(const Slice& key);
+
+    // Completes the file. At least one key must have been added. If info is
+    // non-null it is filled in on success.
+    Status Finish(ExternalSstFileInfo* info = nullptr);
+
+    uint64_t FileSize() const;
+
+private:
+    struct Rep;
+    Rep* rep_;
+};
+
+}
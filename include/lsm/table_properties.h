@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+
+namespace lsm {
+
+// Statistics recorded in every table file when it is written, readable
+// without scanning the table.
+struct TableProperties {
+    uint64_t num_entries = 0;
+    uint64_t num_deletions = 0;
+    uint64_t raw_key_size = 0;
+    uint64_t raw_value_size = 0;
+    // Data blocks before compression, and as stored (including trailers).
+    uint64_t raw_data_size = 0;
+    uint64_t data_size = 0;
+    uint64_t smallest_seqno = 0;
+    uint64_t largest_seqno = 0;
+    // Seconds since the epoch when the table was written.
+    uint64_t creation_time = 0;
+
+    // Uncompressed / stored data block bytes; 1.0 for an empty table.
+    double CompressionRatio() const {
+        if (data_size == 0) return 1.0;
+        return static_cast<double>(raw_data_size) / data_size;
+    }
+
+    // Fraction of entries that are tombstones.
+    double DeletionRatio() const {
+        if (num_entries == 0) return 0;
+        return static_cast<double>(num_deletions) / num_entries;
+    }
+};
+
+// Properties of every live table file, by file number.
+typedef std::map<uint64_t, TableProperties> TablePropertiesCollection;
+
+}
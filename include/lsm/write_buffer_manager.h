@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "cache.h"
+
+namespace lsm {
+
+// One memory budget for the memtables of every DB that shares it, for
+// packing many DBs into one process: set the same manager in each DB's
+// Options::write_buffer_manager. Thread-safe.
+class WriteBufferManager {
+public:
+    // Once the memtables use about buffer_size bytes in total, the DB with
+    // the largest mutable memtable is made to flush it; 0 only tracks
+    // usage. With a cache, memtable memory is also charged to it in
+    // kDummyEntrySize pieces, so that memtables and cached blocks share its
+    // capacity; pass the same cache as Options::block_cache.
+    explicit WriteBufferManager(size_t buffer_size, std::shared_ptr<Cache> cache = nullptr);
+    ~WriteBufferManager();
+
+    WriteBufferManager(const WriteBufferManager&) = delete;
+    WriteBufferManager& operator=(const WriteBufferManager&) = delete;
+
+    static const size_t kDummyEntrySize = 256 * 1024;
+
+    size_t buffer_size() const { return buffer_size_; }
+
+    // Bytes held by memtables, including those waiting to be flushed.
+    size_t memory_usage() const { return memory_used_.load(std::memory_order_relaxed); }
+
+    // Bytes held by memtables that still take writes.
+    size_t mutable_memtable_memory_usage() const {
+        return memory_active_.load(std::memory_order_relaxed);
+    }
+
+    // Bytes charged to the cache.
+    size_t dummy_entries_in_cache_usage() const;
+
+    // True once the mutable memtables reach 7/8 of buffer_size, or all
+    // memtables reach buffer_size while half of it is still mutable: past
+    // that point flushing more would not free memory any sooner.
+    bool ShouldFlush() const;
+
+    // What follows is used by the DBs and memtables sharing the manager.
+
+    // A DB sharing the manager.
+    class Client {
+    public:
+        virtual ~Client() = default;
+        virtual size_t MutableMemtableSize() = 0;
+        // Switches to a new memtable so the full one gets flushed. Must not
+        // block on the manager.
+        virtual void FlushMemtable() = 0;
+    };
+
+    void RegisterClient(Client* client);
+    void UnregisterClient(Client* client);
+
+    // Asks the client with the largest mutable memtable to flush it. Call
+    // with no DB mutex held.
+    void FlushLargest();
+
+    // A memtable grew by n bytes.
+    void ReserveMem(size_t n);
+    // A memtable holding n bytes stopped taking writes.
+    void ScheduleFreeMem(size_t n);
+    // A memtable holding n bytes was freed.
+    void FreeMem(size_t n);
+
+private:
+    // Charges or releases dummy cache entries until they cover memory_used_.
+    void UpdateCacheCharge();
+
+    const size_t buffer_size_;
+    const size_t mutable_limit_;
+    std::atomic<size_t> memory_used_;
+    std::atomic<size_t> memory_active_;
+
+    std::mutex clients_mu_;
+    std::vector<Client*> clients_;
+
+    const std::shared_ptr<Cache> cache_;
+    mutable std::mutex cache_mu_;
+    // Prefix of the dummy entries' keys in cache_.
+    uint64_t cache_id_;
+    std::vector<Cache::Handle*> dummy_handles_;
+};
+
+}
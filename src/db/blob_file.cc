@@ -0,0 +1,170 @@
+#include "src/db/blob_file.h"
+#include <mutex>
+#include "src/util/coding.h"
+#include "src/util/crc32.h"
+
+namespace lsm {
+
+std::string BlobFileName(const std::string& dbname, uint64_t number) {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "%s/%06llu.blob", dbname.c_str(),
+             static_cast<unsigned long long>(number));
+    return std::string(buf);
+}
+
+void BlobIndex::EncodeTo(std::string* dst) const {
+    PutVarint64(dst, file_number);
+    PutVarint64(dst, offset);
+    PutVarint64(dst, size);
+}
+
+Status BlobIndex::DecodeFrom(Slice input) {
+    if (GetVarint64(&input, &file_number) &&
+        GetVarint64(&input, &offset) &&
+        GetVarint64(&input, &size) &&
+        input.empty()) {
+        return Status::OK();
+    }
+    return Status::Corruption("bad blob index");
+}
+
+BlobFileBuilder::BlobFileBuilder(const std::string& fname, uint64_t file_number)
+    : file_(fname, std::ios::out | std::ios::binary),
+      file_number_(file_number),
+      offset_(0),
+      num_records_(0) {
+    if (!file_.is_open()) {
+        status_ = Status::IOError("Failed to create blob file: ", fname);
+    }
+}
+
+Status BlobFileBuilder::Add(const Slice& user_key, const Slice& value, BlobIndex* index) {
+    if (!status_.ok()) {
+        return status_;
+    }
+
+    record_.assign(4, '\0');
+    PutVarint32(&record_, static_cast<uint32_t>(user_key.size()));
+    PutVarint32(&record_, static_cast<uint32_t>(value.size()));
+    record_.append(user_key.data(), user_key.size());
+    record_.append(value.data(), value.size());
+    EncodeFixed32(&record_[0], crc32c::Mask(crc32c::Value(record_.data() + 4,
+                                                          record_.size() - 4)));
+
+    file_.write(record_.data(), record_.size());
+    if (file_.fail()) {
+        status_ = Status::IOError("Failed to write blob record");
+        return status_;
+    }
+
+    index->file_number = file_number_;
+    index->offset = offset_;
+    index->size = record_.size();
+    offset_ += record_.size();
+    num_records_++;
+    return status_;
+}
+
+Status BlobFileBuilder::Finish() {
+    if (status_.ok()) {
+        file_.flush();
+        if (file_.fail()) {
+            status_ = Status::IOError("Failed to flush blob file");
+        }
+    }
+    file_.close();
+    return status_;
+}
+
+namespace {
+
+// An open blob file. Reads share one stream, so they are serialized.
+struct BlobFileReader {
+    std::ifstream file;
+    std::mutex mu;
+
+    Status Read(const ReadOptions& options, const BlobIndex& index, std::string* value) {
+        if (index.size < 4) {
+            return Status::Corruption("bad blob index");
+        }
+        std::string record(static_cast<size_t>(index.size), '\0');
+        {
+            std::lock_guard<std::mutex> l(mu);
+            file.clear();
+            file.seekg(static_cast<std::streamoff>(index.offset), std::ios::beg);
+            file.read(&record[0], record.size());
+            if (file.gcount() != static_cast<std::streamsize>(record.size())) {
+                return Status::IOError("truncated blob record read");
+            }
+        }
+
+        if (options.verify_checksums) {
+            const uint32_t expected = crc32c::Unmask(DecodeFixed32(record.data()));
+            if (crc32c::Value(record.data() + 4, record.size() - 4) != expected) {
+                return Status::Corruption("blob record checksum mismatch");
+            }
+        }
+
+        Slice input(record.data() + 4, record.size() - 4);
+        uint32_t key_size, value_size;
+        if (!GetVarint32(&input, &key_size) || !GetVarint32(&input, &value_size) ||
+            input.size() != static_cast<size_t>(key_size) + value_size) {
+            return Status::Corruption("bad blob record");
+        }
+        value->assign(input.data() + key_size, value_size);
+        return Status::OK();
+    }
+};
+
+void DeleteBlobFileReader(const Slice& /*key*/, void* value) {
+    delete reinterpret_cast<BlobFileReader*>(value);
+}
+
+}
+
+BlobFileCache::BlobFileCache(const std::string& dbname, int entries)
+    : dbname_(dbname),
+      cache_(NewLRUCache(entries)) {
+}
+
+BlobFileCache::~BlobFileCache() {
+    delete cache_;
+}
+
+Status BlobFileCache::FindFile(uint64_t file_number, Cache::Handle** handle) {
+    char buf[sizeof(file_number)];
+    EncodeFixed64(buf, file_number);
+    Slice key(buf, sizeof(buf));
+    *handle = cache_->Lookup(key);
+    if (*handle == nullptr) {
+        std::string fname = BlobFileName(dbname_, file_number);
+        BlobFileReader* reader = new BlobFileReader;
+        reader->file.open(fname, std::ios::in | std::ios::binary);
+        if (!reader->file.is_open()) {
+            delete reader;
+            return Status::IOError("Failed to open blob file: ", fname);
+        }
+        *handle = cache_->Insert(key, reader, 1, &DeleteBlobFileReader);
+    }
+    return Status::OK();
+}
+
+Status BlobFileCache::Get(const ReadOptions& options, const BlobIndex& index,
+                          std::string* value) {
+    Cache::Handle* handle = nullptr;
+    Status s = FindFile(index.file_number, &handle);
+    if (s.ok()) {
+        BlobFileReader* reader = reinterpret_cast<BlobFileReader*>(cache_->Value(handle));
+        s = reader->Read(options, index, value);
+        cache_->Release(handle);
+    }
+    return s;
+}
+
+void BlobFileCache::Evict(uint64_t file_number) {
+    char buf[sizeof(file_number)];
+    EncodeFixed64(buf, file_number);
+    cache_->Erase(Slice(buf, sizeof(buf)));
+}
+
+}
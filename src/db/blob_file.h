@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include "lsm/options.h"
+#include "lsm/slice.h"
+#include "lsm/status.h"
+#include "lsm/cache.h"
+
+namespace lsm {
+
+// Blob files hold large values moved out of the LSM tree (key-value
+// separation). Each file is a sequence of records:
+//    crc: uint32           (masked crc32c of the rest of the record)
+//    key_size: varint32
+//    value_size: varint32
+//    key: char[key_size]
+//    value: char[value_size]
+// Tables store an encoded BlobIndex, tagged kTypeBlobIndex, in place of
+// the value.
+
+std::string BlobFileName(const std::string& dbname, uint64_t number);
+
+struct BlobIndex {
+    uint64_t file_number = 0;
+    uint64_t offset = 0;   // Start of the record in the blob file.
+    uint64_t size = 0;     // Size of the whole record.
+
+    void EncodeTo(std::string* dst) const;
+    Status DecodeFrom(Slice input);
+};
+
+// Appends records to a new blob file. Not thread-safe.
+class BlobFileBuilder {
+public:
+    BlobFileBuilder(const std::string& fname, uint64_t file_number);
+
+    BlobFileBuilder(const BlobFileBuilder&) = delete;
+    BlobFileBuilder& operator=(const BlobFileBuilder&) = delete;
+
+    // Appends user_key -> value and stores the record location in *index.
+    Status Add(const Slice& user_key, const Slice& value, BlobIndex* index);
+
+    // Flushes and closes the file.
+    Status Finish();
+
+    uint64_t NumRecords() const { return num_records_; }
+
+    uint64_t FileSize() const { return offset_; }
+
+private:
+    std::ofstream file_;
+    const uint64_t file_number_;
+    uint64_t offset_;
+    uint64_t num_records_;
+    Status status_;
+    std::string record_;
+};
+
+// Caches open blob files, the blob counterpart of TableCache.
+// Thread-safe.
+class BlobFileCache {
+public:
+    BlobFileCache(const std::string& dbname, int entries);
+    ~BlobFileCache();
+
+    BlobFileCache(const BlobFileCache&) = delete;
+    BlobFileCache& operator=(const BlobFileCache&) = delete;
+
+    // Reads the value referenced by index into *value.
+    Status Get(const ReadOptions& options, const BlobIndex& index, std::string* value);
+
+    void Evict(uint64_t file_number);
+
+private:
+    Status FindFile(uint64_t file_number, Cache::Handle** handle);
+
+    const std::string dbname_;
+    Cache* cache_;
+};
+
+}
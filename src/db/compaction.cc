@@ -13,8 +13,9 @@ static int64_t TotalFileSize(const std::vector<FileMetaData*>& files) {
     return sum;
 }
 
-Compaction::Compaction(const Options* options, int level)
+Compaction::Compaction(const Options* options, int level, int output_level)
     : level_(level),
+      output_level_(output_level),
       max_output_file_size_(options->max_file_size),
       input_version_(nullptr),
       grandparent_index_(0),
@@ -44,14 +45,14 @@ bool Compaction::IsTrivialMove() const {
 void Compaction::AddInputDeletions(VersionEdit* edit) {
     for (int which = 0; which < 2; which++) {
         for (size_t i = 0; i < inputs_[which].size(); i++) {
-            edit->DeleteFile(level_ + which, inputs_[which][i]->number);
+            edit->DeleteFile(which == 0 ? level_ : output_level_, inputs_[which][i]->number);
         }
     }
 }
 
 bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
     const Comparator* user_cmp = input_version_->vset_->options_->comparator;
-    for (int lvl = level_ + 2; lvl < lsm::Options::kNumLevels; lvl++) {
+    for (int lvl = output_level_ + 1; lvl < lsm::Options::kNumLevels; lvl++) {
         const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
         while (level_ptrs_[lvl] < files.size()) {
             FileMetaData* f = files[level_ptrs_[lvl]];
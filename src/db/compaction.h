@@ -22,6 +22,11 @@ public:
 
     int level() const { return level_; }
 
+    // Level the outputs go to: level() + 1, except for level-0 compactions
+    // under Options::level_compaction_dynamic_level_bytes, which write to
+    // the base level.
+    int output_level() const { return output_level_; }
+
     VersionEdit* edit() { return &edit_; }
 
     int num_input_files(int which) const { return inputs_[which].size(); }
@@ -45,9 +50,10 @@ private:
     friend class VersionSet;
     friend class DBImpl;
 
-    Compaction(const Options* options, int level);
+    Compaction(const Options* options, int level, int output_level);
 
     int level_;
+    int output_level_;
     uint64_t max_output_file_size_;
     Version* input_version_;
     VersionEdit edit_;
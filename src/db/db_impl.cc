@@ -1,11 +1,23 @@
 #include "src/db/db_impl.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <random>
+#include <set>
 #include <vector>
 #include <string>
 #include "lsm/comparator.h"
+#include "src/table/format.h"
 #include "src/table/sstable_builder.h"
+#include "src/table/sstable_reader.h"
 #include "src/table/table_cache.h"
 #include "src/db/merger.h"
 #include "src/util/coding.h"
+#include "src/util/crc32.h"
+#include "src/util/file.h"
 #include <sys/stat.h>
 
 #ifdef _WIN32
@@ -24,9 +36,13 @@ struct DBImpl::Writer {
     Slice key;
     Slice value;
     ValueType type;
+    // Holds the front of the queue without writing anything, keeping other
+    // writers out while files are ingested. Never batched.
+    bool exclusive;
 
     Writer(const WriteOptions* opt, ValueType t, const Slice& k, const Slice& v)
-        : done(false), options(opt), sequence(0), key(k), value(v), type(t) {}
+        : done(false), options(opt), sequence(0), key(k), value(v), type(t),
+          exclusive(false) {}
 };
 
 static std::string LogFileName(const std::string& dbname, uint64_t number) {
@@ -43,8 +59,24 @@ static std::string TableFileName(const std::string& dbname, uint64_t number) {
     return std::string(buf);
 }
 
+// Tables the table cache may hold open; the rest of max_open_files is left
+// for logs, blob files and the like. Unlimited keeps every table open in
+// its FileMetaData instead, so the cache only sees files that failed to.
+static int TableCacheSize(const Options& options) {
+    static const int kNumNonTableCacheFiles = 10;
+    if (options.max_open_files < 0) {
+        return std::numeric_limits<int>::max();
+    }
+    return std::max(options.max_open_files - kNumNonTableCacheFiles, 20);
+}
+
 Status DB::Open(const Options& options, const std::string& name, DB** dbptr) {
     *dbptr = nullptr;
+    if (options.data_block_hash_index &&
+        !(options.data_block_hash_table_util_ratio > 0 &&
+          options.data_block_hash_table_util_ratio <= 1)) {
+        return Status::InvalidArgument("data_block_hash_table_util_ratio must be in (0, 1]");
+    }
 
     DBImpl* impl = new DBImpl(options, name);
     impl->mutex_.lock();
@@ -65,7 +97,10 @@ Status DB::Open(const Options& options, const std::string& name, DB** dbptr) {
         return Status::InvalidArgument(name, "exists (error_if_exists is true)");
     }
 
-    Status s = impl->Recover();
+    Status s = impl->table_cache_->status();
+    if (s.ok()) {
+        s = impl->Recover();
+    }
     if (s.ok()) {
         uint64_t new_log_number = impl->versions_->NewFileNumber();
         impl->log_.reset(new WalWriter(LogFileName(name, new_log_number)));
@@ -74,11 +109,38 @@ Status DB::Open(const Options& options, const std::string& name, DB** dbptr) {
         s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
     }
 
+    // The dump names tables by file number, so it is matched only against
+    // the version recovered here. Tables flushed after open may reuse the
+    // numbers of tables that were live when the dump was written.
+    Version* dump_version = nullptr;
+    if (s.ok() && !options.block_cache_dump_path.empty()) {
+        dump_version = impl->versions_->current();
+        dump_version->Ref();
+    }
     if (s.ok()) {
         impl->MaybeScheduleCompaction();
     }
     impl->mutex_.unlock();
 
+    if (dump_version != nullptr) {
+        // A missing or damaged dump just leaves the cache cold.
+        impl->cache_load_thread_ = std::thread(
+            [impl, dump_version, path = options.block_cache_dump_path] {
+                impl->LoadBlockCacheForVersion(path, dump_version);
+            });
+    }
+    if (s.ok() && options.table_warmup_threads > 0) {
+        impl->mutex_.lock();
+        Version* v = impl->versions_->current();
+        v->Ref();
+        impl->mutex_.unlock();
+        if (options.table_warmup_in_background) {
+            impl->warmup_thread_ = std::thread(&DBImpl::WarmTables, impl, v);
+        } else {
+            impl->WarmTables(v);
+        }
+    }
+
     if (s.ok()) {
         *dbptr = impl;
     } else {
@@ -93,23 +155,35 @@ DBImpl::DBImpl(const Options& options, const std::string& dbname)
       internal_comparator_(options.comparator),
       internal_options_(options),
       table_cache_(nullptr),
+      blob_cache_(nullptr),
       shutting_down_(false),
       bg_compaction_scheduled_(false),
-      mem_(new MemTable(internal_comparator_)),
+      warmup_done_(0),
+      warmup_total_(0),
+      mem_(new MemTable(internal_comparator_, options.write_buffer_manager.get())),
       imm_(nullptr),
       has_imm_(false),
       logfile_number_(0),
-      versions_(nullptr) {
+      versions_(nullptr),
+      running_compaction_(nullptr) {
     internal_options_.comparator = &internal_comparator_;
-    table_cache_ = new TableCache(dbname, &internal_options_, internal_options_.block_cache_capacity);
-    versions_ = new VersionSet(dbname, &internal_options_, table_cache_);
+    table_cache_ = new TableCache(dbname, &internal_options_, TableCacheSize(internal_options_));
+    blob_cache_ = new BlobFileCache(dbname, internal_options_.max_open_files);
+    versions_ = new VersionSet(dbname, &options_, table_cache_, blob_cache_);
     mem_->Ref();
 
     // Start the persistent background compaction thread
     bg_thread_ = std::thread(&DBImpl::BackgroundThreadMain, this);
+
+    if (options_.write_buffer_manager != nullptr) {
+        options_.write_buffer_manager->RegisterClient(this);
+    }
 }
 
 DBImpl::~DBImpl() {
+    if (options_.write_buffer_manager != nullptr) {
+        options_.write_buffer_manager->UnregisterClient(this);
+    }
     {
         std::unique_lock<std::mutex> l(mutex_);
         shutting_down_.store(true, std::memory_order_release);
@@ -120,6 +194,12 @@ DBImpl::~DBImpl() {
     if (bg_thread_.joinable()) {
         bg_thread_.join();
     }
+    if (warmup_thread_.joinable()) {
+        warmup_thread_.join();
+    }
+    if (cache_load_thread_.joinable()) {
+        cache_load_thread_.join();
+    }
 
     {
         std::unique_lock<std::mutex> l(mutex_);
@@ -128,10 +208,15 @@ DBImpl::~DBImpl() {
         }
     }
 
+    if (!options_.block_cache_dump_path.empty()) {
+        DumpBlockCache(options_.block_cache_dump_path);
+    }
+
     if (mem_ != nullptr) mem_->Unref();
     if (imm_ != nullptr) imm_->Unref();
     delete versions_;
     delete table_cache_;
+    delete blob_cache_;
 }
 
 Status DBImpl::Recover() {
@@ -163,20 +248,39 @@ Status DBImpl::MakeRoomForWrite(bool force) {
             bg_cv_.wait(wait_lock);
             wait_lock.release();
         } else {
-            uint64_t new_log_number = versions_->NewFileNumber();
-            log_.reset(new WalWriter(LogFileName(dbname_, new_log_number)));
-            logfile_number_ = new_log_number;
-            imm_ = mem_;
-            has_imm_.store(true, std::memory_order_release);
-            mem_ = new MemTable(internal_comparator_);
-            mem_->Ref();
+            SwitchMemTable();
             force = false;
-            MaybeScheduleCompaction();
         }
     }
     return s;
 }
 
+void DBImpl::SwitchMemTable() {
+    uint64_t new_log_number = versions_->NewFileNumber();
+    log_.reset(new WalWriter(LogFileName(dbname_, new_log_number)));
+    logfile_number_ = new_log_number;
+    mem_->MarkImmutable();
+    imm_ = mem_;
+    has_imm_.store(true, std::memory_order_release);
+    mem_ = new MemTable(internal_comparator_, options_.write_buffer_manager.get());
+    mem_->Ref();
+    MaybeScheduleCompaction();
+}
+
+size_t DBImpl::MutableMemtableSize() {
+    std::lock_guard<std::mutex> l(mutex_);
+    return mem_->ApproximateMemoryUsage();
+}
+
+void DBImpl::FlushMemtable() {
+    std::lock_guard<std::mutex> l(mutex_);
+    // With imm_ still being flushed, that flush is what frees memory next.
+    if (imm_ == nullptr && mem_->ApproximateMemoryUsage() > 0 && bg_error_.ok() &&
+        !shutting_down_.load(std::memory_order_acquire)) {
+        SwitchMemTable();
+    }
+}
+
 // ---------------------------------------------------------------------------
 // Group commit: Put and Delete both enqueue a Writer and call Write().
 // The leader thread batches all queued writers into a single WAL record
@@ -203,6 +307,7 @@ DBImpl::Writer* DBImpl::BuildBatchGroup(Writer** last_writer) {
 
     for (auto it = writers_.begin() + 1; it != writers_.end(); ++it) {
         Writer* w = *it;
+        if (w->exclusive) break;
         size += w->key.size() + w->value.size();
         if (size > kMaxBatchSize) break;
         *last_writer = w;
@@ -285,6 +390,14 @@ Status DBImpl::Write(Writer* my_writer) {
 
     my_writer->status = s;
     my_writer->done = true;
+
+    // The largest memtable may belong to another DB, whose mutex must not
+    // be taken while holding this one.
+    l.unlock();
+    WriteBufferManager* wbm = options_.write_buffer_manager.get();
+    if (wbm != nullptr && wbm->ShouldFlush()) {
+        wbm->FlushLargest();
+    }
     return s;
 }
 
@@ -304,10 +417,64 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key, std::string* va
     
     l.unlock();
 
+    bool have_stat_update = false;
+    Version::GetStats stats = {nullptr, -1};
     if (mem->Get(lkey, value, &s)) {
     } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
     } else {
-        current->Get(options, lkey.internal_key(), value, &s);
+        current->Get(options, lkey.internal_key(), value, &s, &stats);
+        have_stat_update = true;
+    }
+
+    l.lock();
+    if (have_stat_update && current->UpdateStats(stats)) {
+        MaybeScheduleCompaction();
+    }
+    mem->Unref();
+    if (imm != nullptr) imm->Unref();
+    current->Unref();
+
+    return s;
+}
+
+std::vector<Status> DBImpl::MultiGet(const ReadOptions& options,
+                                     const std::vector<Slice>& keys,
+                                     std::vector<std::string>* values) {
+    std::unique_lock<std::mutex> l(mutex_);
+
+    MemTable* mem = mem_;
+    MemTable* imm = imm_;
+    Version* current = versions_->current();
+    mem->Ref();
+    if (imm != nullptr) imm->Ref();
+    current->Ref();
+
+    uint64_t seq = versions_->LastSequence();
+
+    l.unlock();
+
+    std::vector<Status> statuses(keys.size());
+    values->resize(keys.size());
+
+    // Keys the memtables do not settle go to the version as one batch.
+    std::vector<std::unique_ptr<LookupKey>> lkeys;
+    std::vector<Slice> table_keys;
+    std::vector<std::string*> table_values;
+    std::vector<Status*> table_statuses;
+    for (size_t i = 0; i < keys.size(); i++) {
+        lkeys.emplace_back(new LookupKey(keys[i], seq));
+        const LookupKey& lkey = *lkeys.back();
+        std::string* value = &(*values)[i];
+        if (mem->Get(lkey, value, &statuses[i])) {
+        } else if (imm != nullptr && imm->Get(lkey, value, &statuses[i])) {
+        } else {
+            table_keys.push_back(lkey.internal_key());
+            table_values.push_back(value);
+            table_statuses.push_back(&statuses[i]);
+        }
+    }
+    if (!table_keys.empty()) {
+        current->MultiGet(options, table_keys, table_values, table_statuses);
     }
 
     l.lock();
@@ -315,9 +482,447 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key, std::string* va
     if (imm != nullptr) imm->Unref();
     current->Unref();
 
+    return statuses;
+}
+
+Status DBImpl::GetPropertiesOfAllTables(TablePropertiesCollection* props) {
+    std::unique_lock<std::mutex> l(mutex_);
+    Version* current = versions_->current();
+    current->Ref();
+    l.unlock();
+
+    props->clear();
+    Status s = current->GetPropertiesOfAllTables(props);
+
+    l.lock();
+    current->Unref();
+    return s;
+}
+
+// Block cache dump: fixed64 magic, then per block varint64 file number,
+// varint64 offset and a priority byte (0 high, 1 low); finally fixed32
+// masked crc of everything before it.
+static const uint64_t kBlockCacheDumpMagic = 0x626c6b64756d7031ull;
+
+Status DBImpl::DumpBlockCache(const std::string& fname) {
+    std::vector<CachedBlockRef> blocks;
+    table_cache_->ListCachedBlocks(&blocks);
+    std::string data;
+    PutFixed64(&data, kBlockCacheDumpMagic);
+    for (const CachedBlockRef& b : blocks) {
+        PutVarint64(&data, b.file_number);
+        PutVarint64(&data, b.offset);
+        data.push_back(b.priority == Cache::Priority::kHigh ? 0 : 1);
+    }
+    PutFixed32(&data, crc32c::Mask(crc32c::Value(data.data(), data.size())));
+
+    const std::string tmp = fname + ".tmp";
+    WritableFile* out = nullptr;
+    Status s = NewWritableFile(tmp, false, &out);
+    if (!s.ok()) {
+        return s;
+    }
+    s = out->Append(data);
+    if (s.ok()) {
+        s = out->Sync();
+    }
+    if (s.ok()) {
+        s = out->Close();
+    }
+    delete out;
+    if (s.ok()) {
+#ifdef _WIN32
+        std::remove(fname.c_str());
+#endif
+        if (std::rename(tmp.c_str(), fname.c_str()) != 0) {
+            s = Status::IOError(tmp, "rename failed");
+        }
+    }
+    return s;
+}
+
+// Reads the dump fname into *by_file, keyed by file number.
+static Status ReadBlockCacheDump(const std::string& fname,
+                                 std::map<uint64_t, std::vector<CachedBlockRef>>* by_file) {
+    std::ifstream in(fname, std::ios::binary);
+    if (!in) {
+        return Status::NotFound(fname);
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() < 12 ||
+        crc32c::Unmask(DecodeFixed32(data.data() + data.size() - 4)) !=
+            crc32c::Value(data.data(), data.size() - 4) ||
+        DecodeFixed64(data.data()) != kBlockCacheDumpMagic) {
+        return Status::Corruption(fname, "not a block cache dump");
+    }
+    Slice input(data.data() + 8, data.size() - 12);
+    while (!input.empty()) {
+        CachedBlockRef b;
+        if (!GetVarint64(&input, &b.file_number) || !GetVarint64(&input, &b.offset) ||
+            input.empty()) {
+            return Status::Corruption(fname, "truncated block");
+        }
+        b.priority = input[0] == 0 ? Cache::Priority::kHigh : Cache::Priority::kLow;
+        input.remove_prefix(1);
+        (*by_file)[b.file_number].push_back(b);
+    }
+    return Status::OK();
+}
+
+Status DBImpl::LoadBlockCache(const std::string& fname) {
+    std::unique_lock<std::mutex> l(mutex_);
+    Version* current = versions_->current();
+    current->Ref();
+    l.unlock();
+    return LoadBlockCacheForVersion(fname, current);
+}
+
+Status DBImpl::LoadBlockCacheForVersion(const std::string& fname, Version* v) {
+    std::map<uint64_t, std::vector<CachedBlockRef>> by_file;
+    Status s = ReadBlockCacheDump(fname, &by_file);
+
+    // Files compacted away since the dump are simply not in the version;
+    // a file that fails to load is left to be read on demand.
+    for (int level = 0; s.ok() && level < lsm::Options::kNumLevels; level++) {
+        for (FileMetaData* f : v->files_[level]) {
+            if (shutting_down_.load(std::memory_order_acquire)) {
+                break;
+            }
+            auto it = by_file.find(f->number);
+            if (it == by_file.end()) {
+                continue;
+            }
+            std::vector<CachedBlockRef>& blocks = it->second;
+            std::sort(blocks.begin(), blocks.end(),
+                      [](const CachedBlockRef& a, const CachedBlockRef& b) {
+                          return a.offset < b.offset;
+                      });
+            table_cache_->LoadCachedBlocks(f->number, f->file_size, blocks, f->table.get());
+        }
+    }
+
+    std::lock_guard<std::mutex> l(mutex_);
+    v->Unref();
     return s;
 }
 
+void DBImpl::RecordReadSample(const Slice& internal_key) {
+    std::lock_guard<std::mutex> l(mutex_);
+    if (versions_->current()->RecordReadSample(internal_key)) {
+        MaybeScheduleCompaction();
+    }
+}
+
+bool DBImpl::GetProperty(const Slice& property, std::string* value) {
+    if (property == Slice("lsm.table-warmup-progress")) {
+        *value = std::to_string(warmup_done_.load(std::memory_order_relaxed)) + "/" +
+                 std::to_string(warmup_total_.load(std::memory_order_relaxed));
+        return true;
+    }
+    Slice in = property;
+    const Slice prefix("lsm.num-files-at-level");
+    if (in.starts_with(prefix)) {
+        in.remove_prefix(prefix.size());
+        if (in.size() != 1 || in[0] < '0' || in[0] >= '0' + lsm::Options::kNumLevels) {
+            return false;
+        }
+        std::lock_guard<std::mutex> l(mutex_);
+        *value = std::to_string(versions_->NumLevelFiles(in[0] - '0'));
+        return true;
+    }
+    return false;
+}
+
+void DBImpl::WarmTables(Version* v) {
+    std::vector<FileMetaData*> files;
+    for (int level = 0; level < lsm::Options::kNumLevels; level++) {
+        files.insert(files.end(), v->files_[level].begin(), v->files_[level].end());
+    }
+    warmup_total_.store(files.size(), std::memory_order_relaxed);
+
+    // Errors are left for the first read of the file to report.
+    std::atomic<size_t> next(0);
+    auto warm = [&] {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            if (shutting_down_.load(std::memory_order_acquire)) {
+                return;
+            }
+            FileMetaData* f = files[i];
+            table_cache_->Warm(f->number, f->file_size, options_.table_warmup_data_blocks,
+                               f->table.get());
+            warmup_done_.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+    const size_t num_threads =
+        std::min(files.size(), static_cast<size_t>(options_.table_warmup_threads));
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; i++) {
+        threads.emplace_back(warm);
+    }
+    warm();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    std::lock_guard<std::mutex> l(mutex_);
+    v->Unref();
+}
+
+// Copies src to dst, or renames it when move is set.
+static Status PlaceExternalFile(const std::string& src, const std::string& dst, bool move) {
+    if (move) {
+        if (std::rename(src.c_str(), dst.c_str()) != 0) {
+            return Status::IOError(src, "rename failed");
+        }
+        return Status::OK();
+    }
+    std::ifstream in(src, std::ios::binary);
+    std::ofstream out(dst, std::ios::binary | std::ios::trunc);
+    if (!in || !out) {
+        return Status::IOError(src, "cannot copy");
+    }
+    out << in.rdbuf();
+    out.flush();
+    if (!out) {
+        std::remove(dst.c_str());
+        return Status::IOError(dst, "copy failed");
+    }
+    return Status::OK();
+}
+
+// Overwrites the global sequence number block at offset, and its trailer
+// checksum, in place.
+static Status PatchGlobalSeqno(const std::string& fname, uint64_t offset, uint64_t seqno) {
+    std::fstream f(fname, std::ios::in | std::ios::out | std::ios::binary);
+    if (!f) {
+        return Status::IOError(fname, "cannot open for patching");
+    }
+    char buf[8 + kBlockTrailerSize];
+    f.seekg(offset);
+    f.read(buf, sizeof(buf));
+    if (!f) {
+        return Status::Corruption(fname, "truncated global seqno block");
+    }
+    EncodeFixed64(buf, seqno);
+    EncodeFixed32(buf + 9, ComputeBlockChecksum(buf, 8, buf[8]));
+    f.seekp(offset);
+    f.write(buf, sizeof(buf));
+    f.flush();
+    if (!f) {
+        return Status::IOError(fname, "cannot write global seqno");
+    }
+    return Status::OK();
+}
+
+// Returns true iff mem holds an entry whose user key lies in [smallest, largest].
+static bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                             const Slice& smallest, const Slice& largest) {
+    std::unique_ptr<Iterator> iter(mem->NewIterator());
+    InternalKey start(smallest, kMaxSequenceNumber, kValueTypeForSeek);
+    iter->Seek(start.Encode());
+    return iter->Valid() &&
+           ucmp->Compare(InternalKey::ExtractUserKey(iter->key()), largest) <= 0;
+}
+
+Status DBImpl::IngestExternalFiles(const IngestExternalFileOptions& options,
+                                   const std::vector<std::string>& files) {
+    if (files.empty()) {
+        return Status::InvalidArgument("no files to ingest");
+    }
+    const Comparator* ucmp = internal_comparator_.user_comparator();
+
+    struct IngestedFile {
+        std::string path;
+        uint64_t file_size;
+        uint64_t seqno_offset;
+        std::string smallest;
+        std::string largest;
+        ValueType smallest_type;
+        ValueType largest_type;
+        TableProperties properties;
+        uint64_t number;
+        std::string internal_path;
+    };
+    std::vector<IngestedFile> ingested(files.size());
+
+    // Validate the files before touching the DB.
+    for (size_t i = 0; i < files.size(); i++) {
+        IngestedFile& f = ingested[i];
+        f.path = files[i];
+        struct stat st;
+        if (stat(f.path.c_str(), &st) != 0) {
+            return Status::InvalidArgument(f.path, "does not exist");
+        }
+        f.file_size = static_cast<uint64_t>(st.st_size);
+
+        Table* raw_table = nullptr;
+        Status s = Table::Open(internal_options_, f.path, f.file_size, &raw_table);
+        if (!s.ok()) {
+            return s;
+        }
+        std::unique_ptr<Table> table(raw_table);
+        f.seqno_offset = table->GlobalSeqnoOffset();
+        if (f.seqno_offset == 0) {
+            return Status::InvalidArgument(f.path, "not written by SstFileWriter");
+        }
+        std::unique_ptr<Iterator> iter(table->NewIterator(ReadOptions()));
+        ParsedInternalKey ikey;
+        iter->SeekToFirst();
+        if (!iter->Valid() || !ParseInternalKey(iter->key(), &ikey)) {
+            return Status::InvalidArgument(f.path, "empty table");
+        }
+        f.smallest = ikey.user_key.ToString();
+        f.smallest_type = ikey.type;
+        iter->SeekToLast();
+        if (!iter->Valid() || !ParseInternalKey(iter->key(), &ikey)) {
+            return Status::Corruption(f.path, "cannot read largest key");
+        }
+        f.largest = ikey.user_key.ToString();
+        f.largest_type = ikey.type;
+        if (!iter->status().ok()) {
+            return iter->status();
+        }
+        f.properties = table->GetTableProperties();
+    }
+
+    // All files get the same sequence number, so they must not overlap.
+    std::sort(ingested.begin(), ingested.end(),
+              [ucmp](const IngestedFile& a, const IngestedFile& b) {
+                  return ucmp->Compare(a.smallest, b.smallest) < 0;
+              });
+    for (size_t i = 1; i < ingested.size(); i++) {
+        if (ucmp->Compare(ingested[i - 1].largest, ingested[i].smallest) >= 0) {
+            return Status::InvalidArgument(ingested[i].path, "overlaps another ingested file");
+        }
+    }
+
+    // Hold the front of the write queue so no write can take a sequence
+    // number while the files are being installed.
+    std::unique_lock<std::mutex> l(mutex_);
+    Writer w(nullptr, kTypeValue, Slice(), Slice());
+    w.exclusive = true;
+    writers_.push_back(&w);
+    while (&w != writers_.front()) {
+        w.cv.wait(l);
+    }
+
+    // Data in the memtables is older than the ingested files but would
+    // shadow them on reads, so flush it first. This must happen before file
+    // numbers are allocated, since level-0 files are ordered by number.
+    Status s;
+    bool overlaps_memtable = false;
+    for (const IngestedFile& f : ingested) {
+        if (MemTableOverlaps(mem_, ucmp, f.smallest, f.largest) ||
+            (imm_ != nullptr && MemTableOverlaps(imm_, ucmp, f.smallest, f.largest))) {
+            overlaps_memtable = true;
+            break;
+        }
+    }
+    if (overlaps_memtable) {
+        s = MakeRoomForWrite(true);
+        while (s.ok() && imm_ != nullptr) {
+            if (!bg_error_.ok()) {
+                s = bg_error_;
+                break;
+            }
+            bg_cv_.wait(l);
+        }
+    }
+
+    const uint64_t seqno = versions_->LastSequence() + 1;
+    for (IngestedFile& f : ingested) {
+        f.number = versions_->NewFileNumber();
+        f.internal_path = TableFileName(dbname_, f.number);
+    }
+    l.unlock();
+
+    size_t placed = 0;
+    for (const IngestedFile& f : ingested) {
+        if (!s.ok()) break;
+        s = PlaceExternalFile(f.path, f.internal_path, options.move_files);
+        if (!s.ok()) break;
+        placed++;
+        s = PatchGlobalSeqno(f.internal_path, f.seqno_offset, seqno);
+        if (!s.ok()) break;
+    }
+
+    // Files are added at level 0 and moved to their final level once the
+    // current version can be inspected under the lock.
+    VersionEdit edit;
+    if (s.ok()) {
+        for (const IngestedFile& f : ingested) {
+            TableProperties props = f.properties;
+            props.smallest_seqno = seqno;
+            props.largest_seqno = seqno;
+            edit.AddFile(0, f.number, f.file_size,
+                         InternalKey(f.smallest, seqno, f.smallest_type),
+                         InternalKey(f.largest, seqno, f.largest_type),
+                         props);
+        }
+        versions_->PinTables(&edit);
+    }
+
+    l.lock();
+
+    if (s.ok()) {
+        Version* current = versions_->current();
+        const Compaction* c = running_compaction_;
+        for (size_t n = 0; n < ingested.size(); n++) {
+            const IngestedFile& f = ingested[n];
+            Slice smallest(f.smallest), largest(f.largest);
+            bool overlaps_compaction = false;
+            if (c != nullptr) {
+                for (int which = 0; which < 2 && !overlaps_compaction; which++) {
+                    for (int i = 0; i < c->num_input_files(which); i++) {
+                        const FileMetaData* in = c->input(which, i);
+                        if (ucmp->Compare(smallest, in->largest.user_key()) <= 0 &&
+                            ucmp->Compare(largest, in->smallest.user_key()) >= 0) {
+                            overlaps_compaction = true;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            // Deepest level such that nothing above it overlaps the file. Older
+            // compaction outputs may not land above the file either.
+            int level = 0;
+            for (int lvl = 0; lvl < lsm::Options::kNumLevels; lvl++) {
+                if (current->OverlapInLevel(lvl, &smallest, &largest)) break;
+                if (overlaps_compaction && lvl > c->level()) break;
+                level = lvl;
+            }
+            edit.SetNewFileLevel(n, level);
+        }
+        versions_->SetLastSequence(seqno);
+        s = versions_->LogAndApply(&edit, &mutex_);
+    }
+
+    if (!s.ok()) {
+        for (size_t i = 0; i < placed; i++) {
+            if (options.move_files) {
+                std::rename(ingested[i].internal_path.c_str(), ingested[i].path.c_str());
+            } else {
+                std::remove(ingested[i].internal_path.c_str());
+            }
+        }
+    }
+
+    writers_.pop_front();
+    if (!writers_.empty()) {
+        writers_.front()->cv.notify_one();
+    }
+    if (s.ok()) {
+        MaybeScheduleCompaction();
+    }
+    return s;
+}
+
+// Iterators sample about one key in every kReadBytesPeriod bytes they read,
+// so that ranges scanned often through overlapping files get compacted like
+// ranges looked up often.
+static const size_t kReadBytesPeriod = 1048576;
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
     std::unique_lock<std::mutex> l(mutex_);
     MemTable* mem = mem_;
@@ -337,8 +942,12 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
     
     class DBIterator : public Iterator {
     public:
-        DBIterator(DBImpl* db, const Comparator* ucmp, Iterator* iter, uint64_t s, MemTable* m, MemTable* im, Version* v)
-            : db_(db), user_comparator_(ucmp), iter_(iter), sequence_(s), mem_(m), imm_(im), version_(v) {
+        DBIterator(DBImpl* db, const ReadOptions& options, const Comparator* ucmp, Iterator* iter,
+                   uint64_t s, MemTable* m, MemTable* im, Version* v)
+            : db_(db), options_(options), user_comparator_(ucmp), iter_(iter), sequence_(s),
+              mem_(m), imm_(im), version_(v), direction_(kForward), valid_(false),
+              saved_type_(kTypeValue), rnd_(static_cast<uint32_t>(s) + 1),
+              bytes_until_read_sampling_(RandomCompactionPeriod()) {
         }
         ~DBIterator() override {
             delete iter_;
@@ -346,79 +955,214 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
             mem_->Unref();
             if (imm_ != nullptr) imm_->Unref();
             version_->Unref();
+            db_->DeleteObsoleteBlobFiles();
         }
 
-        bool Valid() const override { return iter_->Valid(); }
-        Status status() const override { return iter_->status(); }
-        Slice key() const override { return InternalKey::ExtractUserKey(iter_->key()); }
-        Slice value() const override { return iter_->value(); }
+        bool Valid() const override { return valid_; }
+        Status status() const override {
+            if (!blob_status_.ok()) return blob_status_;
+            return iter_->status();
+        }
+        Slice key() const override {
+            assert(valid_);
+            return direction_ == kForward ? InternalKey::ExtractUserKey(iter_->key())
+                                          : Slice(saved_key_);
+        }
+        Slice value() const override {
+            assert(valid_);
+            ValueType type = saved_type_;
+            Slice raw = saved_value_;
+            if (direction_ == kForward) {
+                ParsedInternalKey ikey;
+                type = ParseInternalKey(iter_->key(), &ikey) ? ikey.type : kTypeValue;
+                raw = iter_->value();
+            }
+            if (type == kTypeBlobIndex) {
+                BlobIndex index;
+                Status s = index.DecodeFrom(raw);
+                if (s.ok()) {
+                    s = db_->blob_cache_->Get(options_, index, &blob_value_);
+                }
+                if (!s.ok()) {
+                    blob_status_ = s;
+                    blob_value_.clear();
+                }
+                return Slice(blob_value_);
+            }
+            return raw;
+        }
 
         void Next() override {
-            iter_->Next();
+            assert(valid_);
+            if (direction_ == kReverse) {
+                direction_ = kForward;
+                // iter_ is just before the entries for saved_key_; step into
+                // them and let FindNextUserEntry() skip past them.
+                if (!iter_->Valid()) {
+                    iter_->SeekToFirst();
+                } else {
+                    iter_->Next();
+                }
+            } else {
+                // Older versions of the current key follow it; skip them too.
+                SaveKey(InternalKey::ExtractUserKey(iter_->key()));
+                iter_->Next();
+            }
             FindNextUserEntry(true);
         }
 
         void Prev() override {
-            iter_->Prev();
+            assert(valid_);
+            if (direction_ == kForward) {
+                // Back up to the last entry of the previous user key, past
+                // every version of the current one.
+                SaveKey(InternalKey::ExtractUserKey(iter_->key()));
+                while (true) {
+                    iter_->Prev();
+                    if (!iter_->Valid()) {
+                        valid_ = false;
+                        saved_key_.clear();
+                        saved_value_.clear();
+                        return;
+                    }
+                    if (user_comparator_->Compare(InternalKey::ExtractUserKey(iter_->key()),
+                                                  Slice(saved_key_)) < 0) {
+                        break;
+                    }
+                }
+                direction_ = kReverse;
+            }
             FindPrevUserEntry();
         }
 
         void Seek(const Slice& target) override {
+            direction_ = kForward;
+            saved_key_.clear();
+            saved_value_.clear();
             LookupKey k(target, sequence_);
             iter_->Seek(k.internal_key());
             FindNextUserEntry(false);
         }
 
         void SeekToFirst() override {
+            direction_ = kForward;
+            saved_key_.clear();
+            saved_value_.clear();
             iter_->SeekToFirst();
             FindNextUserEntry(false);
         }
 
         void SeekToLast() override {
+            direction_ = kReverse;
+            saved_value_.clear();
             iter_->SeekToLast();
             FindPrevUserEntry();
         }
 
     private:
+        // Forward: iter_ is at the entry returned. Reverse: iter_ is just
+        // before every entry of saved_key_, whose newest visible version is
+        // in saved_value_ and saved_type_.
+        enum Direction { kForward, kReverse };
+
+        void SaveKey(const Slice& user_key) {
+            saved_key_.assign(user_key.data(), user_key.size());
+        }
+
+        size_t RandomCompactionPeriod() {
+            return std::uniform_int_distribution<size_t>(0, 2 * kReadBytesPeriod)(rnd_);
+        }
+
+        bool ParseKey(ParsedInternalKey* ikey) {
+            const size_t bytes_read = iter_->key().size() + iter_->value().size();
+            while (bytes_until_read_sampling_ < bytes_read) {
+                bytes_until_read_sampling_ += RandomCompactionPeriod();
+                db_->RecordReadSample(iter_->key());
+            }
+            bytes_until_read_sampling_ -= bytes_read;
+            return ParseInternalKey(iter_->key(), ikey);
+        }
+
+        // Moves iter_ to the newest visible, undeleted entry at or after it,
+        // skipping entries for saved_key_ while skipping.
         void FindNextUserEntry(bool skipping) {
-            std::string saved_key;
             while (iter_->Valid()) {
                 ParsedInternalKey ikey;
-                if (ParseInternalKey(iter_->key(), &ikey) && ikey.sequence <= sequence_) {
-                    if (skipping && user_comparator_->Compare(ikey.user_key, Slice(saved_key)) == 0) {
-                    } else {
-                        saved_key.assign(ikey.user_key.data(), ikey.user_key.size());
+                if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+                    if (skipping && user_comparator_->Compare(ikey.user_key, Slice(saved_key_)) <= 0) {
+                    } else if (ikey.type == kTypeDeletion) {
+                        // Older versions of a deleted key are hidden too.
+                        SaveKey(ikey.user_key);
                         skipping = true;
-                        if (ikey.type == kTypeDeletion) {
-                        } else {
-                            return;
-                        }
+                    } else {
+                        saved_key_.clear();
+                        valid_ = true;
+                        return;
                     }
                 }
                 iter_->Next();
             }
+            saved_key_.clear();
+            valid_ = false;
         }
-        
+
+        // Walking backwards meets the versions of a key oldest first, so
+        // keep the latest one seen until the previous key comes up.
         void FindPrevUserEntry() {
+            ValueType value_type = kTypeDeletion;
             while (iter_->Valid()) {
                 ParsedInternalKey ikey;
-                if (ParseInternalKey(iter_->key(), &ikey) && ikey.sequence <= sequence_ && ikey.type != kTypeDeletion) {
-                    return;
+                if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+                    if (value_type != kTypeDeletion &&
+                        user_comparator_->Compare(ikey.user_key, Slice(saved_key_)) < 0) {
+                        break;
+                    }
+                    value_type = ikey.type;
+                    if (value_type == kTypeDeletion) {
+                        saved_key_.clear();
+                        saved_value_.clear();
+                    } else {
+                        SaveKey(ikey.user_key);
+                        saved_value_.assign(iter_->value().data(), iter_->value().size());
+                        saved_type_ = value_type;
+                    }
                 }
                 iter_->Prev();
             }
+            if (value_type == kTypeDeletion) {
+                valid_ = false;
+                saved_key_.clear();
+                saved_value_.clear();
+                direction_ = kForward;
+            } else {
+                valid_ = true;
+            }
         }
 
         DBImpl* db_;
+        const ReadOptions options_;
         const Comparator* user_comparator_;
         Iterator* iter_;
         uint64_t sequence_;
         MemTable* mem_;
         MemTable* imm_;
         Version* version_;
+        Direction direction_;
+        bool valid_;
+        // Forward: the key being skipped. Reverse: the current key.
+        std::string saved_key_;
+        // Reverse only: the current entry's raw value and type.
+        std::string saved_value_;
+        ValueType saved_type_;
+        std::minstd_rand rnd_;
+        size_t bytes_until_read_sampling_;
+        // Value of the current entry when it lives in a blob file.
+        mutable std::string blob_value_;
+        mutable Status blob_status_;
     };
 
-    return new DBIterator(this, options_.comparator, internal_iter, versions_->LastSequence(), mem, imm, current);
+    return new DBIterator(this, options, options_.comparator, internal_iter,
+                          versions_->LastSequence(), mem, imm, current);
 }
 
 // ---------------------------------------------------------------------------
@@ -431,7 +1175,8 @@ void DBImpl::MaybeScheduleCompaction() {
 
     if (imm_ == nullptr &&
         versions_->current()->compaction_score_ < 1 &&
-        versions_->current()->file_to_compact_ == nullptr) {
+        versions_->current()->file_to_compact_ == nullptr &&
+        versions_->current()->deletion_file_to_compact_ == nullptr) {
         return;
     }
 
@@ -448,6 +1193,10 @@ void DBImpl::BackgroundThreadMain() {
         }
         BackgroundCall();
     }
+    // A request may have been scheduled after shutdown began; nothing will
+    // service it now, so clear it for the destructor's wait loop.
+    bg_compaction_scheduled_ = false;
+    bg_cv_.notify_all();
 }
 
 void DBImpl::BackgroundCall() {
@@ -456,6 +1205,7 @@ void DBImpl::BackgroundCall() {
     } else if (!bg_error_.ok()) {
     } else {
         BackgroundCompaction();
+        DeleteObsoleteBlobFiles();
     }
 
     bg_compaction_scheduled_ = false;
@@ -470,34 +1220,79 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
     FileMetaData meta;
     meta.number = versions_->NewFileNumber();
     std::string fname = TableFileName(dbname_, meta.number);
-    std::ofstream* file = new std::ofstream(fname, std::ios::out | std::ios::binary);
+    WritableFile* file = nullptr;
+    Status s = NewWritableFile(fname, options_.use_direct_io_for_flush_and_compaction, &file);
+    if (!s.ok()) {
+        return s;
+    }
 
     Options table_options = options_;
     table_options.comparator = &internal_comparator_;
+    table_options.compression = options_.CompressionForLevel(0);
     TableBuilder* builder = new TableBuilder(table_options, file);
+    std::unique_ptr<BlobFileBuilder> blob_builder;
+    uint64_t blob_number = 0;
     Iterator* iter = mem->NewIterator();
     iter->SeekToFirst();
     if (iter->Valid()) {
         meta.smallest.SetFrom(iter->key());
         InternalKey last;
+        ParsedInternalKey ikey;
+        std::string blob_ref;
         while (iter->Valid()) {
             last.SetFrom(iter->key());
-            builder->Add(iter->key(), iter->value());
+            if (options_.enable_blob_files &&
+                iter->value().size() >= options_.min_blob_size &&
+                ParseInternalKey(iter->key(), &ikey) && ikey.type == kTypeValue) {
+                // Key-value separation: the value goes to the blob file and
+                // the table keeps a reference under the same sequence.
+                if (blob_builder == nullptr) {
+                    blob_number = versions_->NewFileNumber();
+                    blob_builder.reset(new BlobFileBuilder(BlobFileName(dbname_, blob_number),
+                                                           blob_number));
+                }
+                BlobIndex index;
+                s = blob_builder->Add(ikey.user_key, iter->value(), &index);
+                if (!s.ok()) break;
+                blob_ref.clear();
+                index.EncodeTo(&blob_ref);
+                InternalKey blob_key(ikey.user_key, ikey.sequence, kTypeBlobIndex);
+                builder->Add(blob_key.Encode(), blob_ref);
+            } else {
+                builder->Add(iter->key(), iter->value());
+            }
             iter->Next();
         }
         meta.largest = last;
     }
-    Status s = builder->Finish();
+    if (s.ok()) {
+        s = builder->Finish();
+    } else {
+        builder->Abandon();
+    }
     meta.file_size = builder->FileSize();
+    meta.properties = builder->GetTableProperties();
+    if (blob_builder != nullptr) {
+        Status bs = blob_builder->Finish();
+        if (s.ok()) s = bs;
+    }
 
     delete iter;
     delete builder;
     delete file;
 
     if (s.ok()) {
-        edit->AddFile(0, meta.number, meta.file_size, meta.smallest, meta.largest);
+        edit->AddFile(0, meta.number, meta.file_size, meta.smallest, meta.largest,
+                      meta.properties);
+        if (blob_builder != nullptr) {
+            edit->AddBlobFile(blob_number, blob_builder->NumRecords(),
+                              blob_builder->FileSize());
+        }
     } else {
         remove(fname.c_str());
+        if (blob_builder != nullptr) {
+            remove(BlobFileName(dbname_, blob_number).c_str());
+        }
     }
     return s;
 }
@@ -509,6 +1304,9 @@ Status DBImpl::BackgroundCompaction() {
         base->Ref();
         mutex_.unlock();
         Status s = WriteLevel0Table(imm_, &edit, base);
+        if (s.ok()) {
+            versions_->PinTables(&edit);
+        }
         mutex_.lock();
         base->Unref();
 
@@ -532,12 +1330,15 @@ Status DBImpl::BackgroundCompaction() {
         VersionEdit edit;
         FileMetaData* f = c->input(0, 0);
         edit.DeleteFile(c->level(), f->number);
-        edit.AddFile(c->level() + 1, f->number, f->file_size, f->smallest, f->largest);
+        edit.AddFile(c->output_level(), f->number, f->file_size, f->smallest, f->largest,
+                     f->properties);
         status = versions_->LogAndApply(&edit, &mutex_);
         c->ReleaseInputs();
         delete c;
     } else {
+        running_compaction_ = c;
         status = DoCompactionWork(c);
+        running_compaction_ = nullptr;
         CleanupCompaction(c);
         c->ReleaseInputs();
         delete c;
@@ -546,18 +1347,26 @@ Status DBImpl::BackgroundCompaction() {
 }
 
 Status DBImpl::DoCompactionWork(Compaction* c) {
+    // Blob garbage collection: values still referenced from mostly-garbage
+    // blob files are copied to a new blob file as their keys pass through.
+    std::set<uint64_t> gc_blob_files;
+    for (const auto& kv : c->input_version_->blob_files_) {
+        if (kv.second.LiveRatio() < options_.blob_gc_live_ratio) {
+            gc_blob_files.insert(kv.first);
+        }
+    }
     mutex_.unlock();
 
     std::vector<Iterator*> list;
-    for (int i = 0; i < c->num_input_files(0); i++) {
-        list.push_back(table_cache_->NewIterator(ReadOptions(),
-                                                 c->input(0, i)->number,
-                                                 c->input(0, i)->file_size));
-    }
-    for (int i = 0; i < c->num_input_files(1); i++) {
-        list.push_back(table_cache_->NewIterator(ReadOptions(),
-                                                 c->input(1, i)->number,
-                                                 c->input(1, i)->file_size));
+    ReadOptions read_options;
+    read_options.fill_cache = false;
+    for (int which = 0; which < 2; which++) {
+        for (int i = 0; i < c->num_input_files(which); i++) {
+            list.push_back(table_cache_->NewIterator(read_options,
+                                                     c->input(which, i)->number,
+                                                     c->input(which, i)->file_size,
+                                                     nullptr, true, c->input(which, i)->table));
+        }
     }
 
     Iterator* input = NewMergingIterator(&versions_->icmp_, &list[0], list.size());
@@ -574,10 +1383,14 @@ Status DBImpl::DoCompactionWork(Compaction* c) {
 
     Options table_options = options_;
     table_options.comparator = &internal_comparator_;
-    std::ofstream* outfile = nullptr;
+    table_options.compression = options_.CompressionForLevel(c->output_level());
+    WritableFile* outfile = nullptr;
     std::unique_ptr<TableBuilder> builder;
     InternalKey smallest_key, largest_key;
     uint64_t output_file_number = 0;
+    std::unique_ptr<BlobFileBuilder> blob_builder;
+    uint64_t blob_file_number = 0;
+    std::string relocated_ref;
 
     c->AddInputDeletions(&c->edit_);
 
@@ -587,8 +1400,9 @@ Status DBImpl::DoCompactionWork(Compaction* c) {
         if (c->ShouldStopBefore(key) && builder != nullptr) {
             status = builder->Finish();
             if (status.ok()) {
-                c->edit_.AddFile(c->level() + 1, output_file_number,
-                                builder->FileSize(), smallest_key, largest_key);
+                c->edit_.AddFile(c->output_level(), output_file_number,
+                                builder->FileSize(), smallest_key, largest_key,
+                                builder->GetTableProperties());
             }
             delete outfile;
             outfile = nullptr;
@@ -597,6 +1411,7 @@ Status DBImpl::DoCompactionWork(Compaction* c) {
         }
 
         bool drop = false;
+        bool is_blob_index = false;
         if (!ParseInternalKey(key, &ikey)) {
             current_user_key.clear();
             has_current_user_key = false;
@@ -623,7 +1438,7 @@ Status DBImpl::DoCompactionWork(Compaction* c) {
                 for (int i = 0; i < c->num_input_files(1); i++) {
                     FileMetaData* f = c->input(1, i);
                     if (table_cache_->MayContain(f->number, f->file_size,
-                                                 ikey.user_key)) {
+                                                 ikey.user_key, f->table.get())) {
                         maybe_in_output = true;
                         break;
                     }
@@ -634,30 +1449,58 @@ Status DBImpl::DoCompactionWork(Compaction* c) {
             }
 
             last_sequence_for_key = ikey.sequence;
+            is_blob_index = (ikey.type == kTypeBlobIndex);
+        }
+
+        BlobIndex blob_index;
+        if (is_blob_index && !blob_index.DecodeFrom(input->value()).ok()) {
+            is_blob_index = false;
+        }
+        if (drop && is_blob_index) {
+            c->edit_.AddBlobGarbage(blob_index.file_number, 1, blob_index.size);
         }
 
         if (!drop) {
             if (builder == nullptr) {
                 output_file_number = versions_->NewFileNumber();
                 std::string fname = TableFileName(dbname_, output_file_number);
-                outfile = new std::ofstream(fname, std::ios::out | std::ios::binary);
-                if (!outfile->is_open()) {
-                    status = Status::IOError("Failed to create compaction output: ", fname);
-                    delete outfile;
-                    outfile = nullptr;
+                status = NewWritableFile(fname,
+                                         options_.use_direct_io_for_flush_and_compaction,
+                                         &outfile);
+                if (!status.ok()) {
                     break;
                 }
                 builder.reset(new TableBuilder(table_options, outfile));
                 smallest_key.SetFrom(key);
             }
             largest_key.SetFrom(key);
-            builder->Add(key, input->value());
+
+            Slice value = input->value();
+            if (is_blob_index && gc_blob_files.count(blob_index.file_number) > 0) {
+                std::string blob_value;
+                status = blob_cache_->Get(ReadOptions(), blob_index, &blob_value);
+                if (!status.ok()) break;
+                if (blob_builder == nullptr) {
+                    blob_file_number = versions_->NewFileNumber();
+                    blob_builder.reset(new BlobFileBuilder(
+                        BlobFileName(dbname_, blob_file_number), blob_file_number));
+                }
+                BlobIndex relocated;
+                status = blob_builder->Add(ikey.user_key, blob_value, &relocated);
+                if (!status.ok()) break;
+                relocated_ref.clear();
+                relocated.EncodeTo(&relocated_ref);
+                value = Slice(relocated_ref);
+                c->edit_.AddBlobGarbage(blob_index.file_number, 1, blob_index.size);
+            }
+            builder->Add(key, value);
 
             if (builder->FileSize() >= c->MaxOutputFileSize()) {
                 status = builder->Finish();
                 if (status.ok()) {
-                    c->edit_.AddFile(c->level() + 1, output_file_number,
-                                    builder->FileSize(), smallest_key, largest_key);
+                    c->edit_.AddFile(c->output_level(), output_file_number,
+                                    builder->FileSize(), smallest_key, largest_key,
+                                    builder->GetTableProperties());
                 }
                 delete outfile;
                 outfile = nullptr;
@@ -676,8 +1519,9 @@ Status DBImpl::DoCompactionWork(Compaction* c) {
     if (status.ok() && builder != nullptr) {
         status = builder->Finish();
         if (status.ok()) {
-            c->edit_.AddFile(c->level() + 1, output_file_number,
-                            builder->FileSize(), smallest_key, largest_key);
+            c->edit_.AddFile(c->output_level(), output_file_number,
+                            builder->FileSize(), smallest_key, largest_key,
+                            builder->GetTableProperties());
         }
     } else if (builder != nullptr) {
         builder->Abandon();
@@ -685,7 +1529,21 @@ Status DBImpl::DoCompactionWork(Compaction* c) {
     delete outfile;
     builder.reset();
 
+    if (blob_builder != nullptr) {
+        Status bs = blob_builder->Finish();
+        if (status.ok()) status = bs;
+        if (status.ok()) {
+            c->edit_.AddBlobFile(blob_file_number, blob_builder->NumRecords(),
+                                 blob_builder->FileSize());
+        } else {
+            remove(BlobFileName(dbname_, blob_file_number).c_str());
+        }
+    }
+
     delete input;
+    if (status.ok()) {
+        versions_->PinTables(&c->edit_);
+    }
     mutex_.lock();
 
     if (status.ok()) {
@@ -694,6 +1552,20 @@ Status DBImpl::DoCompactionWork(Compaction* c) {
     return status;
 }
 
+void DBImpl::DeleteObsoleteBlobFiles() {
+    auto& obsolete = versions_->obsolete_blob_files_;
+    for (auto it = obsolete.begin(); it != obsolete.end();) {
+        if (it->use_count() == 1) {
+            const uint64_t number = (*it)->number;
+            blob_cache_->Evict(number);
+            remove(BlobFileName(dbname_, number).c_str());
+            it = obsolete.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
 void DBImpl::CleanupCompaction(Compaction* c) {
     for (int which = 0; which < 2; which++) {
         for (int i = 0; i < c->num_input_files(which); i++) {
@@ -9,6 +9,8 @@
 
 #include "lsm/db.h"
 #include "lsm/options.h"
+#include "lsm/write_buffer_manager.h"
+#include "src/db/blob_file.h"
 #include "src/db/memtable.h"
 #include "src/db/version_set.h"
 #include "src/db/wal.h"
@@ -16,7 +18,7 @@
 
 namespace lsm {
 
-class DBImpl : public DB {
+class DBImpl : public DB, private WriteBufferManager::Client {
 public:
     DBImpl(const Options& options, const std::string& dbname);
     ~DBImpl() override;
@@ -24,7 +26,15 @@ public:
     Status Put(const WriteOptions& options, const Slice& key, const Slice& value) override;
     Status Delete(const WriteOptions& options, const Slice& key) override;
     Status Get(const ReadOptions& options, const Slice& key, std::string* value) override;
+    std::vector<Status> MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                                 std::vector<std::string>* values) override;
     Iterator* NewIterator(const ReadOptions& options) override;
+    Status GetPropertiesOfAllTables(TablePropertiesCollection* props) override;
+    Status IngestExternalFiles(const IngestExternalFileOptions& options,
+                               const std::vector<std::string>& files) override;
+    Status DumpBlockCache(const std::string& fname) override;
+    Status LoadBlockCache(const std::string& fname) override;
+    bool GetProperty(const Slice& property, std::string* value) override;
 
     Status Recover();
 
@@ -36,6 +46,13 @@ private:
     Writer* BuildBatchGroup(Writer** last_writer);
 
     Status MakeRoomForWrite(bool force = false);
+    // Makes mem_ the immutable memtable and schedules its flush.
+    // REQUIRES: mutex_ held, imm_ == nullptr.
+    void SwitchMemTable();
+
+    // WriteBufferManager::Client.
+    size_t MutableMemtableSize() override;
+    void FlushMemtable() override;
     Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base);
     Status BackgroundCompaction();
     void BackgroundCall();
@@ -45,14 +62,32 @@ private:
     Status DoCompactionWork(Compaction* c);
     void CleanupCompaction(Compaction* c);
 
+    // Deletes blob files that no live Version references any more.
+    // REQUIRES: mutex_ held.
+    void DeleteObsoleteBlobFiles();
+
+    // Charges a seek to the files an iterator found internal_key to overlap;
+    // see Version::RecordReadSample().
+    void RecordReadSample(const Slice& internal_key);
+
+    // Opens every table of v, and reads Options::table_warmup_data_blocks
+    // of each into the block cache, with Options::table_warmup_threads
+    // threads. Unrefs v when done. Call with no mutex held.
+    void WarmTables(Version* v);
+
+    // Loads the blocks listed in the dump fname that belong to tables of
+    // v. Unrefs v when done. Call with no mutex held.
+    Status LoadBlockCacheForVersion(const std::string& fname, Version* v);
+
     const Options options_;
     const std::string dbname_;
     InternalKeyComparator internal_comparator_;
 
     Options internal_options_;
 
-    // table_cache_ provides its own synchronization
+    // table_cache_ and blob_cache_ provide their own synchronization
     TableCache* table_cache_;
+    BlobFileCache* blob_cache_;
 
     std::mutex mutex_;
     std::condition_variable bg_cv_;
@@ -60,6 +95,13 @@ private:
     bool bg_compaction_scheduled_;
 
     std::thread bg_thread_;
+    // Runs WarmTables() with Options::table_warmup_in_background.
+    std::thread warmup_thread_;
+    std::atomic<uint64_t> warmup_done_;
+    std::atomic<uint64_t> warmup_total_;
+    // Loads Options::block_cache_dump_path into the tables of the version
+    // installed by DB::Open.
+    std::thread cache_load_thread_;
     std::condition_variable bg_work_cv_;
 
     MemTable* mem_;
@@ -74,6 +116,10 @@ private:
     std::deque<Writer*> writers_;
     Status bg_error_;
 
+    // Compaction whose outputs are not yet installed, if any. Ingestion must
+    // not place a file where those outputs will land.
+    Compaction* running_compaction_;
+
     // Information for a compaction in progress.
     struct CompactionState {
         Compaction* const compaction;
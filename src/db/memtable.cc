@@ -51,7 +51,11 @@ std::string InternalKey::DebugString() const {
         result.append("' @ ");
         result.append(std::to_string(seq_type >> 8));
         result.append(" : ");
-        result.append((seq_type & 0xff) == kTypeValue ? "Val" : "Del");
+        switch (seq_type & 0xff) {
+            case kTypeValue: result.append("Val"); break;
+            case kTypeBlobIndex: result.append("Blob"); break;
+            default: result.append("Del"); break;
+        }
     }
     return result;
 }
@@ -103,15 +107,23 @@ private:
     }
 };
 
-MemTable::MemTable(const InternalKeyComparator& comparator)
+MemTable::MemTable(const InternalKeyComparator& comparator,
+                   WriteBufferManager* write_buffer_manager)
     : comparator_(comparator),
       refs_(0),
       table_(comparator_),
-      memory_usage_(0) {
+      memory_usage_(0),
+      write_buffer_manager_(write_buffer_manager),
+      reserved_(0),
+      immutable_(false) {
 }
 
 MemTable::~MemTable() {
     assert(refs_ == 0);
+    if (write_buffer_manager_ != nullptr) {
+        MarkImmutable();
+        write_buffer_manager_->FreeMem(reserved_);
+    }
     // Since SkipList nodes are individually heap-allocated in our implementation,
     // we must iterate over the SkipList and free the memory for our custom key/val blocks
     
@@ -131,6 +143,13 @@ size_t MemTable::ApproximateMemoryUsage() const {
     return memory_usage_.load(std::memory_order_relaxed);
 }
 
+void MemTable::MarkImmutable() {
+    if (write_buffer_manager_ != nullptr && !immutable_) {
+        write_buffer_manager_->ScheduleFreeMem(reserved_);
+    }
+    immutable_ = true;
+}
+
 Iterator* MemTable::NewIterator() {
     return new MemTableIterator(&table_);
 }
@@ -166,7 +185,14 @@ void MemTable::Add(uint64_t seq, ValueType type,
     table_.Insert(buf);
     
     size_t overhead = sizeof(void*) * 8;
-    memory_usage_.fetch_add(encoded_len + overhead, std::memory_order_relaxed);
+    const size_t usage =
+        memory_usage_.fetch_add(encoded_len + overhead, std::memory_order_relaxed) +
+        encoded_len + overhead;
+    if (write_buffer_manager_ != nullptr && usage > reserved_) {
+        const size_t grow = (usage - reserved_ + kReserveChunk - 1) / kReserveChunk * kReserveChunk;
+        reserved_ += grow;
+        write_buffer_manager_->ReserveMem(grow);
+    }
 }
 
 bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
@@ -211,7 +237,7 @@ LookupKey::LookupKey(const Slice& user_key, uint64_t sequence) {
     kstart_ = dst;
     std::memcpy(dst, user_key.data(), usize);
     dst += usize;
-    EncodeFixed64(dst, PackSequenceAndType(sequence, kTypeValue));
+    EncodeFixed64(dst, PackSequenceAndType(sequence, kValueTypeForSeek));
     dst += 8;
     end_ = dst;
 }
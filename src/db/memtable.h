@@ -4,6 +4,7 @@
 #include "lsm/slice.h"
 #include "lsm/iterator.h"
 #include "lsm/comparator.h"
+#include "lsm/write_buffer_manager.h"
 #include "skiplist.h"
 #include "src/util/coding.h"
 
@@ -11,16 +12,23 @@ namespace lsm {
 
 enum ValueType {
     kTypeDeletion = 0x0,
-    kTypeValue = 0x1
+    kTypeValue = 0x1,
+    // Value is an encoded BlobIndex pointing into a blob file. Only
+    // written to tables, never to the memtable or WAL.
+    kTypeBlobIndex = 0x2
 };
 
+// Seeks use the highest type so that entries of every type at the lookup
+// sequence sort at or after the seek key.
+static const ValueType kValueTypeForSeek = kTypeBlobIndex;
+
 // Internal key format: | User key (varlen) | Sequence Number (7 bytes) | ValueType (1 byte) |
 // Sequence and Type are packed into a single 64-bit word.
 inline constexpr uint64_t kMaxSequenceNumber = ((1ull << 56) - 1);
 
 inline uint64_t PackSequenceAndType(uint64_t seq, ValueType t) {
     assert(seq <= kMaxSequenceNumber);
-    assert(t <= kTypeValue);
+    assert(t <= kTypeBlobIndex);
     return (seq << 8) | t;
 }
 
@@ -124,7 +132,10 @@ class MemTableIterator;
 
 class MemTable {
 public:
-    explicit MemTable(const InternalKeyComparator& comparator);
+    // With a write_buffer_manager, which must outlive the memtable, its
+    // memory is reserved there as it grows and freed with it.
+    explicit MemTable(const InternalKeyComparator& comparator,
+                      WriteBufferManager* write_buffer_manager = nullptr);
 
     MemTable(const MemTable&) = delete;
     MemTable& operator=(const MemTable&) = delete;
@@ -141,6 +152,9 @@ public:
 
     size_t ApproximateMemoryUsage() const;
 
+    // Called when the memtable stops taking writes and waits to be flushed.
+    void MarkImmutable();
+
     // Returns an iterator over memtable contents (internal keys).
     // Caller must keep MemTable alive for the iterator's lifetime.
     Iterator* NewIterator();
@@ -174,6 +188,13 @@ private:
     Table table_;
     
     std::atomic<size_t> memory_usage_;
+
+    WriteBufferManager* const write_buffer_manager_;
+    // Bytes reserved in write_buffer_manager_, ahead of memory_usage_ by up
+    // to kReserveChunk so that not every Add() touches the shared counters.
+    size_t reserved_;
+    bool immutable_;
+    static const size_t kReserveChunk = 64 * 1024;
 };
 
 }
@@ -11,7 +11,9 @@ enum Tag {
     kCompactPointer       = 5,
     kDeletedFile          = 6,
     kNewFile              = 7,
-    kPrevLogNumber        = 9
+    kPrevLogNumber        = 9,
+    kNewBlobFile          = 10,
+    kBlobFileGarbage      = 11
 };
 
 void VersionEdit::Clear() {
@@ -27,17 +29,21 @@ void VersionEdit::Clear() {
     has_last_sequence_ = false;
     deleted_files_.clear();
     new_files_.clear();
+    new_blob_files_.clear();
+    blob_garbage_.clear();
 }
 
 void VersionEdit::AddFile(int level, uint64_t file,
                           uint64_t file_size,
                           const InternalKey& smallest,
-                          const InternalKey& largest) {
+                          const InternalKey& largest,
+                          const TableProperties& properties) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.properties = properties;
     new_files_.push_back(std::make_pair(level, f));
 }
 
@@ -82,6 +88,20 @@ void VersionEdit::EncodeTo(std::string* dst) const {
         PutLengthPrefixedSlice(dst, f.smallest.Encode());
         PutLengthPrefixedSlice(dst, f.largest.Encode());
     }
+
+    for (const auto& b : new_blob_files_) {
+        PutVarint32(dst, kNewBlobFile);
+        PutVarint64(dst, b.number);
+        PutVarint64(dst, b.total_count);
+        PutVarint64(dst, b.total_bytes);
+    }
+
+    for (const auto& g : blob_garbage_) {
+        PutVarint32(dst, kBlobFileGarbage);
+        PutVarint64(dst, g.first);
+        PutVarint64(dst, g.second.first);
+        PutVarint64(dst, g.second.second);
+    }
 }
 
 static bool GetInternalKey(Slice* input, InternalKey* dst) {
@@ -175,6 +195,30 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
                 }
                 break;
 
+            case kNewBlobFile: {
+                SharedBlobFileMetaData b;
+                if (GetVarint64(&input, &b.number) &&
+                    GetVarint64(&input, &b.total_count) &&
+                    GetVarint64(&input, &b.total_bytes)) {
+                    new_blob_files_.push_back(b);
+                } else {
+                    return Status::Corruption("VersionEdit: new blob file");
+                }
+                break;
+            }
+
+            case kBlobFileGarbage: {
+                uint64_t count, bytes;
+                if (GetVarint64(&input, &number) &&
+                    GetVarint64(&input, &count) &&
+                    GetVarint64(&input, &bytes)) {
+                    AddBlobGarbage(number, count, bytes);
+                } else {
+                    return Status::Corruption("VersionEdit: blob file garbage");
+                }
+                break;
+            }
+
             default:
                 return Status::Corruption("VersionEdit: unknown tag");
         }
@@ -1,14 +1,19 @@
 #pragma once
 
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include <set>
 #include "lsm/slice.h"
 #include "lsm/status.h"
+#include "lsm/table_properties.h"
 #include "src/db/memtable.h"
 
 namespace lsm {
 
+class Table;
+
 struct FileMetaData {
     int refs;
     int allowed_seeks;
@@ -16,10 +21,38 @@ struct FileMetaData {
     uint64_t file_size;
     InternalKey smallest;
     InternalKey largest;
+    // Copied from the builder when the table is written; not part of the
+    // MANIFEST record, so files decoded from one read them from the table.
+    TableProperties properties;
+    // The open table, kept here instead of in the table cache when
+    // Options::max_open_files is negative; may be unset if it failed to open.
+    std::shared_ptr<Table> table;
 
     FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
 };
 
+// Immutable facts about a blob file, shared by every Version that still
+// references it. Once a Version drops the file it is marked obsolete, and
+// the file is deleted after the last Version holding it goes away.
+struct SharedBlobFileMetaData {
+    uint64_t number = 0;
+    uint64_t total_count = 0;
+    uint64_t total_bytes = 0;
+};
+
+// Per-Version view of a blob file: records that are no longer referenced by
+// any table count as garbage.
+struct BlobFileMetaData {
+    std::shared_ptr<SharedBlobFileMetaData> shared;
+    uint64_t garbage_count = 0;
+    uint64_t garbage_bytes = 0;
+
+    double LiveRatio() const {
+        if (shared->total_bytes == 0) return 0;
+        return 1.0 - static_cast<double>(garbage_bytes) / shared->total_bytes;
+    }
+};
+
 class VersionEdit {
 public:
     VersionEdit() { Clear(); }
@@ -54,10 +87,32 @@ public:
     void AddFile(int level, uint64_t file,
                  uint64_t file_size,
                  const InternalKey& smallest,
-                 const InternalKey& largest);
+                 const InternalKey& largest,
+                 const TableProperties& properties = TableProperties());
+
+    // Moves the i-th file added to this edit to `level`.
+    void SetNewFileLevel(size_t i, int level) {
+        new_files_[i].first = level;
+    }
 
     void DeleteFile(int level, uint64_t file);
 
+    void AddBlobFile(uint64_t number, uint64_t total_count, uint64_t total_bytes) {
+        SharedBlobFileMetaData f;
+        f.number = number;
+        f.total_count = total_count;
+        f.total_bytes = total_bytes;
+        new_blob_files_.push_back(f);
+    }
+
+    // Records that count records of `bytes` total in blob file `number`
+    // are no longer referenced.
+    void AddBlobGarbage(uint64_t number, uint64_t count, uint64_t bytes) {
+        auto& g = blob_garbage_[number];
+        g.first += count;
+        g.second += bytes;
+    }
+
     void EncodeTo(std::string* dst) const;
     Status DecodeFrom(const Slice& src);
 
@@ -82,6 +137,9 @@ private:
 
     std::vector< std::pair<int, FileMetaData> > new_files_;
     DeletedFileSet deleted_files_;
+
+    std::vector<SharedBlobFileMetaData> new_blob_files_;
+    std::map<uint64_t, std::pair<uint64_t, uint64_t> > blob_garbage_;  // count, bytes
 };
 
 }
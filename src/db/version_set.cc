@@ -1,10 +1,14 @@
 #include "src/db/version_set.h"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <limits>
+#include <thread>
 #include "src/util/coding.h"
 #include "src/db/merger.h"
 #include "src/table/sstable_reader.h"
 #include "src/table/table_cache.h"
+#include "src/db/blob_file.h"
 
 namespace lsm {
 
@@ -12,17 +16,23 @@ static const int kTargetFileSize = 2 * 1048576;
 static const int64_t kMaxGrandParentOverlapBytes = 10 * kTargetFileSize;
 static const int64_t kExpandedCompactionByteSizeLimit = 25 * kTargetFileSize;
 
+static const double kLevelBaseBytes = 10. * 1048576.0;
+static const double kLevelSizeMultiplier = 10;
+
 static double MaxBytesForLevel(int level) {
     // Note: the result for level zero is not really used since we set
     // the level-0 compaction threshold based on number of files.
-    double result = 10. * 1048576.0;
+    double result = kLevelBaseBytes;
     while (level > 1) {
-        result *= 10;
+        result *= kLevelSizeMultiplier;
         level--;
     }
     return result;
 }
 
+// Threads PinTables() opens tables with.
+static const size_t kMaxPinThreads = 16;
+
 static uint64_t MaxFileSizeForLevel(int level) {
     return kTargetFileSize;
 }
@@ -45,6 +55,23 @@ int64_t VersionSet::NumLevelBytes(int level) const {
     return TotalFileSize(current_->files_[level]);
 }
 
+Status Version::GetPropertiesOfAllTables(TablePropertiesCollection* props) {
+    for (int level = 0; level < lsm::Options::kNumLevels; level++) {
+        for (const FileMetaData* f : files_[level]) {
+            if (f->properties.creation_time != 0) {
+                (*props)[f->number] = f->properties;
+                continue;
+            }
+            Status s = vset_->table_cache_->GetTableProperties(f->number, f->file_size,
+                                                               &(*props)[f->number]);
+            if (!s.ok()) {
+                return s;
+            }
+        }
+    }
+    return Status::OK();
+}
+
 namespace {
     std::string DescriptorFileName(const std::string& dbname, uint64_t number) {
         char buf[100];
@@ -101,9 +128,10 @@ public:
     Slice value() const override {
         assert(Valid());
         auto f = (*flist_)[index_];
-        char buf[16];
+        char buf[24];
         EncodeFixed64(buf, f->number);
         EncodeFixed64(buf + 8, f->file_size);
+        EncodeFixed64(buf + 16, reinterpret_cast<uintptr_t>(f));
         value_buf_.assign(buf, sizeof(buf));
         return Slice(value_buf_);
     }
@@ -118,12 +146,14 @@ private:
 
 static Iterator* GetFileIterator(void* arg, const ReadOptions& options, const Slice& file_value) {
     TableCache* cache = reinterpret_cast<TableCache*>(arg);
-    if (file_value.size() != 16) {
+    if (file_value.size() != 24) {
         return NewErrorIterator(Status::Corruption("FileReader invoked with unexpected value"));
     } else {
         uint64_t file_num = DecodeFixed64(file_value.data());
         uint64_t file_size = DecodeFixed64(file_value.data() + 8);
-        return cache->NewIterator(options, file_num, file_size);
+        const FileMetaData* f =
+            reinterpret_cast<const FileMetaData*>(DecodeFixed64(file_value.data() + 16));
+        return cache->NewIterator(options, file_num, file_size, nullptr, false, f->table);
     }
 }
 
@@ -135,8 +165,9 @@ Iterator* Version::NewConcatenatingIterator(const ReadOptions& options, int leve
 
 void Version::AddIterators(const ReadOptions& options, std::vector<Iterator*>* iters) {
     for (size_t i = 0; i < files_[0].size(); i++) {
-        iters->push_back(
-            vset_->table_cache_->NewIterator(options, files_[0][i]->number, files_[0][i]->file_size));
+        const FileMetaData* f = files_[0][i];
+        iters->push_back(vset_->table_cache_->NewIterator(options, f->number, f->file_size,
+                                                          nullptr, false, f->table));
     }
 
     // For levels > 0, we can use a concatenating iterator that sequentially
@@ -161,6 +192,7 @@ struct Saver {
     const Comparator* ucmp;
     Slice user_key;
     std::string* value;
+    bool is_blob_index;
 };
 }
 
@@ -171,9 +203,10 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
         s->state = kCorrupt;
     } else {
         if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-            s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+            s->state = (parsed_key.type == kTypeDeletion) ? kDeleted : kFound;
             if (s->state == kFound) {
                 s->value->assign(v.data(), v.size());
+                s->is_blob_index = (parsed_key.type == kTypeBlobIndex);
             }
         }
     }
@@ -243,10 +276,22 @@ bool SomeFileOverlapsRange(const InternalKeyComparator& icmp,
     return !BeforeFile(ucmp, largest_user_key, files[index]);
 }
 
+bool Version::OverlapInLevel(int level, const Slice* smallest_user_key,
+                             const Slice* largest_user_key) {
+    return SomeFileOverlapsRange(vset_->icmp_, (level > 0), files_[level],
+                                 smallest_user_key, largest_user_key);
+}
+
 void Version::Get(const ReadOptions& options,
                   const Slice& k,
                   std::string* value,
-                  Status* status) {
+                  Status* status,
+                  GetStats* stats) {
+    stats->seek_file = nullptr;
+    stats->seek_file_level = -1;
+    FileMetaData* last_file_read = nullptr;
+    int last_file_read_level = -1;
+
     Slice ikey = k;
     Slice user_key = InternalKey::ExtractUserKey(ikey);
     const Comparator* ucmp = vset_->icmp_.user_comparator();
@@ -257,6 +302,7 @@ void Version::Get(const ReadOptions& options,
     saver.ucmp = ucmp;
     saver.user_key = user_key;
     saver.value = value;
+    saver.is_blob_index = false;
 
     // We can search level-by-level since entries never hop across
     // levels.  Therefore we are guaranteed that if we find data
@@ -304,8 +350,16 @@ void Version::Get(const ReadOptions& options,
         for (uint32_t i = 0; i < num_files; ++i) {
             if (saver.state == kNotFound) {
                 FileMetaData* f = files[i];
+                if (stats->seek_file == nullptr && last_file_read != nullptr) {
+                    // More than one file read: charge the first.
+                    stats->seek_file = last_file_read;
+                    stats->seek_file_level = last_file_read_level;
+                }
+                last_file_read = f;
+                last_file_read_level = level;
+
                 s = vset_->table_cache_->Get(options, f->number, f->file_size,
-                                             ikey, &saver, SaveValue);
+                                             ikey, &saver, SaveValue, f->table.get());
                 if (!s.ok()) {
                     *status = s;
                     return;
@@ -314,6 +368,9 @@ void Version::Get(const ReadOptions& options,
                     case kNotFound:
                         break;
                     case kFound:
+                        if (saver.is_blob_index) {
+                            s = ResolveBlobIndex(options, value);
+                        }
                         *status = s;
                         return;
                     case kDeleted:
@@ -332,6 +389,183 @@ void Version::Get(const ReadOptions& options,
     *status = Status::NotFound(Slice());
 }
 
+bool Version::UpdateStats(const GetStats& stats) {
+    FileMetaData* f = stats.seek_file;
+    if (f != nullptr) {
+        f->allowed_seeks--;
+        if (f->allowed_seeks <= 0 && file_to_compact_ == nullptr) {
+            file_to_compact_ = f;
+            file_to_compact_level_ = stats.seek_file_level;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Version::RecordReadSample(const Slice& internal_key) {
+    const Comparator* ucmp = vset_->icmp_.user_comparator();
+    const Slice user_key = InternalKey::ExtractUserKey(internal_key);
+    GetStats stats = {nullptr, -1};
+    int matches = 0;
+    for (int level = 0; level < lsm::Options::kNumLevels && matches < 2; level++) {
+        if (level == 0) {
+            std::vector<FileMetaData*> tmp;
+            for (FileMetaData* f : files_[0]) {
+                if (ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+                    ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+                    tmp.push_back(f);
+                }
+            }
+            std::sort(tmp.begin(), tmp.end(), NewestFirst);
+            for (size_t i = 0; i < tmp.size() && matches < 2; i++) {
+                if (++matches == 1) {
+                    stats.seek_file = tmp[i];
+                    stats.seek_file_level = 0;
+                }
+            }
+            continue;
+        }
+        const uint32_t index = FindFile(vset_->icmp_, files_[level], internal_key);
+        if (index < files_[level].size() &&
+            ucmp->Compare(user_key, files_[level][index]->smallest.user_key()) >= 0) {
+            if (++matches == 1) {
+                stats.seek_file = files_[level][index];
+                stats.seek_file_level = level;
+            }
+        }
+    }
+    // One file holding the key costs a lookup nothing extra.
+    return matches >= 2 && UpdateStats(stats);
+}
+
+void Version::MultiGet(const ReadOptions& options,
+                       const std::vector<Slice>& keys,
+                       const std::vector<std::string*>& values,
+                       const std::vector<Status*>& statuses) {
+    const Comparator* ucmp = vset_->icmp_.user_comparator();
+    std::vector<Saver> savers(keys.size());
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < keys.size(); i++) {
+        Saver& saver = savers[i];
+        saver.state = kNotFound;
+        saver.ucmp = ucmp;
+        saver.user_key = InternalKey::ExtractUserKey(keys[i]);
+        saver.value = values[i];
+        saver.is_blob_index = false;
+        pending.push_back(i);
+    }
+    std::sort(pending.begin(), pending.end(), [&](size_t a, size_t b) {
+        return vset_->icmp_.Compare(keys[a], keys[b]) < 0;
+    });
+
+    // Looks up batch (ascending) in f. Keys resolved there, found, deleted
+    // or failed, get their final status; the rest stay kNotFound.
+    std::vector<Slice> batch_keys;
+    std::vector<void*> batch_args;
+    std::vector<Status> batch_statuses;
+    auto lookup = [&](FileMetaData* f, const std::vector<size_t>& batch) {
+        batch_keys.clear();
+        batch_args.clear();
+        for (size_t i : batch) {
+            batch_keys.push_back(keys[i]);
+            batch_args.push_back(&savers[i]);
+        }
+        batch_statuses.assign(batch.size(), Status());
+        vset_->table_cache_->MultiGet(options, f->number, f->file_size, batch_keys,
+                                      batch_args.data(), SaveValue, batch_statuses.data(),
+                                      f->table.get());
+        for (size_t j = 0; j < batch.size(); j++) {
+            const size_t i = batch[j];
+            Saver& saver = savers[i];
+            if (!batch_statuses[j].ok()) {
+                *statuses[i] = batch_statuses[j];
+                saver.state = kCorrupt;  // Settled; skip older files.
+                continue;
+            }
+            switch (saver.state) {
+                case kNotFound:
+                    break;
+                case kFound:
+                    *statuses[i] = saver.is_blob_index ? ResolveBlobIndex(options, values[i])
+                                                       : Status::OK();
+                    break;
+                case kDeleted:
+                    *statuses[i] = Status::NotFound(Slice());
+                    break;
+                case kCorrupt:
+                    *statuses[i] = Status::Corruption("corrupted key for ", saver.user_key);
+                    break;
+            }
+        }
+    };
+    auto still_pending = [&](size_t i) { return savers[i].state == kNotFound; };
+
+    std::vector<size_t> batch;
+    for (int level = 0; level < lsm::Options::kNumLevels && !pending.empty(); level++) {
+        const std::vector<FileMetaData*>& files = files_[level];
+        if (files.empty()) continue;
+
+        if (level == 0) {
+            // Newest first, so a key settled by one file skips the older ones.
+            std::vector<FileMetaData*> tmp(files);
+            std::sort(tmp.begin(), tmp.end(), NewestFirst);
+            for (FileMetaData* f : tmp) {
+                batch.clear();
+                for (size_t i : pending) {
+                    if (still_pending(i) &&
+                        ucmp->Compare(savers[i].user_key, f->smallest.user_key()) >= 0 &&
+                        ucmp->Compare(savers[i].user_key, f->largest.user_key()) <= 0) {
+                        batch.push_back(i);
+                    }
+                }
+                if (!batch.empty()) {
+                    lookup(f, batch);
+                }
+            }
+        } else {
+            // Sorted keys map to files in order; each run of keys in the same
+            // file is one batch.
+            size_t current_file = files.size();
+            batch.clear();
+            for (size_t i : pending) {
+                uint32_t index = FindFile(vset_->icmp_, files, keys[i]);
+                if (index >= files.size() ||
+                    ucmp->Compare(savers[i].user_key, files[index]->smallest.user_key()) < 0) {
+                    continue;
+                }
+                if (index != current_file && !batch.empty()) {
+                    lookup(files[current_file], batch);
+                    batch.clear();
+                }
+                current_file = index;
+                batch.push_back(i);
+            }
+            if (!batch.empty()) {
+                lookup(files[current_file], batch);
+            }
+        }
+        pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                     [&](size_t i) { return !still_pending(i); }),
+                      pending.end());
+    }
+
+    for (size_t i : pending) {
+        *statuses[i] = Status::NotFound(Slice());
+    }
+}
+
+Status Version::ResolveBlobIndex(const ReadOptions& options, std::string* value) {
+    BlobIndex index;
+    Status s = index.DecodeFrom(Slice(*value));
+    if (!s.ok()) {
+        return s;
+    }
+    if (vset_->blob_cache_ == nullptr) {
+        return Status::Corruption("blob reference without a blob file cache");
+    }
+    return vset_->blob_cache_->Get(options, index, value);
+}
+
 Version::Version(VersionSet* vset)
     : vset_(vset),
       next_(this),
@@ -339,8 +573,12 @@ Version::Version(VersionSet* vset)
       refs_(0),
       file_to_compact_(nullptr),
       file_to_compact_level_(-1),
+      deletion_file_to_compact_(nullptr),
+      deletion_file_to_compact_level_(-1),
       compaction_score_(-1),
-      compaction_level_(-1) {
+      compaction_level_(-1),
+      compaction_file_(nullptr),
+      base_level_(1) {
 }
 
 Version::~Version() {
@@ -397,10 +635,11 @@ private:
     VersionSet* vset_;
     Version* base_;
     LevelState levels_[lsm::Options::kNumLevels];
+    std::map<uint64_t, BlobFileMetaData> blob_files_;
 
 public:
     VersionSetBuilder(VersionSet* vset, Version* base)
-        : vset_(vset), base_(base) {
+        : vset_(vset), base_(base), blob_files_(base->blob_files_) {
         base_->Ref();
         BySmallestKey cmp;
         cmp.internal_comparator = &vset_->icmp_;
@@ -446,6 +685,19 @@ public:
             levels_[level].deleted_files.erase(f->number);
             levels_[level].added_files->insert(f);
         }
+
+        for (const auto& b : edit->new_blob_files_) {
+            BlobFileMetaData meta;
+            meta.shared = std::make_shared<SharedBlobFileMetaData>(b);
+            blob_files_[b.number] = meta;
+        }
+        for (const auto& g : edit->blob_garbage_) {
+            auto it = blob_files_.find(g.first);
+            if (it != blob_files_.end()) {
+                it->second.garbage_count += g.second.first;
+                it->second.garbage_bytes += g.second.second;
+            }
+        }
     }
 
     void SaveTo(Version* v) {
@@ -486,6 +738,15 @@ public:
         }
     }
     
+    void SaveBlobFilesTo(Version* v) {
+        // A blob file none of whose records are referenced leaves the version.
+        for (const auto& kv : blob_files_) {
+            if (kv.second.garbage_bytes < kv.second.shared->total_bytes) {
+                v->blob_files_.insert(kv);
+            }
+        }
+    }
+
     void MaybeAddFile(Version* v, int level, FileMetaData* f) {
         if (levels_[level].deleted_files.count(f->number) > 0) {
         } else {
@@ -502,10 +763,12 @@ public:
 
 VersionSet::VersionSet(const std::string& dbname,
                        const Options* options,
-                       TableCache* table_cache)
+                       TableCache* table_cache,
+                       BlobFileCache* blob_cache)
     : dbname_(dbname),
       options_(options),
       table_cache_(table_cache),
+      blob_cache_(blob_cache),
       icmp_(options->comparator),
       next_file_number_(2),
       manifest_file_number_(0),
@@ -537,10 +800,106 @@ void VersionSet::AppendVersion(Version* v) {
     v->next_->prev_ = v;
 }
 
+// Level targets for Options::level_compaction_dynamic_level_bytes. The
+// last level is taken to be as large as the largest level, and each level
+// above it gets a tenth of the next; the base level is the deepest one
+// whose target is at most kLevelBaseBytes, or the first non-empty level if
+// that is deeper. Levels between 0 and the base level get no target. Sets
+// max_bytes[1..kNumLevels-1] and returns the base level.
+static int DynamicLevelTargets(const std::vector<FileMetaData*>* files, double* max_bytes) {
+    const int last = lsm::Options::kNumLevels - 1;
+    int first_non_empty = last;
+    double largest = 0;
+    for (int level = last; level >= 1; level--) {
+        if (!files[level].empty()) {
+            first_non_empty = level;
+            largest = std::max(largest, static_cast<double>(TotalFileSize(files[level])));
+        }
+    }
+
+    int base_level = first_non_empty;
+    double base_bytes = largest;
+    for (int level = last; level > base_level; level--) {
+        base_bytes /= kLevelSizeMultiplier;
+    }
+    while (base_level > 1 && base_bytes > kLevelBaseBytes) {
+        base_level--;
+        base_bytes /= kLevelSizeMultiplier;
+    }
+    // A tiny base level would be compacted down after every level-0
+    // compaction.
+    base_bytes = std::max(base_bytes, kLevelBaseBytes / kLevelSizeMultiplier);
+
+    for (int level = 1; level <= last; level++) {
+        if (level < base_level) {
+            max_bytes[level] = std::numeric_limits<double>::max();
+        } else if (level == base_level) {
+            max_bytes[level] = base_bytes;
+        } else {
+            max_bytes[level] = max_bytes[level - 1] * kLevelSizeMultiplier;
+        }
+    }
+    return base_level;
+}
+
+// Under Options::kMinOverlappingRatio, the table of files whose overlap with
+// next_files, in bytes, is the smallest fraction of its own size. Both
+// levels are sorted and disjoint, so one pass over each finds every
+// overlap.
+static FileMetaData* MinOverlappingRatioFile(const Comparator* ucmp,
+                                             const std::vector<FileMetaData*>& files,
+                                             const std::vector<FileMetaData*>& next_files) {
+    FileMetaData* best = nullptr;
+    double best_ratio = 0;
+    size_t next = 0;
+    for (FileMetaData* f : files) {
+        while (next < next_files.size() &&
+               ucmp->Compare(next_files[next]->largest.user_key(), f->smallest.user_key()) < 0) {
+            next++;
+        }
+        // The last table overlapped may also overlap f's successor, so
+        // next stays on it.
+        uint64_t overlap = 0;
+        for (size_t i = next; i < next_files.size() &&
+             ucmp->Compare(next_files[i]->smallest.user_key(), f->largest.user_key()) <= 0; i++) {
+            overlap += next_files[i]->file_size;
+        }
+        const double ratio =
+            static_cast<double>(overlap) / std::max<uint64_t>(f->file_size, 1);
+        if (best == nullptr || ratio < best_ratio) {
+            best = f;
+            best_ratio = ratio;
+        }
+    }
+    return best;
+}
+
+// Under Options::kOldestSmallestSeqFirst, the table of files whose oldest
+// entry is the oldest.
+static FileMetaData* OldestSmallestSeqFile(const std::vector<FileMetaData*>& files) {
+    FileMetaData* best = nullptr;
+    for (FileMetaData* f : files) {
+        if (best == nullptr || f->properties.smallest_seqno < best->properties.smallest_seqno) {
+            best = f;
+        }
+    }
+    return best;
+}
+
 void VersionSet::Finalize(Version* v) {
     int best_level = -1;
     double best_score = -1;
 
+    double max_bytes[lsm::Options::kNumLevels] = {};
+    if (options_->level_compaction_dynamic_level_bytes) {
+        v->base_level_ = DynamicLevelTargets(v->files_, max_bytes);
+    } else {
+        v->base_level_ = 1;
+        for (int level = 1; level < lsm::Options::kNumLevels; level++) {
+            max_bytes[level] = MaxBytesForLevel(level);
+        }
+    }
+
     for (int level = 0; level < lsm::Options::kNumLevels-1; level++) {
         double score;
         if (level == 0) {
@@ -559,7 +918,7 @@ void VersionSet::Finalize(Version* v) {
                     static_cast<double>(Options::kL0_CompactionTrigger);
         } else {
             const uint64_t level_bytes = TotalFileSize(v->files_[level]);
-            score = static_cast<double>(level_bytes) / MaxBytesForLevel(level);
+            score = static_cast<double>(level_bytes) / max_bytes[level];
         }
 
         if (score > best_score) {
@@ -570,6 +929,38 @@ void VersionSet::Finalize(Version* v) {
 
     v->compaction_level_ = best_level;
     v->compaction_score_ = best_score;
+
+    v->compaction_file_ = nullptr;
+    if (best_level > 0 && best_score >= 1) {
+        switch (options_->compaction_pri) {
+            case Options::kMinOverlappingRatio:
+                v->compaction_file_ = MinOverlappingRatioFile(
+                    icmp_.user_comparator(), v->files_[best_level], v->files_[best_level + 1]);
+                break;
+            case Options::kOldestSmallestSeqFirst:
+                v->compaction_file_ = OldestSmallestSeqFile(v->files_[best_level]);
+                break;
+            case Options::kRoundRobin:
+                break;
+        }
+    }
+
+    // Tombstone density. Level-0 is already bounded by file count, and the
+    // last level has nowhere to push deletions to.
+    const double min_ratio = options_->deletion_compaction_ratio;
+    if (min_ratio > 0) {
+        double best_ratio = 0;
+        for (int level = 1; level < lsm::Options::kNumLevels - 1; level++) {
+            for (FileMetaData* f : v->files_[level]) {
+                const double ratio = f->properties.DeletionRatio();
+                if (ratio >= min_ratio && ratio > best_ratio) {
+                    best_ratio = ratio;
+                    v->deletion_file_to_compact_ = f;
+                    v->deletion_file_to_compact_level_ = level;
+                }
+            }
+        }
+    }
 }
 
 Status VersionSet::LogAndApply(VersionEdit* edit, std::mutex* mu) {
@@ -587,11 +978,30 @@ Status VersionSet::LogAndApply(VersionEdit* edit, std::mutex* mu) {
     edit->SetNextFile(next_file_number_);
     edit->SetLastSequence(last_sequence_);
 
+    if (options_->max_open_files < 0) {
+        // A file moved between levels keeps its open table.
+        std::map<uint64_t, std::shared_ptr<Table>> open;
+        for (int level = 0; level < lsm::Options::kNumLevels; level++) {
+            for (FileMetaData* f : current_->files_[level]) {
+                open[f->number] = f->table;
+            }
+        }
+        for (auto& entry : edit->new_files_) {
+            FileMetaData& f = entry.second;
+            auto it = open.find(f.number);
+            if (f.table == nullptr && it != open.end()) {
+                f.table = it->second;
+            }
+        }
+        PinTables(edit);
+    }
+
     Version* v = new Version(this);
     {
         VersionSetBuilder builder(this, current_);
         builder.Apply(edit);
         builder.SaveTo(v);
+        builder.SaveBlobFilesTo(v);
     }
     Finalize(v);
 
@@ -612,6 +1022,11 @@ Status VersionSet::LogAndApply(VersionEdit* edit, std::mutex* mu) {
             s = descriptor_log_->Sync();
         }
         if (s.ok()) {
+            for (const auto& kv : current_->blob_files_) {
+                if (v->blob_files_.count(kv.first) == 0) {
+                    obsolete_blob_files_.push_back(kv.second.shared);
+                }
+            }
             AppendVersion(v);
             log_number_ = edit->log_number_;
             prev_log_number_ = edit->prev_log_number_;
@@ -629,6 +1044,35 @@ Status VersionSet::LogAndApply(VersionEdit* edit, std::mutex* mu) {
     return s;
 }
 
+void VersionSet::PinTables(VersionEdit* edit) {
+    if (options_->max_open_files >= 0) {
+        return;
+    }
+    std::vector<FileMetaData*> files;
+    for (auto& entry : edit->new_files_) {
+        if (entry.second.table == nullptr) {
+            files.push_back(&entry.second);
+        }
+    }
+    // A table that fails to open is left to the table cache, which
+    // reports the error when the file is read.
+    std::atomic<size_t> next(0);
+    auto open = [&] {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            table_cache_->OpenTable(files[i]->number, files[i]->file_size, &files[i]->table);
+        }
+    };
+    const size_t num_threads = std::min(files.size(), kMaxPinThreads);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; i++) {
+        threads.emplace_back(open);
+    }
+    open();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+}
+
 Status VersionSet::WriteSnapshot(WalWriter* log) {
     VersionEdit edit;
     edit.SetComparatorName(Slice(icmp_.user_comparator()->Name()));
@@ -648,6 +1092,14 @@ Status VersionSet::WriteSnapshot(WalWriter* log) {
         }
     }
 
+    for (const auto& kv : current_->blob_files_) {
+        const BlobFileMetaData& b = kv.second;
+        edit.AddBlobFile(b.shared->number, b.shared->total_count, b.shared->total_bytes);
+        if (b.garbage_count > 0) {
+            edit.AddBlobGarbage(b.shared->number, b.garbage_count, b.garbage_bytes);
+        }
+    }
+
     std::string record;
     edit.EncodeTo(&record);
     return log->AddRecord(record);
@@ -657,25 +1109,34 @@ Status VersionSet::Recover() {
     return Status::OK();
 }
 
+int VersionSet::OutputLevel(int level) const {
+    return level == 0 ? current_->base_level_ : level + 1;
+}
+
 Compaction* VersionSet::PickCompaction() {
     Compaction* c;
     int level;
 
     const bool size_compaction = (current_->compaction_score_ >= 1);
     const bool seek_compaction = (current_->file_to_compact_ != nullptr);
+    const bool deletion_compaction = (current_->deletion_file_to_compact_ != nullptr);
     
     if (size_compaction) {
         level = current_->compaction_level_;
         assert(level >= 0);
         assert(level + 1 < lsm::Options::kNumLevels);
-        c = new Compaction(options_, level);
+        c = new Compaction(options_, level, OutputLevel(level));
 
-        for (size_t i = 0; i < current_->files_[level].size(); i++) {
-            FileMetaData* f = current_->files_[level][i];
-            if (compact_pointer_[level].empty() ||
-                icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-                c->inputs_[0].push_back(f);
-                break;
+        if (current_->compaction_file_ != nullptr) {
+            c->inputs_[0].push_back(current_->compaction_file_);
+        } else {
+            for (size_t i = 0; i < current_->files_[level].size(); i++) {
+                FileMetaData* f = current_->files_[level][i];
+                if (compact_pointer_[level].empty() ||
+                    icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
+                    c->inputs_[0].push_back(f);
+                    break;
+                }
             }
         }
         if (c->inputs_[0].empty()) {
@@ -683,8 +1144,12 @@ Compaction* VersionSet::PickCompaction() {
         }
     } else if (seek_compaction) {
         level = current_->file_to_compact_level_;
-        c = new Compaction(options_, level);
+        c = new Compaction(options_, level, OutputLevel(level));
         c->inputs_[0].push_back(current_->file_to_compact_);
+    } else if (deletion_compaction) {
+        level = current_->deletion_file_to_compact_level_;
+        c = new Compaction(options_, level, OutputLevel(level));
+        c->inputs_[0].push_back(current_->deletion_file_to_compact_);
     } else {
         return nullptr;
     }
@@ -716,6 +1181,7 @@ Compaction* VersionSet::PickCompaction() {
 
 void VersionSet::SetupOtherInputs(Compaction* c) {
     const int level = c->level();
+    const int output_level = c->output_level();
     InternalKey smallest, largest;
     
     smallest = c->inputs_[0][0]->smallest;
@@ -732,8 +1198,8 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     
     Slice user_smallest = smallest.user_key();
     Slice user_largest = largest.user_key();
-    for (size_t i = 0; i < current_->files_[level + 1].size(); i++) {
-        FileMetaData* f = current_->files_[level + 1][i];
+    for (size_t i = 0; i < current_->files_[output_level].size(); i++) {
+        FileMetaData* f = current_->files_[output_level][i];
         if (icmp_.user_comparator()->Compare(f->largest.user_key(), user_smallest) >= 0 &&
             icmp_.user_comparator()->Compare(f->smallest.user_key(), user_largest) <= 0) {
             c->inputs_[1].push_back(f);
@@ -753,9 +1219,9 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     user_smallest = smallest.user_key();
     user_largest = largest.user_key();
     
-    if (level + 2 < lsm::Options::kNumLevels) {
-        for (size_t i = 0; i < current_->files_[level + 2].size(); i++) {
-            FileMetaData* f = current_->files_[level + 2][i];
+    if (output_level + 1 < lsm::Options::kNumLevels) {
+        for (size_t i = 0; i < current_->files_[output_level + 1].size(); i++) {
+            FileMetaData* f = current_->files_[output_level + 1][i];
             if (icmp_.user_comparator()->Compare(f->largest.user_key(), user_smallest) >= 0 &&
                 icmp_.user_comparator()->Compare(f->smallest.user_key(), user_largest) <= 0) {
                 c->grandparents_.push_back(f);
@@ -15,6 +15,7 @@
 
 namespace lsm {
 
+class BlobFileCache;
 class VersionSet;
 
 class Version {
@@ -22,10 +23,45 @@ public:
     void Ref();
     void Unref();
 
-    void Get(const ReadOptions&, const Slice& key, std::string* val, Status* status);
+    // The first file a lookup read without finding its key in, when it
+    // went on to read another.
+    struct GetStats {
+        FileMetaData* seek_file;
+        int seek_file_level;
+    };
+
+    void Get(const ReadOptions&, const Slice& key, std::string* val, Status* status,
+             GetStats* stats);
+
+    // Charges stats.seek_file one seek. Returns true once its allowed seeks
+    // run out and it becomes the file to compact, i.e. a compaction may be
+    // needed. REQUIRES: DB mutex held.
+    bool UpdateStats(const GetStats& stats);
+
+    // Charges a seek to the first of the files that could hold the internal
+    // key, if there are at least two; iterators call this for a sample of
+    // the keys they read. Returns true as UpdateStats() does. REQUIRES: DB
+    // mutex held.
+    bool RecordReadSample(const Slice& internal_key);
+
+    // Get() for a batch of internal lookup keys, with the result for keys[i]
+    // stored in *values[i] and *statuses[i]. Keys that fall in the same
+    // table are looked up in one TableCache::MultiGet call.
+    void MultiGet(const ReadOptions&, const std::vector<Slice>& keys,
+                  const std::vector<std::string*>& values,
+                  const std::vector<Status*>& statuses);
 
     void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+    // Properties of every table in this version, by file number. Tables
+    // whose FileMetaData lacks them are read through the table cache.
+    Status GetPropertiesOfAllTables(TablePropertiesCollection* props);
+
+    // Returns true iff some file in the level overlaps the user key range
+    // [*smallest_user_key, *largest_user_key].
+    bool OverlapInLevel(int level, const Slice* smallest_user_key,
+                        const Slice* largest_user_key);
+
     std::string DebugString() const;
 
 private:
@@ -44,6 +80,9 @@ private:
 
     Iterator* NewConcatenatingIterator(const ReadOptions&, int level) const;
 
+    // Replaces the encoded BlobIndex in *value with the value it points to.
+    Status ResolveBlobIndex(const ReadOptions& options, std::string* value);
+
     VersionSet* vset_;
     Version* next_;
     Version* prev_;
@@ -51,16 +90,35 @@ private:
 
     std::vector<FileMetaData*> files_[lsm::Options::kNumLevels];
 
+    // Blob files referenced by this version's tables, by file number.
+    std::map<uint64_t, BlobFileMetaData> blob_files_;
+
     FileMetaData* file_to_compact_;
     int file_to_compact_level_;
 
+    // Table with the highest tombstone density at or above
+    // Options::deletion_compaction_ratio, set by Finalize().
+    FileMetaData* deletion_file_to_compact_;
+    int deletion_file_to_compact_level_;
+
     double compaction_score_;
     int compaction_level_;
+
+    // Table of compaction_level_ that a size compaction starts from under
+    // Options::compaction_pri, set by Finalize(); null for kRoundRobin and
+    // level 0, which go by compact_pointer_.
+    FileMetaData* compaction_file_;
+
+    // Level that level-0 compactions write to, set by Finalize(). Always 1
+    // unless Options::level_compaction_dynamic_level_bytes is set; levels
+    // between 0 and it are empty.
+    int base_level_;
 };
 
 class VersionSet {
 public:
-    VersionSet(const std::string& dbname, const Options* options, TableCache* table_cache);
+    VersionSet(const std::string& dbname, const Options* options, TableCache* table_cache,
+               BlobFileCache* blob_cache = nullptr);
     ~VersionSet();
 
     VersionSet(const VersionSet&) = delete;
@@ -69,6 +127,12 @@ public:
     // Applies *edit to current version, persists it, and installs it as current.
     Status LogAndApply(VersionEdit* edit, std::mutex* mu);
 
+    // With Options::max_open_files negative, opens the tables *edit adds,
+    // in parallel, and keeps them in its FileMetaData; otherwise does
+    // nothing. LogAndApply() does this too, but needs no lock here, so
+    // callers adding many files call it first, outside the DB mutex.
+    void PinTables(VersionEdit* edit);
+
     Status Recover();
 
     Version* current() const { return current_; }
@@ -116,6 +180,9 @@ private:
     void AppendVersion(Version* v);
     void Finalize(Version* v);
 
+    // Level a compaction of level writes to; see Compaction::output_level().
+    int OutputLevel(int level) const;
+
     void SetupOtherInputs(Compaction* c);
 
     Status WriteSnapshot(WalWriter* log);
@@ -123,6 +190,7 @@ private:
     const std::string dbname_;
     const Options* const options_;
     TableCache* const table_cache_;
+    BlobFileCache* const blob_cache_;
     uint64_t next_file_number_;
     uint64_t manifest_file_number_;
     uint64_t last_sequence_;
@@ -138,6 +206,10 @@ private:
     Version* current_;
 
     std::string compact_pointer_[lsm::Options::kNumLevels];
+
+    // Blob files dropped from the current version. Each can be deleted once
+    // this list holds the only reference, i.e. no live Version uses it.
+    std::vector<std::shared_ptr<SharedBlobFileMetaData> > obsolete_blob_files_;
 };
 
 }
@@ -0,0 +1,110 @@
+#include "lsm/write_buffer_manager.h"
+#include <algorithm>
+#include "src/util/coding.h"
+
+namespace lsm {
+
+static void DeleteDummyEntry(const Slice& /*key*/, void* /*value*/) {}
+
+WriteBufferManager::WriteBufferManager(size_t buffer_size, std::shared_ptr<Cache> cache)
+    : buffer_size_(buffer_size),
+      mutable_limit_(buffer_size * 7 / 8),
+      memory_used_(0),
+      memory_active_(0),
+      cache_(std::move(cache)),
+      cache_id_(cache_ != nullptr ? cache_->NewId() : 0) {}
+
+WriteBufferManager::~WriteBufferManager() {
+    std::lock_guard<std::mutex> l(cache_mu_);
+    for (size_t i = 0; i < dummy_handles_.size(); i++) {
+        char buf[16];
+        EncodeFixed64(buf, cache_id_);
+        EncodeFixed64(buf + 8, i);
+        cache_->Release(dummy_handles_[i]);
+        cache_->Erase(Slice(buf, sizeof(buf)));
+    }
+}
+
+size_t WriteBufferManager::dummy_entries_in_cache_usage() const {
+    std::lock_guard<std::mutex> l(cache_mu_);
+    return dummy_handles_.size() * kDummyEntrySize;
+}
+
+bool WriteBufferManager::ShouldFlush() const {
+    if (buffer_size_ == 0) {
+        return false;
+    }
+    const size_t active = mutable_memtable_memory_usage();
+    return active >= mutable_limit_ ||
+           (memory_usage() >= buffer_size_ && active >= buffer_size_ / 2);
+}
+
+void WriteBufferManager::RegisterClient(Client* client) {
+    std::lock_guard<std::mutex> l(clients_mu_);
+    clients_.push_back(client);
+}
+
+void WriteBufferManager::UnregisterClient(Client* client) {
+    std::lock_guard<std::mutex> l(clients_mu_);
+    clients_.erase(std::remove(clients_.begin(), clients_.end(), client), clients_.end());
+}
+
+void WriteBufferManager::FlushLargest() {
+    // Holding clients_mu_ keeps the chosen client from closing under us.
+    std::lock_guard<std::mutex> l(clients_mu_);
+    Client* largest = nullptr;
+    size_t largest_size = 0;
+    for (Client* client : clients_) {
+        const size_t size = client->MutableMemtableSize();
+        if (size > largest_size) {
+            largest = client;
+            largest_size = size;
+        }
+    }
+    if (largest != nullptr) {
+        largest->FlushMemtable();
+    }
+}
+
+void WriteBufferManager::ReserveMem(size_t n) {
+    memory_used_.fetch_add(n, std::memory_order_relaxed);
+    memory_active_.fetch_add(n, std::memory_order_relaxed);
+    if (cache_ != nullptr) {
+        UpdateCacheCharge();
+    }
+}
+
+void WriteBufferManager::ScheduleFreeMem(size_t n) {
+    memory_active_.fetch_sub(n, std::memory_order_relaxed);
+}
+
+void WriteBufferManager::FreeMem(size_t n) {
+    memory_used_.fetch_sub(n, std::memory_order_relaxed);
+    if (cache_ != nullptr) {
+        UpdateCacheCharge();
+    }
+}
+
+void WriteBufferManager::UpdateCacheCharge() {
+    std::lock_guard<std::mutex> l(cache_mu_);
+    const size_t used = memory_usage();
+    char buf[16];
+    EncodeFixed64(buf, cache_id_);
+    while (dummy_handles_.size() * kDummyEntrySize < used) {
+        EncodeFixed64(buf + 8, dummy_handles_.size());
+        dummy_handles_.push_back(cache_->Insert(Slice(buf, sizeof(buf)), nullptr,
+                                                kDummyEntrySize, &DeleteDummyEntry,
+                                                Cache::Priority::kHigh));
+    }
+    // Keep one spare entry, so usage hovering at a boundary does not
+    // insert and erase the same entry over and over.
+    while (dummy_handles_.size() >= 2 &&
+           (dummy_handles_.size() - 2) * kDummyEntrySize >= used) {
+        EncodeFixed64(buf + 8, dummy_handles_.size() - 1);
+        cache_->Release(dummy_handles_.back());
+        cache_->Erase(Slice(buf, sizeof(buf)));
+        dummy_handles_.pop_back();
+    }
+}
+
+}
@@ -1,5 +1,7 @@
 #include "src/table/format.h"
 #include "src/util/coding.h"
+#include "src/util/crc32.h"
+#include "src/util/hash.h"
 #include <cassert>
 
 namespace lsm {
@@ -54,6 +56,21 @@ Status Footer::DecodeFrom(Slice* input) {
     return result;
 }
 
+uint32_t ComputeBlockChecksum(const char* contents, size_t n, char type) {
+    switch (BlockChecksumType(type)) {
+        case Options::kXXHash64:
+            // Seeding with the type byte covers it without a second pass.
+            return static_cast<uint32_t>(
+                XXHash64(contents, n, static_cast<uint8_t>(type)));
+        case Options::kCRC32c:
+        default: {
+            uint32_t crc = crc32c::Value(contents, n);
+            crc = crc32c::Extend(crc, &type, 1);
+            return crc32c::Mask(crc);
+        }
+    }
+}
+
 BlockBuilder::BlockBuilder(const Options* options)
     : options_(options),
       restarts_(),
@@ -70,19 +87,59 @@ void BlockBuilder::Reset() {
     counter_ = 0;
     finished_ = false;
     last_key_.clear();
+    hash_index_hashes_.clear();
+    hash_index_restarts_.clear();
+}
+
+// Buckets of the hash index for n keys. DB::Open rejects ratios outside
+// (0, 1]; tables built directly count them as 1.
+static uint32_t HashIndexBuckets(size_t n, double util_ratio) {
+    if (!(util_ratio > 0 && util_ratio <= 1)) {
+        util_ratio = 1;
+    }
+    const uint32_t num_buckets = static_cast<uint32_t>(n / util_ratio);
+    return num_buckets == 0 ? 1 : num_buckets;
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
-    return (buffer_.size() +
-            restarts_.size() * sizeof(uint32_t) +
-            sizeof(uint32_t));
+    size_t estimate = buffer_.size() +
+                      restarts_.size() * sizeof(uint32_t) +
+                      sizeof(uint32_t);
+    if (options_->data_block_hash_index) {
+        estimate += HashIndexBuckets(hash_index_hashes_.size(),
+                                     options_->data_block_hash_table_util_ratio) +
+                    sizeof(uint32_t);
+    }
+    return estimate;
 }
 
 Slice BlockBuilder::Finish() {
     for (size_t i = 0; i < restarts_.size(); i++) {
         PutFixed32(&buffer_, restarts_[i]);
     }
-    PutFixed32(&buffer_, restarts_.size());
+
+    uint32_t num_restarts = static_cast<uint32_t>(restarts_.size());
+    if (options_->data_block_hash_index &&
+        !hash_index_hashes_.empty() &&
+        restarts_.size() <= kBlockHashIndexMaxRestarts) {
+        const uint32_t num_buckets = HashIndexBuckets(hash_index_hashes_.size(),
+                                                      options_->data_block_hash_table_util_ratio);
+
+        std::string buckets(num_buckets, static_cast<char>(kBlockHashIndexNoEntry));
+        for (size_t i = 0; i < hash_index_hashes_.size(); i++) {
+            const uint32_t b = hash_index_hashes_[i] % num_buckets;
+            const uint8_t entry = static_cast<uint8_t>(buckets[b]);
+            if (entry == kBlockHashIndexNoEntry) {
+                buckets[b] = static_cast<char>(hash_index_restarts_[i]);
+            } else if (entry != hash_index_restarts_[i]) {
+                buckets[b] = static_cast<char>(kBlockHashIndexCollision);
+            }
+        }
+        buffer_.append(buckets);
+        PutFixed32(&buffer_, num_buckets);
+        num_restarts |= kBlockHashIndexFlag;
+    }
+    PutFixed32(&buffer_, num_restarts);
     finished_ = true;
     return Slice(buffer_);
 }
@@ -109,6 +166,17 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
     }
     const size_t non_shared = key.size() - shared;
 
+    if (options_->data_block_hash_index &&
+        restarts_.size() <= kBlockHashIndexMaxRestarts) {
+        // Entries for one user key are adjacent, so only the first is indexed;
+        // a lookup that lands on an earlier interval just scans a little more.
+        const uint32_t h = BlockHashIndexHash(key);
+        if (hash_index_hashes_.empty() || h != hash_index_hashes_.back()) {
+            hash_index_hashes_.push_back(h);
+            hash_index_restarts_.push_back(static_cast<uint8_t>(restarts_.size() - 1));
+        }
+    }
+
     PutVarint32(&buffer_, shared);
     PutVarint32(&buffer_, non_shared);
     PutVarint32(&buffer_, value.size());
@@ -122,4 +190,51 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
     counter_++;
 }
 
+namespace {
+
+struct PropertyField {
+    const char* name;
+    uint64_t TableProperties::*field;
+};
+
+// Kept in name order; block entries must be added sorted.
+const PropertyField kPropertyFields[] = {
+    {"lsm.creation.time", &TableProperties::creation_time},
+    {"lsm.data.size", &TableProperties::data_size},
+    {"lsm.largest.seqno", &TableProperties::largest_seqno},
+    {"lsm.num.deletions", &TableProperties::num_deletions},
+    {"lsm.num.entries", &TableProperties::num_entries},
+    {"lsm.raw.data.size", &TableProperties::raw_data_size},
+    {"lsm.raw.key.size", &TableProperties::raw_key_size},
+    {"lsm.raw.value.size", &TableProperties::raw_value_size},
+    {"lsm.smallest.seqno", &TableProperties::smallest_seqno},
+};
+
+}  // namespace
+
+void EncodeTableProperties(const TableProperties& props, BlockBuilder* block) {
+    std::string value;
+    for (const PropertyField& p : kPropertyFields) {
+        value.clear();
+        PutVarint64(&value, props.*p.field);
+        block->Add(p.name, value);
+    }
+}
+
+void DecodeTableProperties(Iterator* iter, TableProperties* props) {
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        for (const PropertyField& p : kPropertyFields) {
+            if (iter->key() == Slice(p.name)) {
+                Slice v = iter->value();
+                uint64_t n;
+                if (GetVarint64(&v, &n)) {
+                    props->*p.field = n;
+                }
+                break;
+            }
+        }
+    }
+}
+
+
 }
@@ -5,7 +5,10 @@
 #include <vector>
 #include "lsm/slice.h"
 #include "lsm/status.h"
+#include "lsm/iterator.h"
 #include "lsm/options.h"
+#include "lsm/table_properties.h"
+#include "src/util/hash.h"
 
 namespace lsm {
 
@@ -63,6 +66,55 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
 static const size_t kBlockTrailerSize = 5;
 
+// Metaindex key of the raw zstd dictionary that every data block of the
+// table was compressed against. Sorts before the "filter." entry.
+static const char kCompressionDictMetaKey[] = "compression.dict";
+
+// Metaindex key of the TableProperties block. Sorts after the "filter." entry.
+static const char kPropertiesMetaKey[] = "lsm.properties";
+
+// Metaindex key of an 8-byte fixed64 block holding the sequence number every
+// key of the table is read with. SstFileWriter writes it as 0, and
+// DB::IngestExternalFiles overwrites it (and the block checksum) in place.
+static const char kGlobalSeqnoMetaKey[] = "lsm.global.seqno";
+
+// The trailer's type byte holds the CompressionType in its low four bits and
+// the ChecksumType in its high four bits; blocks from files written before
+// checksum types existed decode as crc32c.
+inline char EncodeBlockType(Options::CompressionType compression,
+                            Options::ChecksumType checksum) {
+    return static_cast<char>((static_cast<uint8_t>(checksum) << 4) |
+                             static_cast<uint8_t>(compression));
+}
+
+inline Options::CompressionType BlockCompressionType(char type) {
+    return static_cast<Options::CompressionType>(static_cast<uint8_t>(type) & 0xf);
+}
+
+inline Options::ChecksumType BlockChecksumType(char type) {
+    return static_cast<Options::ChecksumType>(static_cast<uint8_t>(type) >> 4);
+}
+
+// Returns the value stored in the trailer for contents[0,n-1] followed by
+// the trailer type byte.
+uint32_t ComputeBlockChecksum(const char* contents, size_t n, char type);
+
+// Optional data block hash index, appended after the restart array:
+//    buckets: uint8[num_buckets]   (restart index, or one of the markers below)
+//    num_buckets: uint32
+// Its presence is flagged in the high bit of the trailing restart count.
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+static const uint8_t kBlockHashIndexNoEntry = 255;
+static const uint8_t kBlockHashIndexCollision = 254;
+static const uint32_t kBlockHashIndexMaxRestarts = 253;
+
+// Entries are hashed by user key so every version of a key maps to the same
+// restart interval. Keys shorter than 8 bytes are not internal keys.
+inline uint32_t BlockHashIndexHash(const Slice& key) {
+    const size_t n = (key.size() >= 8) ? key.size() - 8 : key.size();
+    return Hash(key.data(), n, 0x7b3a91c5);
+}
+
 // Builds blocks with prefix-compressed keys and restart points for binary search.
 
 class BlockBuilder {
@@ -99,6 +151,16 @@ private:
     int counter_;
     bool finished_;
     std::string last_key_;
+
+    // Hash index input: one (hash, restart index) pair per distinct user key,
+    // recorded at the first restart interval the user key appears in.
+    std::vector<uint32_t> hash_index_hashes_;
+    std::vector<uint8_t> hash_index_restarts_;
 };
 
+// The properties block maps each property name to a varint64 value. Readers
+// skip names they do not know, so properties can be added freely.
+void EncodeTableProperties(const TableProperties& props, BlockBuilder* block);
+void DecodeTableProperties(Iterator* iter, TableProperties* props);
+
 }
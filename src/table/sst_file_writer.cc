@@ -0,0 +1,125 @@
+#include "lsm/sst_file_writer.h"
+#include <memory>
+#include "lsm/comparator.h"
+#include "src/db/memtable.h"
+#include "src/table/sstable_builder.h"
+#include "src/util/file.h"
+
+namespace lsm {
+
+struct SstFileWriter::Rep {
+    Options options;
+    InternalKeyComparator internal_comparator;
+    Options table_options;
+    std::string file_path;
+    std::unique_ptr<WritableFile> file;
+    std::unique_ptr<TableBuilder> builder;
+    std::string smallest_key;
+    std::string last_key;
+    uint64_t num_entries = 0;
+    uint64_t file_size = 0;
+
+    explicit Rep(const Options& opt)
+        : options(opt),
+          internal_comparator(opt.comparator),
+          table_options(opt) {
+        table_options.comparator = &internal_comparator;
+        table_options.compression = opt.CompressionForLevel(Options::kNumLevels - 1);
+    }
+
+    // Every key is written with sequence 0; ingestion assigns the real one.
+    Status Add(const Slice& key, const Slice& value, ValueType type) {
+        if (builder == nullptr) {
+            return Status::InvalidArgument("SstFileWriter is not open");
+        }
+        if (num_entries > 0 &&
+            options.comparator->Compare(key, Slice(last_key)) <= 0) {
+            return Status::InvalidArgument("keys must be added in strictly increasing order");
+        }
+        InternalKey ikey(key, 0, type);
+        builder->Add(ikey.Encode(), value);
+        if (num_entries == 0) {
+            smallest_key.assign(key.data(), key.size());
+        }
+        last_key.assign(key.data(), key.size());
+        num_entries++;
+        return builder->status();
+    }
+};
+
+SstFileWriter::SstFileWriter(const Options& options) : rep_(new Rep(options)) {}
+
+SstFileWriter::~SstFileWriter() {
+    if (rep_->builder != nullptr) {
+        // Finish() was never called; the partial file is left to the caller.
+        rep_->builder->Abandon();
+    }
+    delete rep_;
+}
+
+Status SstFileWriter::Open(const std::string& file_path) {
+    Rep* r = rep_;
+    if (r->builder != nullptr) {
+        return Status::InvalidArgument("SstFileWriter is already open");
+    }
+    WritableFile* file = nullptr;
+    Status s = NewWritableFile(file_path, r->options.use_direct_io_for_flush_and_compaction,
+                               &file);
+    if (!s.ok()) {
+        return s;
+    }
+    r->file.reset(file);
+    r->file_path = file_path;
+    r->builder.reset(new TableBuilder(r->table_options, r->file.get()));
+    r->builder->ReserveGlobalSeqno();
+    r->num_entries = 0;
+    r->file_size = 0;
+    return Status::OK();
+}
+
+Status SstFileWriter::Put(const Slice& key, const Slice& value) {
+    return rep_->Add(key, value, kTypeValue);
+}
+
+Status SstFileWriter::Delete(const Slice& key) {
+    return rep_->Add(key, Slice(), kTypeDeletion);
+}
+
+Status SstFileWriter::Finish(ExternalSstFileInfo* info) {
+    Rep* r = rep_;
+    if (r->builder == nullptr) {
+        return Status::InvalidArgument("SstFileWriter is not open");
+    }
+    Status s;
+    if (r->num_entries == 0) {
+        r->builder->Abandon();
+        s = Status::InvalidArgument("cannot create an empty sst file");
+    } else {
+        s = r->builder->Finish();
+    }
+    r->file_size = r->builder->FileSize();
+    r->builder.reset();
+    Status close_status = r->file->Close();
+    if (s.ok()) {
+        s = close_status;
+    }
+    r->file.reset();
+
+    if (s.ok() && info != nullptr) {
+        info->file_path = r->file_path;
+        info->smallest_key = r->smallest_key;
+        info->largest_key = r->last_key;
+        info->num_entries = r->num_entries;
+        info->file_size = r->file_size;
+    }
+    return s;
+}
+
+uint64_t SstFileWriter::FileSize() const {
+    if (rep_->builder != nullptr) {
+        return rep_->builder->FileSize();
+    }
+    return rep_->file_size;
+}
+
+}
@@ -5,19 +5,36 @@
 #include "lsm/comparator.h"
 #include "lsm/options.h"
 #include "src/util/coding.h"
-#include "src/util/crc32.h"
 #include "src/util/bloom.h"
+#include "src/util/file.h"
+#include "src/util/lz.h"
+#include <algorithm>
+#include <ctime>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #ifdef LSM_HAVE_ZSTD
 #include <zstd.h>
+#include <zdict.h>
 #endif
 
 namespace lsm {
 
+// Per-thread compression scratch state; zstd contexts cannot be shared.
+struct CompressionContext {
+#ifdef LSM_HAVE_ZSTD
+    ZSTD_CCtx* zstd_cctx = nullptr;
+    ~CompressionContext() { ZSTD_freeCCtx(zstd_cctx); }
+#endif
+};
+
 struct TableBuilder::Rep {
     Options options;
     Options index_block_options;
-    std::ofstream* file;
+    WritableFile* file;
     uint64_t offset;
     Status status;
     BlockBuilder data_block;
@@ -25,6 +42,14 @@ struct TableBuilder::Rep {
     std::string last_key;
     int64_t num_entries;
     bool closed;
+
+    // Collected as entries are added and written as the properties block.
+    // Deletions and sequence numbers are only known for internal keys.
+    TableProperties props;
+    bool internal_keys;
+    bool reserve_global_seqno = false;
+    // 0 records the time Finish() runs.
+    uint64_t creation_time = 0;
     
     // We do not implement the FilterBlockBuilder in full generality
     // for this simplified engine - we'll just gather all keys in memory
@@ -38,7 +63,46 @@ struct TableBuilder::Rep {
 
     std::string compressed_output;
 
-    Rep(const Options& opt, std::ofstream* f)
+    // Dictionary compression holds data blocks back until enough samples
+    // exist to train the dictionary; they are then written in order.
+    struct BufferedBlock {
+        std::string contents;
+        std::string first_key;
+        std::string last_key;
+    };
+    bool buffering;
+    std::vector<BufferedBlock> buffered_blocks;
+    size_t buffered_bytes;
+    std::string first_key_in_block;
+    std::string compression_dict;
+    CompressionContext compression_ctx;
+#ifdef LSM_HAVE_ZSTD
+    ZSTD_CDict* zstd_cdict = nullptr;
+#endif
+
+    // Parallel compression: Flush() queues finished data blocks for the
+    // worker pool; the building thread writes them back in file order once
+    // compressed, together with their index entries.
+    struct ParallelBlock {
+        std::string raw;
+        std::string compressed;
+        Options::CompressionType type;
+        Options::ChecksumType checksum;
+        char trailer[kBlockTrailerSize];
+        bool done = false;
+        std::string index_key;
+        bool has_index_key = false;
+    };
+    std::vector<std::thread> workers;
+    std::deque<std::unique_ptr<ParallelBlock>> inflight;
+    size_t inflight_bytes = 0;
+    std::mutex mu;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    std::deque<ParallelBlock*> work_queue;
+    bool stop_workers = false;
+
+    Rep(const Options& opt, WritableFile* f)
         : options(opt),
           index_block_options(opt),
           file(f),
@@ -47,12 +111,126 @@ struct TableBuilder::Rep {
           index_block(&index_block_options),
           num_entries(0),
           closed(false),
-          pending_index_entry(false) {
+          internal_keys(dynamic_cast<const InternalKeyComparator*>(opt.comparator) != nullptr),
+          pending_index_entry(false),
+          buffering(false),
+          buffered_bytes(0) {
         index_block_options.block_restart_interval = 1;
+        index_block_options.data_block_hash_index = false;
+#ifdef LSM_HAVE_ZSTD
+        buffering = options.compression == Options::kZstdCompression &&
+                    options.zstd_max_dict_bytes > 0;
+#endif
+        if (options.parallel_compression_threads > 1 &&
+            options.compression != Options::kNoCompression) {
+            for (int i = 0; i < options.parallel_compression_threads; i++) {
+                workers.emplace_back([this] { CompressionWorker(); });
+            }
+        }
+    }
+
+    ~Rep() {
+        if (!workers.empty()) {
+            {
+                std::lock_guard<std::mutex> l(mu);
+                stop_workers = true;
+            }
+            work_cv.notify_all();
+            for (auto& t : workers) {
+                t.join();
+            }
+        }
+#ifdef LSM_HAVE_ZSTD
+        ZSTD_freeCDict(zstd_cdict);
+#endif
+    }
+
+    // Compresses raw into *output. Returns the type to record in the block
+    // trailer; kNoCompression means raw should be stored as is.
+    Options::CompressionType Compress(Options::CompressionType type, const Slice& raw,
+                                      bool use_dict, std::string* output,
+                                      CompressionContext* ctx) const {
+        switch (type) {
+            case Options::kZstdCompression: {
+#ifdef LSM_HAVE_ZSTD
+                size_t max_compressed_size = ZSTD_compressBound(raw.size());
+                output->resize(max_compressed_size);
+                size_t compressed_size;
+                if (use_dict && zstd_cdict != nullptr) {
+                    if (ctx->zstd_cctx == nullptr) {
+                        ctx->zstd_cctx = ZSTD_createCCtx();
+                    }
+                    compressed_size = ZSTD_compress_usingCDict(
+                        ctx->zstd_cctx, &(*output)[0], max_compressed_size,
+                        raw.data(), raw.size(), zstd_cdict);
+                } else {
+                    compressed_size = ZSTD_compress(
+                        &(*output)[0], max_compressed_size,
+                        raw.data(), raw.size(), 1 /* default level */);
+                }
+                if (ZSTD_isError(compressed_size)) {
+                    return Options::kNoCompression;
+                }
+                output->resize(compressed_size);
+                break;
+#else
+                (void)use_dict;
+                (void)ctx;
+                return Options::kNoCompression;
+#endif
+            }
+
+            case Options::kLZCompression:
+                lz::Compress(raw.data(), raw.size(), output);
+                break;
+
+            default:
+                return Options::kNoCompression;
+        }
+
+        // Store the block raw unless compression saved at least 12.5%; a poor
+        // ratio is not worth the decompression cost on every read.
+        if (output->size() >= raw.size() - (raw.size() / 8u)) {
+            return Options::kNoCompression;
+        }
+        return type;
+    }
+
+    void CompressionWorker() {
+        CompressionContext ctx;
+        std::unique_lock<std::mutex> l(mu);
+        while (true) {
+            work_cv.wait(l, [this] { return stop_workers || !work_queue.empty(); });
+            if (work_queue.empty()) {
+                return;
+            }
+            ParallelBlock* b = work_queue.front();
+            work_queue.pop_front();
+            l.unlock();
+
+            b->type = Compress(b->type, Slice(b->raw), true, &b->compressed, &ctx);
+            const Slice contents = (b->type == Options::kNoCompression)
+                                       ? Slice(b->raw) : Slice(b->compressed);
+            b->trailer[0] = EncodeBlockType(b->type, b->checksum);
+            EncodeFixed32(b->trailer + 1, ComputeBlockChecksum(contents.data(),
+                                                               contents.size(),
+                                                               b->trailer[0]));
+
+            l.lock();
+            b->done = true;
+            done_cv.notify_all();
+        }
+    }
+
+    size_t TrainBytesLimit() const {
+        if (options.zstd_max_train_bytes > 0) {
+            return options.zstd_max_train_bytes;
+        }
+        return static_cast<size_t>(options.zstd_max_dict_bytes) * 100;
     }
 };
 
-TableBuilder::TableBuilder(const Options& options, std::ofstream* file)
+TableBuilder::TableBuilder(const Options& options, WritableFile* file)
     : rep_(new Rep(options, file)) {
 }
 
@@ -68,6 +246,7 @@ Status TableBuilder::ChangeOptions(const Options& options) {
     rep_->options = options;
     rep_->index_block_options = options;
     rep_->index_block_options.block_restart_interval = 1;
+    rep_->index_block_options.data_block_hash_index = false;
     return Status::OK();
 }
 
@@ -82,9 +261,16 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     if (r->pending_index_entry) {
         assert(r->data_block.empty());
         r->options.comparator->FindShortestSeparator(&r->last_key, key);
-        std::string handle_encoding;
-        r->pending_handle.EncodeTo(&handle_encoding);
-        r->index_block.Add(r->last_key, Slice(handle_encoding));
+        if (!r->inflight.empty() && !r->inflight.back()->has_index_key) {
+            // The block is still in the compression pipeline; its entry is
+            // added when the block is written.
+            r->inflight.back()->index_key = r->last_key;
+            r->inflight.back()->has_index_key = true;
+        } else {
+            std::string handle_encoding;
+            r->pending_handle.EncodeTo(&handle_encoding);
+            r->index_block.Add(r->last_key, Slice(handle_encoding));
+        }
         r->pending_index_entry = false;
     }
 
@@ -96,6 +282,25 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
         }
     }
 
+    if (r->buffering && r->data_block.empty()) {
+        r->first_key_in_block.assign(key.data(), key.size());
+    }
+
+    r->props.raw_key_size += key.size();
+    r->props.raw_value_size += value.size();
+    ParsedInternalKey ikey;
+    if (r->internal_keys && ParseInternalKey(key, &ikey)) {
+        if (ikey.type == kTypeDeletion) {
+            r->props.num_deletions++;
+        }
+        if (r->num_entries == 0 || ikey.sequence < r->props.smallest_seqno) {
+            r->props.smallest_seqno = ikey.sequence;
+        }
+        if (r->num_entries == 0 || ikey.sequence > r->props.largest_seqno) {
+            r->props.largest_seqno = ikey.sequence;
+        }
+    }
+
     r->last_key.assign(key.data(), key.size());
     r->num_entries++;
     r->data_block.Add(key, value);
@@ -112,79 +317,187 @@ void TableBuilder::Flush() {
     if (!ok()) return;
     if (r->data_block.empty()) return;
     assert(!r->pending_index_entry);
-    WriteBlock(&r->data_block, &r->pending_handle);
+    if (r->buffering) {
+        Rep::BufferedBlock b;
+        b.contents = r->data_block.Finish().ToString();
+        b.first_key.swap(r->first_key_in_block);
+        b.last_key = r->last_key;
+        r->buffered_bytes += b.contents.size();
+        r->props.raw_data_size += b.contents.size();
+        r->buffered_blocks.push_back(std::move(b));
+        r->data_block.Reset();
+        if (r->buffered_bytes >= r->TrainBytesLimit()) {
+            EnterUnbuffered();
+        }
+        return;
+    }
+    if (!r->workers.empty()) {
+        std::unique_ptr<Rep::ParallelBlock> b(new Rep::ParallelBlock);
+        b->raw = r->data_block.Finish().ToString();
+        b->type = r->options.compression;
+        b->checksum = r->options.checksum;
+        r->data_block.Reset();
+        r->inflight_bytes += b->raw.size();
+        r->props.raw_data_size += b->raw.size();
+        {
+            std::lock_guard<std::mutex> l(r->mu);
+            r->work_queue.push_back(b.get());
+        }
+        r->work_cv.notify_one();
+        r->inflight.push_back(std::move(b));
+        r->pending_index_entry = true;
+        WriteCompletedBlocks(false);
+        return;
+    }
+    const Slice raw = r->data_block.Finish();
+    r->props.raw_data_size += raw.size();
+    CompressAndWriteBlock(raw, &r->pending_handle, true);
+    r->data_block.Reset();
     if (ok()) {
         r->pending_index_entry = true;
-        r->file->flush();
+        r->status = r->file->Flush();
     }
 }
 
-void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
-    // File format contains a sequence of blocks where each block has:
-    //    block_data: uint8[n]
-    //    type: uint8
-    //    crc: uint32
-    assert(ok());
+void TableBuilder::EnterUnbuffered() {
     Rep* r = rep_;
-    Slice raw = block->Finish();
+    r->buffering = false;
 
-    Slice block_contents;
-    Options::CompressionType type = r->options.compression;
+#ifdef LSM_HAVE_ZSTD
+    if (!r->buffered_blocks.empty()) {
+        std::string samples;
+        std::vector<size_t> sample_sizes;
+        samples.reserve(r->buffered_bytes);
+        for (const auto& b : r->buffered_blocks) {
+            samples.append(b.contents);
+            sample_sizes.push_back(b.contents.size());
+        }
 
-    switch (type) {
-        case Options::kNoCompression:
-            block_contents = raw;
-            break;
+        const size_t max_dict = r->options.zstd_max_dict_bytes;
+        r->compression_dict.resize(max_dict);
+        size_t dict_size = ZDICT_trainFromBuffer(&r->compression_dict[0], max_dict,
+                                                 samples.data(), sample_sizes.data(),
+                                                 static_cast<unsigned>(sample_sizes.size()));
+        if (ZDICT_isError(dict_size)) {
+            // Too few samples to train on; the most recent sample bytes still
+            // make a useful raw-content dictionary.
+            const size_t n = std::min(max_dict, samples.size());
+            r->compression_dict = samples.substr(samples.size() - n);
+        } else {
+            r->compression_dict.resize(dict_size);
+        }
 
-        case Options::kZstdCompression: {
-#ifdef LSM_HAVE_ZSTD
-            size_t max_compressed_size = ZSTD_compressBound(raw.size());
-            r->compressed_output.resize(max_compressed_size);
-            size_t compressed_size = ZSTD_compress(
-                &r->compressed_output[0], max_compressed_size,
-                raw.data(), raw.size(), 1 /* default level */);
-            if (ZSTD_isError(compressed_size)) {
-                block_contents = raw;
-                type = Options::kNoCompression;
-            } else {
-                r->compressed_output.resize(compressed_size);
-                block_contents = Slice(r->compressed_output);
-            }
-#else
-            block_contents = raw;
-            type = Options::kNoCompression;
+        r->zstd_cdict = ZSTD_createCDict(r->compression_dict.data(),
+                                         r->compression_dict.size(), 1);
+        if (r->zstd_cdict == nullptr) {
+            r->status = Status::IOError("failed to create zstd dictionary");
+        }
+    }
 #endif
+
+    const size_t n = r->buffered_blocks.size();
+    for (size_t i = 0; i < n && ok(); i++) {
+        const Rep::BufferedBlock& b = r->buffered_blocks[i];
+        BlockHandle handle;
+        CompressAndWriteBlock(Slice(b.contents), &handle, true);
+        if (!ok()) {
             break;
         }
+        if (i + 1 < n) {
+            std::string separator = b.last_key;
+            r->options.comparator->FindShortestSeparator(&separator,
+                                                         r->buffered_blocks[i + 1].first_key);
+            std::string handle_encoding;
+            handle.EncodeTo(&handle_encoding);
+            r->index_block.Add(separator, Slice(handle_encoding));
+        } else {
+            // The last buffered block ends at r->last_key; its separator is
+            // added by the next Add() or by Finish() as usual.
+            r->pending_handle = handle;
+            r->pending_index_entry = true;
+        }
     }
+    r->buffered_blocks.clear();
+    r->buffered_bytes = 0;
+}
+
+void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle, bool use_dict) {
+    Slice raw = block->Finish();
+    CompressAndWriteBlock(raw, handle, use_dict);
+    block->Reset();
+}
+
+void TableBuilder::CompressAndWriteBlock(const Slice& raw, BlockHandle* handle,
+                                         bool use_dict) {
+    assert(ok());
+    Rep* r = rep_;
+    Options::CompressionType type = r->Compress(r->options.compression, raw, use_dict,
+                                                &r->compressed_output, &r->compression_ctx);
+    const Slice block_contents = (type == Options::kNoCompression)
+                                     ? raw : Slice(r->compressed_output);
     WriteRawBlock(block_contents, type, handle);
     r->compressed_output.clear();
-    block->Reset();
+}
+
+void TableBuilder::WriteCompletedBlocks(bool wait_all) {
+    Rep* r = rep_;
+    // Bound memory held by queued blocks when workers fall behind.
+    const size_t max_inflight = 2 * r->workers.size();
+    while (!r->inflight.empty()) {
+        Rep::ParallelBlock* b = r->inflight.front().get();
+        if (!b->has_index_key) {
+            // The most recent block; its separator needs the next key.
+            break;
+        }
+        {
+            std::unique_lock<std::mutex> l(r->mu);
+            if (!b->done) {
+                if (!wait_all && r->inflight.size() <= max_inflight) {
+                    return;
+                }
+                r->done_cv.wait(l, [b] { return b->done; });
+            }
+        }
+        if (ok()) {
+            const Slice contents = (b->type == Options::kNoCompression)
+                                       ? Slice(b->raw) : Slice(b->compressed);
+            BlockHandle handle;
+            WriteBlockWithTrailer(contents, b->trailer, &handle);
+            if (ok()) {
+                std::string handle_encoding;
+                handle.EncodeTo(&handle_encoding);
+                r->index_block.Add(b->index_key, Slice(handle_encoding));
+                r->status = r->file->Flush();
+            }
+        }
+        r->inflight_bytes -= b->raw.size();
+        r->inflight.pop_front();
+    }
 }
 
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
                                  Options::CompressionType type,
                                  BlockHandle* handle) {
+    char trailer[kBlockTrailerSize];
+    trailer[0] = EncodeBlockType(type, rep_->options.checksum);
+    EncodeFixed32(trailer + 1, ComputeBlockChecksum(block_contents.data(),
+                                                    block_contents.size(),
+                                                    trailer[0]));
+    WriteBlockWithTrailer(block_contents, trailer, handle);
+}
+
+void TableBuilder::WriteBlockWithTrailer(const Slice& block_contents, const char* trailer,
+                                         BlockHandle* handle) {
     Rep* r = rep_;
     handle->set_offset(r->offset);
     handle->set_size(block_contents.size());
-    r->file->write(block_contents.data(), block_contents.size());
-    
-    if (r->file->fail()) {
-        r->status = Status::IOError("Failed to write raw block");
+    r->status = r->file->Append(block_contents);
+    if (!r->status.ok()) {
         return;
     }
 
-    char trailer[kBlockTrailerSize];
-    trailer[0] = static_cast<char>(type);
-    uint32_t crc = crc32c::Value(block_contents.data(), block_contents.size());
-    crc = crc32c::Extend(crc, trailer, 1);
-    EncodeFixed32(trailer + 1, crc32c::Mask(crc));
-    
-    r->file->write(trailer, kBlockTrailerSize);
-    
-    if (r->file->fail()) {
-        r->status = Status::IOError("Failed to write block trailer");
+    r->status = r->file->Append(Slice(trailer, kBlockTrailerSize));
+    if (!r->status.ok()) {
         return;
     }
 
@@ -198,10 +511,33 @@ Status TableBuilder::status() const {
 Status TableBuilder::Finish() {
     Rep* r = rep_;
     Flush();
+    if (r->buffering && ok()) {
+        EnterUnbuffered();
+    }
+    if (!r->inflight.empty()) {
+        if (r->pending_index_entry && !r->inflight.back()->has_index_key) {
+            r->options.comparator->FindShortSuccessor(&r->last_key);
+            r->inflight.back()->index_key = r->last_key;
+            r->inflight.back()->has_index_key = true;
+            r->pending_index_entry = false;
+        }
+        WriteCompletedBlocks(true);
+    }
     assert(!r->closed);
     r->closed = true;
 
+    r->props.num_entries = r->num_entries;
+    r->props.data_size = r->offset;
+    r->props.creation_time =
+        r->creation_time != 0 ? r->creation_time : static_cast<uint64_t>(time(nullptr));
+
     BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+    BlockHandle compression_dict_handle, properties_handle, global_seqno_handle;
+
+    if (ok() && !r->compression_dict.empty()) {
+        WriteRawBlock(Slice(r->compression_dict), Options::kNoCompression,
+                      &compression_dict_handle);
+    }
 
     // Write bloom filter block
     if (ok() && r->options.bloom_bits_per_key > 0) {
@@ -219,9 +555,33 @@ Status TableBuilder::Finish() {
                       &filter_block_handle);
     }
 
+    if (ok() && r->reserve_global_seqno) {
+        char seqno[8];
+        EncodeFixed64(seqno, 0);
+        WriteRawBlock(Slice(seqno, sizeof(seqno)), Options::kNoCompression,
+                      &global_seqno_handle);
+    }
+
+    // Write properties block
+    if (ok()) {
+        Options properties_options = r->options;
+        properties_options.data_block_hash_index = false;
+        BlockBuilder properties_block(&properties_options);
+        EncodeTableProperties(r->props, &properties_block);
+        WriteRawBlock(properties_block.Finish(), Options::kNoCompression,
+                      &properties_handle);
+    }
+
     // Write metaindex block
     if (ok()) {
-        BlockBuilder meta_index_block(&r->options);
+        Options meta_index_options = r->options;
+        meta_index_options.data_block_hash_index = false;
+        BlockBuilder meta_index_block(&meta_index_options);
+        if (!r->compression_dict.empty()) {
+            std::string handle_encoding;
+            compression_dict_handle.EncodeTo(&handle_encoding);
+            meta_index_block.Add(kCompressionDictMetaKey, handle_encoding);
+        }
         if (r->options.bloom_bits_per_key > 0) {
             std::string key = "filter.";
             key.append((BloomFilterPolicy(0)).Name());
@@ -229,6 +589,16 @@ Status TableBuilder::Finish() {
             filter_block_handle.EncodeTo(&handle_encoding);
             meta_index_block.Add(key, handle_encoding);
         }
+        if (r->reserve_global_seqno) {
+            std::string handle_encoding;
+            global_seqno_handle.EncodeTo(&handle_encoding);
+            meta_index_block.Add(kGlobalSeqnoMetaKey, handle_encoding);
+        }
+        {
+            std::string handle_encoding;
+            properties_handle.EncodeTo(&handle_encoding);
+            meta_index_block.Add(kPropertiesMetaKey, handle_encoding);
+        }
         WriteBlock(&meta_index_block, &metaindex_block_handle);
     }
 
@@ -250,15 +620,26 @@ Status TableBuilder::Finish() {
         footer.set_index_handle(index_block_handle);
         std::string footer_encoding;
         footer.EncodeTo(&footer_encoding);
-        r->file->write(footer_encoding.data(), footer_encoding.size());
-        if (r->file->fail()) {
-            r->status = Status::IOError("Failed to write footer");
-        }
+        r->status = r->file->Append(footer_encoding);
         r->offset += footer_encoding.size();
     }
+
+    // With direct I/O the unaligned tail is still buffered; Close() pads it
+    // to a whole page and truncates the file back.
+    if (ok()) {
+        r->status = r->file->Close();
+    }
     return r->status;
 }
 
+void TableBuilder::ReserveGlobalSeqno() {
+    rep_->reserve_global_seqno = true;
+}
+
+void TableBuilder::SetCreationTime(uint64_t creation_time) {
+    rep_->creation_time = creation_time;
+}
+
 void TableBuilder::Abandon() {
     Rep* r = rep_;
     assert(!r->closed);
@@ -269,8 +650,14 @@ uint64_t TableBuilder::NumEntries() const {
     return rep_->num_entries;
 }
 
+const TableProperties& TableBuilder::GetTableProperties() const {
+    return rep_->props;
+}
+
 uint64_t TableBuilder::FileSize() const {
-    return rep_->offset;
+    // Count blocks held back for dictionary training or still being
+    // compressed so callers splitting output files by size see the table grow.
+    return rep_->offset + rep_->buffered_bytes + rep_->inflight_bytes;
 }
 
 }
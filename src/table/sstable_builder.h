@@ -2,20 +2,21 @@
 
 #include <cstdint>
 #include <string>
-#include <fstream>
 #include "lsm/options.h"
 #include "lsm/status.h"
+#include "lsm/table_properties.h"
 
 namespace lsm {
 
 class BlockBuilder;
 class BlockHandle;
+class WritableFile;
 
 // Builds an immutable sorted SSTable from key-value pairs. Thread-safe for const methods.
 class TableBuilder {
 public:
-    // Caller must close *file after Finish() returns.
-    TableBuilder(const Options& options, std::ofstream* file);
+    // Finish() closes *file; the caller still owns and deletes it.
+    TableBuilder(const Options& options, WritableFile* file);
 
     TableBuilder(const TableBuilder&) = delete;
     TableBuilder& operator=(const TableBuilder&) = delete;
@@ -35,16 +36,32 @@ public:
     // REQUIRES: Finish()/Abandon() not yet called.
     Status Finish();
 
+    // Makes Finish() write a global sequence number block (initially 0) that
+    // DB::IngestExternalFiles can overwrite in place. Used by SstFileWriter.
+    void ReserveGlobalSeqno();
+
+    // Records creation_time, in seconds since the epoch, as the table's
+    // creation time instead of the time Finish() runs, so that builds of
+    // the same entries produce identical files.
+    void SetCreationTime(uint64_t creation_time);
+
     // Must call Abandon() if not calling Finish().
     void Abandon();
 
     uint64_t NumEntries() const;
 
+    // Properties written to the table. Complete once Finish() succeeds.
+    const TableProperties& GetTableProperties() const;
+
     uint64_t FileSize() const;
 
 private:
     bool ok() const { return status().ok(); }
-    void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+    void WriteBlock(BlockBuilder* block, BlockHandle* handle, bool use_dict = false);
+    void CompressAndWriteBlock(const Slice& raw, BlockHandle* handle, bool use_dict);
+    void EnterUnbuffered();
+    void WriteCompletedBlocks(bool wait_all);
+    void WriteBlockWithTrailer(const Slice& data, const char* trailer, BlockHandle* handle);
     void WriteRawBlock(const Slice& data, Options::CompressionType type, BlockHandle* handle);
 
     struct Rep;
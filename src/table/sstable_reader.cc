@@ -1,13 +1,16 @@
 #include "src/table/sstable_reader.h"
 #include <cassert>
+#include <cstring>
 #include "src/table/format.h"
 #include "src/db/memtable.h"
 #include "lsm/comparator.h"
 #include "src/util/coding.h"
-#include "src/util/crc32.h"
 #include "src/util/bloom.h"
-#include <fstream>
-#include <mutex>
+#include "src/util/file.h"
+#include "src/util/hash.h"
+#include "src/util/lz.h"
+#include "src/util/persistent_cache.h"
+#include "src/util/secondary_cache.h"
 #include <vector>
 
 #ifdef LSM_HAVE_ZSTD
@@ -44,18 +47,36 @@ public:
     explicit Block(const Slice& contents)
         : data_(contents.data()),
           size_(contents.size()),
-          restart_offset_(0) {
+          restart_offset_(0),
+          hash_buckets_(nullptr),
+          num_buckets_(0) {
         if (size_ < sizeof(uint32_t)) {
             size_ = 0;
             return;
         }
-        size_t max_restarts_allowed = (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
+        size_t trailer = sizeof(uint32_t);
+        if (HasHashIndex()) {
+            if (size_ < 2 * sizeof(uint32_t)) {
+                size_ = 0;
+                return;
+            }
+            num_buckets_ = DecodeFixed32(data_ + size_ - 2 * sizeof(uint32_t));
+            trailer += sizeof(uint32_t) + num_buckets_;
+            if (num_buckets_ == 0 || trailer > size_) {
+                size_ = 0;
+                return;
+            }
+        }
+        size_t max_restarts_allowed = (size_ - trailer) / sizeof(uint32_t);
         if (NumRestarts() > max_restarts_allowed) {
             size_ = 0;
             return;
         }
         // NumRestarts() is read from the end of the block
-        restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+        restart_offset_ = size_ - trailer - NumRestarts() * sizeof(uint32_t);
+        if (num_buckets_ > 0) {
+            hash_buckets_ = reinterpret_cast<const uint8_t*>(data_ + size_ - trailer);
+        }
     }
 
     ~Block() { delete[] data_; }
@@ -64,17 +85,38 @@ public:
     Block& operator=(const Block&) = delete;
 
     size_t size() const { return size_; }
+    Slice contents() const { return Slice(data_, size_); }
     Iterator* NewIterator(const Comparator* comparator);
 
+    // Returns the restart interval holding the first entry for key's user key,
+    // kBlockHashIndexNoEntry if the block has no such user key, or
+    // kBlockHashIndexCollision if the caller must fall back to Seek().
+    uint8_t HashIndexLookup(const Slice& key) const {
+        if (hash_buckets_ == nullptr) {
+            return kBlockHashIndexCollision;
+        }
+        const uint8_t entry = hash_buckets_[BlockHashIndexHash(key) % num_buckets_];
+        if (entry != kBlockHashIndexNoEntry && entry >= NumRestarts()) {
+            return kBlockHashIndexCollision;
+        }
+        return entry;
+    }
+
 private:
+    bool HasHashIndex() const {
+        return (DecodeFixed32(data_ + size_ - sizeof(uint32_t)) & kBlockHashIndexFlag) != 0;
+    }
+
     uint32_t NumRestarts() const {
         assert(size_ >= sizeof(uint32_t));
-        return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+        return DecodeFixed32(data_ + size_ - sizeof(uint32_t)) & ~kBlockHashIndexFlag;
     }
 
     const char* data_;
     size_t size_;
     uint32_t restart_offset_;
+    const uint8_t* hash_buckets_;
+    uint32_t num_buckets_;
     friend class BlockIter;
     friend class Table;
 };
@@ -156,7 +198,13 @@ public:
             }
         }
 
-        SeekToRestartPoint(left);
+        SeekFromRestartPoint(left, target);
+    }
+
+    // Positions at the first key >= target, scanning forward from restart
+    // point "index", which must not lie past that key.
+    void SeekFromRestartPoint(uint32_t index, const Slice& target) {
+        SeekToRestartPoint(index);
         while (true) {
             if (!ParseNextKey()) {
                 return;
@@ -254,37 +302,43 @@ Iterator* Block::NewIterator(const Comparator* comparator) {
     }
 }
 
-// ReadBlock: reads a block from the persistent file handle stored in Table::Rep.
-// Protected by file_mutex_ to serialize concurrent reads on the same stream.
-static Status ReadBlockFromHandle(std::ifstream& file, std::mutex& file_mutex,
-                                  const ReadOptions& options,
-                                  const BlockHandle& handle, Block** result) {
-    *result = nullptr;
+// Decompression state for a table whose data blocks were compressed
+// against a shared zstd dictionary. Built once when the table is opened.
+struct UncompressionDict {
+#ifdef LSM_HAVE_ZSTD
+    ZSTD_DDict* ddict = nullptr;
+    ~UncompressionDict() { ZSTD_freeDDict(ddict); }
+#endif
+};
 
-    const size_t n = static_cast<size_t>(handle.size());
-    char* buf = new char[n + kBlockTrailerSize];
+#ifdef LSM_HAVE_ZSTD
+// Decompression contexts are large; keep one per reading thread.
+static ZSTD_DCtx* ThreadLocalDCtx() {
+    struct Holder {
+        ZSTD_DCtx* ctx = ZSTD_createDCtx();
+        ~Holder() { ZSTD_freeDCtx(ctx); }
+    };
+    thread_local Holder holder;
+    return holder.ctx;
+}
+#endif
 
-    {
-        std::lock_guard<std::mutex> lock(file_mutex);
-        file.clear();
-        file.seekg(handle.offset(), std::ios::beg);
-        file.read(buf, n + kBlockTrailerSize);
-        if (file.gcount() != static_cast<std::streamsize>(n + kBlockTrailerSize)) {
-            delete[] buf;
-            return Status::IOError("truncated block read");
-        }
-    }
+// Verifies and uncompresses the n-byte block in buf, followed by its
+// trailer. Takes ownership of buf, which was allocated with new[].
+static Status DecodeBlock(const ReadOptions& options, char* buf, size_t n, Block** result,
+                          const UncompressionDict* dict) {
+    *result = nullptr;
 
     if (options.verify_checksums) {
-        const uint32_t crc = crc32c::Unmask(DecodeFixed32(buf + n + 1));
-        const uint32_t actual = crc32c::Value(buf, n + 1);
-        if (crc != actual) {
+        const uint32_t expected = DecodeFixed32(buf + n + 1);
+        const uint32_t actual = ComputeBlockChecksum(buf, n, buf[n]);
+        if (expected != actual) {
             delete[] buf;
             return Status::Corruption("block checksum mismatch");
         }
     }
 
-    switch (buf[n]) {
+    switch (BlockCompressionType(buf[n])) {
         case Options::kNoCompression:
             *result = new Block(Slice(buf, n));
             break;
@@ -298,7 +352,14 @@ static Status ReadBlockFromHandle(std::ifstream& file, std::mutex& file_mutex,
                 return Status::Corruption("bad zstd compressed block");
             }
             char* ubuf = new char[uncompressed_size];
-            size_t actual_size = ZSTD_decompress(ubuf, uncompressed_size, buf, n);
+            size_t actual_size;
+            if (dict != nullptr && dict->ddict != nullptr) {
+                actual_size = ZSTD_decompress_usingDDict(ThreadLocalDCtx(), ubuf,
+                                                         uncompressed_size, buf, n,
+                                                         dict->ddict);
+            } else {
+                actual_size = ZSTD_decompress(ubuf, uncompressed_size, buf, n);
+            }
             delete[] buf;
             if (ZSTD_isError(actual_size) || actual_size != uncompressed_size) {
                 delete[] ubuf;
@@ -306,11 +367,28 @@ static Status ReadBlockFromHandle(std::ifstream& file, std::mutex& file_mutex,
             }
             *result = new Block(Slice(ubuf, actual_size));
 #else
+            (void)dict;
             delete[] buf;
             return Status::NotSupported("zstd compression not built in");
 #endif
             break;
         }
+        case Options::kLZCompression: {
+            size_t ulength = 0;
+            if (!lz::GetUncompressedLength(buf, n, &ulength)) {
+                delete[] buf;
+                return Status::Corruption("bad lz compressed block");
+            }
+            char* ubuf = new char[ulength];
+            const bool ok = lz::Uncompress(buf, n, ubuf);
+            delete[] buf;
+            if (!ok) {
+                delete[] ubuf;
+                return Status::Corruption("bad lz compressed block");
+            }
+            *result = new Block(Slice(ubuf, ulength));
+            break;
+        }
         default:
             delete[] buf;
             return Status::Corruption("bad block type");
@@ -318,11 +396,32 @@ static Status ReadBlockFromHandle(std::ifstream& file, std::mutex& file_mutex,
     return Status::OK();
 }
 
+// ReadBlock: reads a block from the persistent file handle stored in Table::Rep.
+// Data blocks pass the table's dictionary, if it has one.
+static Status ReadBlockFromHandle(const RandomAccessFile* file,
+                                  const ReadOptions& options,
+                                  const BlockHandle& handle, Block** result,
+                                  const UncompressionDict* dict = nullptr) {
+    *result = nullptr;
+
+    const size_t n = static_cast<size_t>(handle.size());
+    char* buf = new char[n + kBlockTrailerSize];
+
+    Status s = file->Read(handle.offset(), n + kBlockTrailerSize, buf);
+    if (!s.ok()) {
+        delete[] buf;
+        return s;
+    }
+    return DecodeBlock(options, buf, n, result, dict);
+}
+
 struct Table::Rep {
     ~Rep() {
         delete filter;
         delete[] const_cast<char*>(filter_data);
         delete index_block;
+        delete compression_dict;
+        delete file_;
     }
 
     Options options;
@@ -331,49 +430,69 @@ struct Table::Rep {
     uint64_t file_size;
     
     // Persistent file handle — opened once, reused for all reads.
-    // Protected by file_mutex_ for thread-safe concurrent access.
-    std::ifstream file_;
-    std::mutex file_mutex_;
+    RandomAccessFile* file_ = nullptr;
 
     Footer footer;
     Block* index_block;
     const char* filter_data;
     size_t filter_data_size;
     BloomFilterPolicy* filter;
+    UncompressionDict* compression_dict = nullptr;
+    TableProperties properties;
+    uint64_t global_seqno = 0;
+    uint64_t global_seqno_offset = 0;
 
     BlockHandle metaindex_handle;
+
+    Cache* block_cache = nullptr;
+    CompressedSecondaryCache* secondary_cache = nullptr;
+    PersistentCache* persistent_cache = nullptr;
+    // Prefix of this table's keys in block_cache.
+    uint64_t cache_id = 0;
+    // Prefix of this table's keys in persistent_cache, the same each time
+    // the file is opened.
+    uint64_t persistent_id = 0;
+    // Set by SetCacheOwner(); 0 for a table without one.
+    uint64_t cache_owner = 0;
+    uint64_t file_number = 0;
 };
 
 Status Table::Open(const Options& options,
                    const std::string& filename,
                    uint64_t file_size,
-                   Table** table) {
+                   Table** table,
+                   Cache* block_cache,
+                   CompressedSecondaryCache* secondary_cache,
+                   PersistentCache* persistent_cache) {
     *table = nullptr;
     if (file_size < Footer::kEncodedLength) {
         return Status::Corruption("file is too short to be an sstable");
     }
 
     Rep* rep = new Table::Rep;
-    rep->file_.open(filename, std::ios::in | std::ios::binary);
-    if (!rep->file_.is_open()) {
+    rep->block_cache = block_cache;
+    rep->secondary_cache = secondary_cache;
+    rep->persistent_cache = persistent_cache;
+    if (block_cache != nullptr) {
+        rep->cache_id = block_cache->NewId();
+    }
+    Status s = NewRandomAccessFile(filename, options.use_direct_reads, &rep->file_);
+    if (!s.ok()) {
         delete rep;
-        return Status::IOError("Failed to open SSTable: ", filename);
+        return s;
     }
 
     char footer_input[Footer::kEncodedLength];
-    {
-        std::lock_guard<std::mutex> lock(rep->file_mutex_);
-        rep->file_.seekg(file_size - Footer::kEncodedLength, std::ios::beg);
-        rep->file_.read(footer_input, Footer::kEncodedLength);
-        if (rep->file_.gcount() != Footer::kEncodedLength) {
-            delete rep;
-            return Status::IOError("Failed to read footer from SSTable.");
-        }
+    s = rep->file_->Read(file_size - Footer::kEncodedLength, Footer::kEncodedLength,
+                         footer_input);
+    if (!s.ok()) {
+        delete rep;
+        return s;
     }
 
     Footer footer;
     Slice footer_input_slice(footer_input, Footer::kEncodedLength);
-    Status s = footer.DecodeFrom(&footer_input_slice);
+    s = footer.DecodeFrom(&footer_input_slice);
     if (!s.ok()) {
         delete rep;
         return s;
@@ -385,8 +504,7 @@ Status Table::Open(const Options& options,
     if (options.paranoid_checks) {
         opt.verify_checksums = true;
     }
-    s = ReadBlockFromHandle(rep->file_, rep->file_mutex_, opt,
-                            footer.index_handle(), &index_block);
+    s = ReadBlockFromHandle(rep->file_, opt, footer.index_handle(), &index_block);
 
     if (s.ok()) {
         rep->options = options;
@@ -398,6 +516,15 @@ Status Table::Open(const Options& options,
         rep->filter = nullptr;
         *table = new Table(rep);
         (*table)->ReadMeta(footer);
+        if (persistent_cache != nullptr) {
+            // File number, size, creation time and index together tell
+            // this table apart from any other the cache has seen.
+            std::string id = filename.substr(filename.find_last_of("/\\") + 1);
+            PutFixed64(&id, file_size);
+            PutFixed64(&id, rep->properties.creation_time);
+            id.append(index_block->contents().data(), index_block->contents().size());
+            rep->persistent_id = XXHash64(id.data(), id.size(), 0);
+        }
     } else {
         delete index_block;
         delete rep;
@@ -407,32 +534,145 @@ Status Table::Open(const Options& options,
 }
 
 void Table::ReadMeta(const Footer& footer) {
-    if (rep_->options.bloom_bits_per_key == 0) {
-        return;
-    }
-
     ReadOptions opt;
     if (rep_->options.paranoid_checks) {
         opt.verify_checksums = true;
     }
     Block* meta = nullptr;
-    Status s = ReadBlockFromHandle(rep_->file_, rep_->file_mutex_, opt,
-                                   footer.metaindex_handle(), &meta);
+    Status s = ReadBlockFromHandle(rep_->file_, opt, footer.metaindex_handle(), &meta);
     if (!s.ok()) {
         return;
     }
 
     std::unique_ptr<Block> meta_guard(meta);
     Iterator* iter = meta->NewIterator(BytewiseComparator());
-    std::string key = "filter.";
-    key.append(BloomFilterPolicy(0).Name());
-    iter->Seek(key);
-    if (iter->Valid() && iter->key() == Slice(key)) {
-        ReadFilter(iter->value());
+    iter->Seek(kCompressionDictMetaKey);
+    if (iter->Valid() && iter->key() == Slice(kCompressionDictMetaKey)) {
+        ReadCompressionDict(iter->value());
+    }
+    if (rep_->options.bloom_bits_per_key > 0) {
+        std::string key = "filter.";
+        key.append(BloomFilterPolicy(0).Name());
+        iter->Seek(key);
+        if (iter->Valid() && iter->key() == Slice(key)) {
+            ReadFilter(iter->value());
+        }
+    }
+    iter->Seek(kGlobalSeqnoMetaKey);
+    if (iter->Valid() && iter->key() == Slice(kGlobalSeqnoMetaKey)) {
+        ReadGlobalSeqno(iter->value());
+    }
+    iter->Seek(kPropertiesMetaKey);
+    if (iter->Valid() && iter->key() == Slice(kPropertiesMetaKey)) {
+        ReadProperties(iter->value());
     }
     delete iter;
 }
 
+void Table::ReadProperties(const Slice& properties_handle_value) {
+    Slice v = properties_handle_value;
+    BlockHandle properties_handle;
+    if (!properties_handle.DecodeFrom(&v).ok()) {
+        return;
+    }
+
+    ReadOptions opt;
+    opt.verify_checksums = true;
+    Block* block = nullptr;
+    if (!ReadBlockFromHandle(rep_->file_, opt, properties_handle, &block).ok()) {
+        return;
+    }
+    std::unique_ptr<Block> block_guard(block);
+    std::unique_ptr<Iterator> iter(block->NewIterator(BytewiseComparator()));
+    DecodeTableProperties(iter.get(), &rep_->properties);
+}
+
+const TableProperties& Table::GetTableProperties() const {
+    return rep_->properties;
+}
+
+void Table::ReadGlobalSeqno(const Slice& seqno_handle_value) {
+    Slice v = seqno_handle_value;
+    BlockHandle seqno_handle;
+    if (!seqno_handle.DecodeFrom(&v).ok() || seqno_handle.size() != 8) {
+        return;
+    }
+
+    char buf[8];
+    if (!rep_->file_->Read(seqno_handle.offset(), sizeof(buf), buf).ok()) {
+        return;
+    }
+    rep_->global_seqno = DecodeFixed64(buf);
+    rep_->global_seqno_offset = seqno_handle.offset();
+}
+
+uint64_t Table::GlobalSeqnoOffset() const {
+    return rep_->global_seqno_offset;
+}
+
+// Rewrites the sequence number of an internal key, keeping its type.
+static Slice ApplyGlobalSeqno(const Slice& key, uint64_t seqno, std::string* scratch) {
+    if (key.size() < 8) {
+        return key;
+    }
+    const ValueType type = static_cast<ValueType>(
+        static_cast<uint8_t>(key[key.size() - 8]));
+    scratch->assign(key.data(), key.size() - 8);
+    PutFixed64(scratch, PackSequenceAndType(seqno, type));
+    return Slice(*scratch);
+}
+
+// Presents the keys of an ingested table under the sequence number it was
+// assigned; the file itself stores every key with sequence 0.
+class GlobalSeqnoIterator : public Iterator {
+public:
+    GlobalSeqnoIterator(Iterator* iter, uint64_t seqno) : iter_(iter), seqno_(seqno) {}
+    ~GlobalSeqnoIterator() override { delete iter_; }
+
+    bool Valid() const override { return iter_->Valid(); }
+    void SeekToFirst() override { iter_->SeekToFirst(); Update(); }
+    void SeekToLast() override { iter_->SeekToLast(); Update(); }
+    void Seek(const Slice& target) override { iter_->Seek(target); Update(); }
+    void Next() override { iter_->Next(); Update(); }
+    void Prev() override { iter_->Prev(); Update(); }
+    Slice key() const override { return Slice(key_); }
+    Slice value() const override { return iter_->value(); }
+    Status status() const override { return iter_->status(); }
+
+private:
+    void Update() {
+        if (iter_->Valid()) {
+            ApplyGlobalSeqno(iter_->key(), seqno_, &key_);
+        }
+    }
+
+    Iterator* iter_;
+    const uint64_t seqno_;
+    std::string key_;
+};
+
+void Table::ReadCompressionDict(const Slice& dict_handle_value) {
+#ifdef LSM_HAVE_ZSTD
+    Slice v = dict_handle_value;
+    BlockHandle dict_handle;
+    if (!dict_handle.DecodeFrom(&v).ok()) {
+        return;
+    }
+
+    std::string dict(static_cast<size_t>(dict_handle.size()), '\0');
+    if (!rep_->file_->Read(dict_handle.offset(), dict.size(), &dict[0]).ok()) {
+        return;
+    }
+
+    // ZSTD_createDDict copies the dictionary, so the buffer can go.
+    UncompressionDict* d = new UncompressionDict;
+    d->ddict = ZSTD_createDDict(dict.data(), dict.size());
+    rep_->compression_dict = d;
+#else
+    (void)dict_handle_value;
+#endif
+}
+
 void Table::ReadFilter(const Slice& filter_handle_value) {
     Slice v = filter_handle_value;
     BlockHandle filter_handle;
@@ -442,16 +682,9 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
 
     size_t n = static_cast<size_t>(filter_handle.size());
     char* buf = new char[n];
-
-    {
-        std::lock_guard<std::mutex> lock(rep_->file_mutex_);
-        rep_->file_.clear();
-        rep_->file_.seekg(filter_handle.offset());
-        rep_->file_.read(buf, n);
-        if (rep_->file_.fail()) {
-            delete[] buf;
-            return;
-        }
+    if (!rep_->file_->Read(filter_handle.offset(), n, buf).ok()) {
+        delete[] buf;
+        return;
     }
 
     rep_->filter_data = buf;
@@ -463,8 +696,150 @@ Table::~Table() {
     delete rep_;
 }
 
+// First prefetch of an iterator that turns out to scan sequentially.
+static const size_t kAutoReadaheadInitialSize = 8 * 1024;
+
+// An iterator's private readahead view of the table file.
+struct Table::ReadaheadState {
+    const Table* table;
+    std::unique_ptr<RandomAccessFile> file;
+};
+
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options, const Slice& index_value) {
     Table* table = reinterpret_cast<Table*>(arg);
+    return table->BlockIterator(table->rep_->file_, options, index_value);
+}
+
+Iterator* Table::ReadaheadBlockReader(void* arg, const ReadOptions& options,
+                                      const Slice& index_value) {
+    ReadaheadState* state = reinterpret_cast<ReadaheadState*>(arg);
+    return state->table->BlockIterator(state->file.get(), options, index_value);
+}
+
+void Table::DeleteReadaheadState(void* arg) {
+    delete reinterpret_cast<ReadaheadState*>(arg);
+}
+
+// A block cache entry. Once the block cache lets go of it, the block is
+// demoted to the lower tiers, if any.
+struct CachedBlock {
+    Block* block;
+    CompressedSecondaryCache* secondary_cache;
+    PersistentCache* persistent_cache;
+    uint64_t persistent_id;
+    uint64_t owner;
+    uint64_t file_number;
+};
+
+static void PersistentCacheKey(uint64_t persistent_id, uint64_t offset, char* buf) {
+    EncodeFixed64(buf, persistent_id);
+    EncodeFixed64(buf + 8, offset);
+}
+
+static void DeleteCachedBlock(const Slice& key, void* value) {
+    CachedBlock* cached = reinterpret_cast<CachedBlock*>(value);
+    if (cached->block->size() > 0) {
+        if (cached->secondary_cache != nullptr) {
+            cached->secondary_cache->Insert(key, cached->block->contents());
+        }
+        if (cached->persistent_cache != nullptr) {
+            char buf[16];
+            PersistentCacheKey(cached->persistent_id, DecodeFixed64(key.data() + 8), buf);
+            cached->persistent_cache->Insert(Slice(buf, sizeof(buf)), cached->block->contents());
+        }
+    }
+    delete cached->block;
+    delete cached;
+}
+
+bool Table::DecodeCachedBlock(const Slice& key, void* value,
+                              void (*deleter)(const Slice& key, void* value),
+                              uint64_t* owner, uint64_t* file_number, uint64_t* offset) {
+    if (deleter != &DeleteCachedBlock || key.size() != 16) {
+        return false;
+    }
+    const CachedBlock* cached = reinterpret_cast<const CachedBlock*>(value);
+    if (cached->owner == 0) {
+        return false;
+    }
+    *owner = cached->owner;
+    *file_number = cached->file_number;
+    *offset = DecodeFixed64(key.data() + 8);
+    return true;
+}
+
+void Table::SetCacheOwner(uint64_t owner, uint64_t file_number) {
+    rep_->cache_owner = owner;
+    rep_->file_number = file_number;
+}
+
+void Table::BlockCacheKey(uint64_t offset, char* buf) const {
+    EncodeFixed64(buf, rep_->cache_id);
+    EncodeFixed64(buf + 8, offset);
+}
+
+Status Table::ReadDataBlock(const RandomAccessFile* file, const ReadOptions& options,
+                            const BlockHandle& handle, Cache::Priority priority,
+                            Block** block, Cache::Handle** cache_handle) const {
+    *cache_handle = nullptr;
+    Cache* cache = rep_->block_cache;
+    if (cache == nullptr) {
+        return ReadBlockFromHandle(file, options, handle, block, rep_->compression_dict);
+    }
+    char buf[16];
+    BlockCacheKey(handle.offset(), buf);
+    Slice key(buf, sizeof(buf));
+    if (LookupCachedBlock(options, key, priority, block, cache_handle)) {
+        return Status::OK();
+    }
+    Status s = ReadBlockFromHandle(file, options, handle, block, rep_->compression_dict);
+    if (s.ok() && options.fill_cache) {
+        *cache_handle = InsertCachedBlock(key, *block, priority);
+    }
+    return s;
+}
+
+bool Table::LookupCachedBlock(const ReadOptions& options, const Slice& key,
+                              Cache::Priority priority, Block** block,
+                              Cache::Handle** cache_handle) const {
+    Cache* cache = rep_->block_cache;
+    *cache_handle = cache->Lookup(key);
+    if (*cache_handle != nullptr) {
+        *block = reinterpret_cast<CachedBlock*>(cache->Value(*cache_handle))->block;
+        return true;
+    }
+    char* contents = nullptr;
+    size_t n = 0;
+    if (rep_->secondary_cache != nullptr && rep_->secondary_cache->Lookup(key, &contents, &n)) {
+        if (options.fill_cache) {
+            rep_->secondary_cache->Erase(key);
+        }
+    } else if (rep_->persistent_cache != nullptr) {
+        char buf[16];
+        PersistentCacheKey(rep_->persistent_id, DecodeFixed64(key.data() + 8), buf);
+        if (!rep_->persistent_cache->Lookup(Slice(buf, sizeof(buf)), &contents, &n)) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    *block = new Block(Slice(contents, n));
+    if (options.fill_cache) {
+        *cache_handle = InsertCachedBlock(key, *block, priority);
+    }
+    return true;
+}
+
+Cache::Handle* Table::InsertCachedBlock(const Slice& key, Block* block,
+                                        Cache::Priority priority) const {
+    CachedBlock* cached = new CachedBlock{block, rep_->secondary_cache, rep_->persistent_cache,
+                                          rep_->persistent_id, rep_->cache_owner,
+                                          rep_->file_number};
+    return rep_->block_cache->Insert(key, cached, block->size(), &DeleteCachedBlock, priority);
+}
+
+Iterator* Table::BlockIterator(const RandomAccessFile* file, const ReadOptions& options,
+                               const Slice& index_value) const {
     BlockHandle handle;
     Slice input = index_value;
     Status s = handle.DecodeFrom(&input);
@@ -474,14 +849,22 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options, const Slice&
     }
 
     Block* block = nullptr;
-    s = ReadBlockFromHandle(table->rep_->file_, table->rep_->file_mutex_,
-                            options, handle, &block);
+    Cache::Handle* cache_handle = nullptr;
+    s = ReadDataBlock(file, options, handle, Cache::Priority::kLow, &block, &cache_handle);
     if (s.ok()) {
-        Iterator* iter = block->NewIterator(table->rep_->options.comparator);
+        Iterator* iter = block->NewIterator(rep_->options.comparator);
         class BlockIterWrapper : public Iterator {
         public:
-            BlockIterWrapper(Iterator* i, Block* b) : iter(i), block(b) {}
-            ~BlockIterWrapper() { delete iter; delete block; }
+            BlockIterWrapper(Iterator* i, Block* b, Cache* c, Cache::Handle* h)
+                : iter(i), block(b), cache(c), handle(h) {}
+            ~BlockIterWrapper() {
+                delete iter;
+                if (handle != nullptr) {
+                    cache->Release(handle);
+                } else {
+                    delete block;
+                }
+            }
             bool Valid() const override { return iter->Valid(); }
             void SeekToFirst() override { iter->SeekToFirst(); }
             void SeekToLast() override { iter->SeekToLast(); }
@@ -494,8 +877,14 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options, const Slice&
         private:
             Iterator* iter;
             Block* block;
+            Cache* cache;
+            Cache::Handle* handle;
         };
-        return new BlockIterWrapper(iter, block);
+        Iterator* result = new BlockIterWrapper(iter, block, rep_->block_cache, cache_handle);
+        if (rep_->global_seqno != 0) {
+            result = new GlobalSeqnoIterator(result, rep_->global_seqno);
+        }
+        return result;
     }
 
     return NewErrorIterator(s);
@@ -507,16 +896,21 @@ public:
         Iterator* index_iter,
         Iterator* (*block_function)(void* arg, const ReadOptions& options, const Slice& index_value),
         void* arg,
-        const ReadOptions& options)
+        const ReadOptions& options,
+        void (*arg_cleanup)(void* arg) = nullptr)
         : index_iter_(index_iter),
           block_function_(block_function),
           arg_(arg),
+          arg_cleanup_(arg_cleanup),
           options_(options),
           data_iter_(nullptr) {}
 
     ~TwoLevelIterator() override {
         delete index_iter_;
         delete data_iter_;
+        if (arg_cleanup_ != nullptr) {
+            (*arg_cleanup_)(arg_);
+        }
     }
 
     void Seek(const Slice& target) override {
@@ -628,15 +1022,146 @@ private:
     Iterator* index_iter_;
     Iterator* (*block_function_)(void*, const ReadOptions&, const Slice&);
     void* arg_;
+    void (*arg_cleanup_)(void*);
     const ReadOptions options_;
     Iterator* data_iter_;
     std::string data_block_handle_;
     Status status_;
 };
 
-Iterator* Table::NewIterator(const ReadOptions& options) const {
-    return new TwoLevelIterator(rep_->index_block->NewIterator(rep_->options.comparator),
-                                &Table::BlockReader, const_cast<Table*>(this), options);
+Iterator* Table::NewIterator(const ReadOptions& options, bool for_compaction) const {
+    Iterator* index_iter = rep_->index_block->NewIterator(rep_->options.comparator);
+    const size_t readahead_size =
+        for_compaction ? rep_->options.compaction_readahead_size : options.readahead_size;
+    const bool auto_readahead = readahead_size == 0 && !for_compaction &&
+                                rep_->options.max_auto_readahead_size > 0;
+    if (readahead_size == 0 && !auto_readahead) {
+        return new TwoLevelIterator(index_iter, &Table::BlockReader,
+                                    const_cast<Table*>(this), options);
+    }
+    ReadaheadState* state = new ReadaheadState;
+    state->table = this;
+    if (auto_readahead) {
+        state->file.reset(NewAutoReadaheadRandomAccessFile(
+            rep_->file_, rep_->file_size, kAutoReadaheadInitialSize,
+            rep_->options.max_auto_readahead_size));
+    } else {
+        state->file.reset(NewReadaheadRandomAccessFile(rep_->file_, rep_->file_size,
+                                                       readahead_size, for_compaction));
+    }
+    return new TwoLevelIterator(index_iter, &Table::ReadaheadBlockReader, state, options,
+                                &Table::DeleteReadaheadState);
+}
+
+Status Table::WarmDataBlocks(int num_blocks) const {
+    if (rep_->block_cache == nullptr) {
+        return Status::OK();
+    }
+    std::unique_ptr<Iterator> iiter(rep_->index_block->NewIterator(rep_->options.comparator));
+    ReadOptions options;
+    Status s;
+    int n = 0;
+    for (iiter->SeekToFirst(); s.ok() && iiter->Valid() && n < num_blocks; iiter->Next(), n++) {
+        Slice handle_value = iiter->value();
+        BlockHandle handle;
+        s = handle.DecodeFrom(&handle_value);
+        Block* block = nullptr;
+        Cache::Handle* cache_handle = nullptr;
+        if (s.ok()) {
+            s = ReadDataBlock(rep_->file_, options, handle, Cache::Priority::kLow, &block,
+                              &cache_handle);
+        }
+        if (cache_handle != nullptr) {
+            rep_->block_cache->Release(cache_handle);
+        } else {
+            delete block;
+        }
+    }
+    if (s.ok()) {
+        s = iiter->status();
+    }
+    return s;
+}
+
+Status Table::LoadDataBlocks(
+    const std::vector<std::pair<uint64_t, Cache::Priority>>& blocks) const {
+    Cache* cache = rep_->block_cache;
+    if (cache == nullptr) {
+        return Status::OK();
+    }
+
+    // Handles of the blocks asked for that are not cached yet, in file order.
+    std::vector<std::pair<BlockHandle, Cache::Priority>> wanted;
+    std::unique_ptr<Iterator> iiter(rep_->index_block->NewIterator(rep_->options.comparator));
+    size_t i = 0;
+    for (iiter->SeekToFirst(); iiter->Valid() && i < blocks.size(); iiter->Next()) {
+        Slice handle_value = iiter->value();
+        BlockHandle handle;
+        Status s = handle.DecodeFrom(&handle_value);
+        if (!s.ok()) {
+            return s;
+        }
+        while (i < blocks.size() && blocks[i].first < handle.offset()) {
+            i++;
+        }
+        if (i == blocks.size() || blocks[i].first != handle.offset()) {
+            continue;
+        }
+        char buf[16];
+        BlockCacheKey(handle.offset(), buf);
+        Cache::Handle* cache_handle = cache->Lookup(Slice(buf, sizeof(buf)));
+        if (cache_handle != nullptr) {
+            cache->Release(cache_handle);
+        } else {
+            wanted.emplace_back(handle, blocks[i].second);
+        }
+        i++;
+    }
+    if (!iiter->status().ok()) {
+        return iiter->status();
+    }
+
+    // Gaps up to a block between wanted blocks are read through rather
+    // than split into another read.
+    ReadOptions options;
+    options.verify_checksums = true;
+    const uint64_t max_gap = rep_->options.block_size;
+    std::string buf;
+    size_t start = 0;
+    while (start < wanted.size()) {
+        const uint64_t begin = wanted[start].first.offset();
+        uint64_t end = begin + wanted[start].first.size() + kBlockTrailerSize;
+        size_t next = start + 1;
+        while (next < wanted.size()) {
+            const BlockHandle& h = wanted[next].first;
+            const uint64_t block_end = h.offset() + h.size() + kBlockTrailerSize;
+            if (h.offset() > end + max_gap || block_end - begin > kLoadReadSize) {
+                break;
+            }
+            end = block_end;
+            next++;
+        }
+        buf.resize(end - begin);
+        Status s = rep_->file_->Read(begin, buf.size(), &buf[0]);
+        if (!s.ok()) {
+            return s;
+        }
+        for (; start < next; start++) {
+            const BlockHandle& h = wanted[start].first;
+            const size_t n = static_cast<size_t>(h.size());
+            char* block_buf = new char[n + kBlockTrailerSize];
+            memcpy(block_buf, buf.data() + (h.offset() - begin), n + kBlockTrailerSize);
+            Block* block = nullptr;
+            s = DecodeBlock(options, block_buf, n, &block, rep_->compression_dict);
+            if (!s.ok()) {
+                return s;
+            }
+            char key[16];
+            BlockCacheKey(h.offset(), key);
+            cache->Release(InsertCachedBlock(Slice(key, sizeof(key)), block, wanted[start].second));
+        }
+    }
+    return Status::OK();
 }
 
 Iterator* NewTwoLevelIterator(Iterator* index_iter,
@@ -660,20 +1185,161 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
             }
         }
 
-        Iterator* block_iter = BlockReader(this, options, handle_value);
+        BlockHandle handle;
+        Block* block = nullptr;
+        Cache::Handle* cache_handle = nullptr;
+        s = handle.DecodeFrom(&handle_value);
+        if (s.ok()) {
+            s = ReadDataBlock(rep_->file_, options, handle, Cache::Priority::kHigh, &block,
+                              &cache_handle);
+        }
+        if (s.ok()) {
+            s = SearchBlock(block, k, arg, handle_result);
+            if (cache_handle != nullptr) {
+                rep_->block_cache->Release(cache_handle);
+            } else {
+                delete block;
+            }
+        }
+    }
+    if (s.ok()) {
+        s = iiter->status();
+    }
+    return s;
+}
+
+Status Table::SearchBlock(Block* block, const Slice& k, void* arg,
+                          void (*handle_result)(void*, const Slice&, const Slice&)) const {
+    Status s;
+    std::string scratch;
+    const uint8_t restart = block->HashIndexLookup(k);
+    if (restart == kBlockHashIndexNoEntry) {
+        // The hash index proves the user key is absent from this block.
+    } else if (restart == kBlockHashIndexCollision) {
+        Iterator* block_iter = block->NewIterator(rep_->options.comparator);
         block_iter->Seek(k);
         if (block_iter->Valid()) {
-            (*handle_result)(arg, block_iter->key(), block_iter->value());
+            Slice key = block_iter->key();
+            if (rep_->global_seqno != 0) {
+                key = ApplyGlobalSeqno(key, rep_->global_seqno, &scratch);
+            }
+            (*handle_result)(arg, key, block_iter->value());
         }
         s = block_iter->status();
         delete block_iter;
-    }
-    if (s.ok()) {
-        s = iiter->status();
+    } else {
+        BlockIter block_iter(rep_->options.comparator, block->data_,
+                             block->restart_offset_, block->NumRestarts());
+        block_iter.SeekFromRestartPoint(restart, k);
+        if (block_iter.Valid()) {
+            Slice key = block_iter.key();
+            if (rep_->global_seqno != 0) {
+                key = ApplyGlobalSeqno(key, rep_->global_seqno, &scratch);
+            }
+            (*handle_result)(arg, key, block_iter.value());
+        }
+        s = block_iter.status();
     }
     return s;
 }
 
+void Table::InternalMultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                             void* const* args,
+                             void (*handle_result)(void*, const Slice&, const Slice&),
+                             Status* statuses) {
+    struct BlockRead {
+        BlockHandle handle;
+        std::vector<size_t> keys;
+        Block* block = nullptr;
+        Cache::Handle* cache_handle = nullptr;
+        Status status;
+    };
+
+    // Route each key to its data block. Sorted keys that share a block are
+    // adjacent; keys the filter rules out need no block at all.
+    std::vector<BlockRead> reads;
+    std::unique_ptr<Iterator> iiter(rep_->index_block->NewIterator(rep_->options.comparator));
+    for (size_t i = 0; i < keys.size(); i++) {
+        const Slice& k = keys[i];
+        statuses[i] = Status::OK();
+        iiter->Seek(k);
+        if (!iiter->Valid()) {
+            statuses[i] = iiter->status();
+            continue;
+        }
+        if (rep_->filter != nullptr) {
+            Slice filter_key = (k.size() >= 8) ? InternalKey::ExtractUserKey(k) : k;
+            if (!rep_->filter->KeyMayMatch(filter_key, Slice(rep_->filter_data, rep_->filter_data_size))) {
+                continue;
+            }
+        }
+        Slice handle_value = iiter->value();
+        BlockHandle handle;
+        statuses[i] = handle.DecodeFrom(&handle_value);
+        if (!statuses[i].ok()) {
+            continue;
+        }
+        if (reads.empty() || reads.back().handle.offset() != handle.offset()) {
+            reads.emplace_back();
+            reads.back().handle = handle;
+        }
+        reads.back().keys.push_back(i);
+    }
+
+    // Submit every block the cache does not hold at once.
+    Cache* cache = rep_->block_cache;
+    std::vector<ReadRequest> requests;
+    std::vector<BlockRead*> misses;
+    for (BlockRead& r : reads) {
+        if (cache != nullptr) {
+            char buf[16];
+            BlockCacheKey(r.handle.offset(), buf);
+            if (LookupCachedBlock(options, Slice(buf, sizeof(buf)), Cache::Priority::kHigh,
+                                  &r.block, &r.cache_handle)) {
+                continue;
+            }
+        }
+        ReadRequest req;
+        req.offset = r.handle.offset();
+        req.len = static_cast<size_t>(r.handle.size()) + kBlockTrailerSize;
+        req.scratch = new char[req.len];
+        requests.push_back(req);
+        misses.push_back(&r);
+    }
+    if (!requests.empty()) {
+        rep_->file_->MultiRead(&requests[0], requests.size());
+    }
+    for (size_t m = 0; m < misses.size(); m++) {
+        BlockRead* r = misses[m];
+        r->status = requests[m].status;
+        if (!r->status.ok()) {
+            delete[] requests[m].scratch;
+            continue;
+        }
+        r->status = DecodeBlock(options, requests[m].scratch,
+                                static_cast<size_t>(r->handle.size()), &r->block,
+                                rep_->compression_dict);
+        if (r->status.ok() && cache != nullptr && options.fill_cache) {
+            char buf[16];
+            BlockCacheKey(r->handle.offset(), buf);
+            r->cache_handle = InsertCachedBlock(Slice(buf, sizeof(buf)), r->block,
+                                                Cache::Priority::kHigh);
+        }
+    }
+
+    for (BlockRead& r : reads) {
+        for (size_t i : r.keys) {
+            statuses[i] = r.status.ok() ? SearchBlock(r.block, keys[i], args[i], handle_result)
+                                        : r.status;
+        }
+        if (r.cache_handle != nullptr) {
+            cache->Release(r.cache_handle);
+        } else {
+            delete r.block;
+        }
+    }
+}
+
 bool Table::MayContain(const Slice& user_key) const {
     if (rep_->filter == nullptr) {
         return true;
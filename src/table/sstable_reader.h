@@ -3,54 +3,143 @@
 #include <cstdint>
 #include <string>
 #include <memory>
+#include <vector>
 #include "lsm/options.h"
 #include "lsm/status.h"
 #include "lsm/iterator.h"
+#include "lsm/table_properties.h"
+#include "lsm/cache.h"
 
 namespace lsm {
 
 class Block;
 class BlockHandle;
 class Footer;
+class RandomAccessFile;
+class CompressedSecondaryCache;
+class PersistentCache;
 
 // Immutable persistent sorted map. Thread-safe.
 class Table {
 public:
     // Opens table from file. On success sets *table (caller must delete).
-    // Returns non-ok status and nullptr on failure. *file must outlive Table.
+    // Returns non-ok status and nullptr on failure. With a block_cache, which
+    // must outlive the table, data blocks are read through it: point lookups
+    // insert them at Cache::Priority::kHigh, iterators at kLow. With a
+    // secondary_cache or persistent_cache as well, blocks evicted from
+    // block_cache are demoted to them, and a block_cache miss checks them,
+    // in that order, before reading the file. persistent_cache keys are
+    // derived from the file's name and contents, so they stay valid when
+    // the table is reopened by a later process.
     static Status Open(const Options& options,
                        const std::string& filename,
                        uint64_t file_size,
-                       Table** table);
+                       Table** table,
+                       Cache* block_cache = nullptr,
+                       CompressedSecondaryCache* secondary_cache = nullptr,
+                       PersistentCache* persistent_cache = nullptr);
 
     Table(const Table&) = delete;
     Table& operator=(const Table&) = delete;
 
     ~Table();
 
-    // Returns a new iterator. Must Seek before use.
-    Iterator* NewIterator(const ReadOptions& options) const;
+    // Returns a new iterator. Must Seek before use. With
+    // options.readahead_size, or for_compaction, the iterator reads the file
+    // in windows of that many bytes (Options::compaction_readahead_size for
+    // compactions) instead of block by block. A compaction iterator also
+    // hints the OS to read ahead and to drop the pages it has passed.
+    Iterator* NewIterator(const ReadOptions& options, bool for_compaction = false) const;
 
     bool MayContain(const Slice& user_key) const;
 
+    // Reads the first num_blocks data blocks into the block cache, if the
+    // table has one, at Cache::Priority::kLow.
+    Status WarmDataBlocks(int num_blocks) const;
+
+    // Reads the data blocks at the given offsets, ascending, into the block
+    // cache at the given priorities, merging neighbouring blocks into reads
+    // of up to kLoadReadSize bytes. Offsets that start no data block of
+    // this table, and blocks already cached, are skipped.
+    Status LoadDataBlocks(const std::vector<std::pair<uint64_t, Cache::Priority>>& blocks) const;
+
+    // If value, with its key and deleter, is a data block cached by a table
+    // given a cache owner, sets what that table's block is and returns true.
+    static bool DecodeCachedBlock(const Slice& key, void* value,
+                                  void (*deleter)(const Slice& key, void* value),
+                                  uint64_t* owner, uint64_t* file_number, uint64_t* offset);
+
     // Approximate file byte offset of the data for key.
     uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+    // Properties recorded when the table was written. All zero for tables
+    // written before the properties block existed.
+    const TableProperties& GetTableProperties() const;
+
+    // File offset of the global sequence number block of a table written by
+    // SstFileWriter, or 0 if the table has none.
+    uint64_t GlobalSeqnoOffset() const;
+
 private:
+    static const size_t kLoadReadSize = 1 << 20;
+
     struct Rep;
     Rep* rep_;
 
     explicit Table(Rep* rep) : rep_(rep) {}
 
+    // Tags this table's blocks in the block cache with owner and file
+    // number, so that DecodeCachedBlock() can tell them apart.
+    void SetCacheOwner(uint64_t owner, uint64_t file_number);
+
+    struct ReadaheadState;
+
     static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+    static Iterator* ReadaheadBlockReader(void*, const ReadOptions&, const Slice&);
+    static void DeleteReadaheadState(void*);
+    Iterator* BlockIterator(const RandomAccessFile* file, const ReadOptions& options,
+                            const Slice& index_value) const;
+
+    // Reads a data block through the block cache. On success *block belongs
+    // to *cache_handle if that is set (Release() it when done) and to the
+    // caller otherwise.
+    Status ReadDataBlock(const RandomAccessFile* file, const ReadOptions& options,
+                         const BlockHandle& handle, Cache::Priority priority,
+                         Block** block, Cache::Handle** cache_handle) const;
+    void BlockCacheKey(uint64_t offset, char* buf) const;
+    // Looks key up in the block cache, then in the secondary and persistent
+    // caches, whose hits are promoted back into the block cache (or, without
+    // fill_cache, handed to the caller uncached). *block is owned as by
+    // ReadDataBlock().
+    bool LookupCachedBlock(const ReadOptions& options, const Slice& key,
+                           Cache::Priority priority, Block** block,
+                           Cache::Handle** cache_handle) const;
+    Cache::Handle* InsertCachedBlock(const Slice& key, Block* block,
+                                     Cache::Priority priority) const;
     
     friend class TableCache;
     Status InternalGet(const ReadOptions&, const Slice& key,
                        void* arg,
                        void (*handle_result)(void* arg, const Slice& k, const Slice& v));
 
+    // InternalGet() for keys in ascending order. The entry found for keys[i]
+    // goes to handle_result(args[i], ...) and its status to statuses[i].
+    // Keys in the same data block share one read, and the distinct blocks
+    // are read as one RandomAccessFile::MultiRead() batch.
+    void InternalMultiGet(const ReadOptions&, const std::vector<Slice>& keys,
+                          void* const* args,
+                          void (*handle_result)(void* arg, const Slice& k, const Slice& v),
+                          Status* statuses);
+
+    // Passes the first entry of block at or after k to handle_result.
+    Status SearchBlock(Block* block, const Slice& k, void* arg,
+                       void (*handle_result)(void* arg, const Slice& k, const Slice& v)) const;
+
     void ReadMeta(const Footer& footer);
     void ReadFilter(const Slice& filter_handle_value);
+    void ReadCompressionDict(const Slice& dict_handle_value);
+    void ReadProperties(const Slice& properties_handle_value);
+    void ReadGlobalSeqno(const Slice& seqno_handle_value);
 };
 
 Iterator* NewTwoLevelIterator(Iterator* index_iter,
@@ -1,4 +1,5 @@
 #include "src/table/table_cache.h"
+#include "src/db/memtable.h"
 #include "src/util/coding.h"
 #include "lsm/db.h"
 #include <memory>
@@ -29,11 +30,47 @@ static void UnrefEntry(void* arg1, void* arg2) {
 TableCache::TableCache(const std::string& dbname, const Options* options, int entries)
     : dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {
+      cache_(NewLRUCache(entries)),
+      block_cache_(options->block_cache),
+      secondary_cache_(nullptr),
+      persistent_cache_(nullptr),
+      block_cache_owner_(0),
+      row_cache_(options->row_cache_capacity > 0 ? NewLRUCache(options->row_cache_capacity)
+                                                 : nullptr) {
+    if (block_cache_ == nullptr && options->block_cache_capacity > 0) {
+        if (options->block_cache_type == Options::kClockBlockCache) {
+            block_cache_.reset(NewClockCache(options->block_cache_capacity, options->block_size));
+        } else {
+            block_cache_.reset(NewLRUCache(options->block_cache_capacity,
+                                           options->block_cache_high_pri_pool_ratio));
+        }
+        if (options->compressed_secondary_cache_capacity > 0) {
+            secondary_cache_ =
+                new CompressedSecondaryCache(options->compressed_secondary_cache_capacity);
+        }
+        if (!options->persistent_cache_path.empty()) {
+            status_ = PersistentCache::Open(options->persistent_cache_path,
+                                            options->persistent_cache_capacity,
+                                            &persistent_cache_);
+        }
+    }
+    if (block_cache_ != nullptr) {
+        block_cache_owner_ = block_cache_->NewId();
+    }
 }
 
 TableCache::~TableCache() {
     delete cache_;
+    delete row_cache_;
+    if (secondary_cache_ != nullptr) {
+        secondary_cache_->Close();
+    }
+    // Blocks still in the block cache spill to the persistent tier, which
+    // then saves its index, so a restart finds them. A shared block cache
+    // lives on; its blocks from here have no tiers to spill to.
+    block_cache_.reset();
+    delete secondary_cache_;
+    delete persistent_cache_;
 }
 
 static std::string TableFileName(const std::string& dbname, uint64_t number) {
@@ -52,8 +89,10 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size, Cache::Ha
     if (*handle == nullptr) {
         std::string fname = TableFileName(dbname_, file_number);
         Table* raw_table = nullptr;
-        s = Table::Open(*options_, fname, file_size, &raw_table);
+        s = Table::Open(*options_, fname, file_size, &raw_table, block_cache_.get(),
+                        secondary_cache_, persistent_cache_);
         if (s.ok()) {
+            raw_table->SetCacheOwner(block_cache_owner_, file_number);
             TableAndFile* tf = new TableAndFile;
             tf->table.reset(raw_table);
             *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
@@ -62,53 +101,105 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size, Cache::Ha
     return s;
 }
 
+Status TableCache::GetTable(uint64_t file_number, uint64_t file_size, Table* pinned,
+                            Table** table, Cache::Handle** handle) {
+    *handle = nullptr;
+    if (pinned != nullptr) {
+        *table = pinned;
+        return Status::OK();
+    }
+    Status s = FindTable(file_number, file_size, handle);
+    if (s.ok()) {
+        *table = reinterpret_cast<TableAndFile*>(cache_->Value(*handle))->table.get();
+    }
+    return s;
+}
+
+Status TableCache::OpenTable(uint64_t file_number, uint64_t file_size,
+                             std::shared_ptr<Table>* table) {
+    Table* raw_table = nullptr;
+    Status s = Table::Open(*options_, TableFileName(dbname_, file_number), file_size,
+                           &raw_table, block_cache_.get(), secondary_cache_, persistent_cache_);
+    if (s.ok()) {
+        raw_table->SetCacheOwner(block_cache_owner_, file_number);
+        table->reset(raw_table);
+    }
+    return s;
+}
+
 static Iterator* GetTableIterator(void* table, const ReadOptions& options) {
     return reinterpret_cast<Table*>(table)->NewIterator(options);
 }
 
+// Keeps the iterated Table alive, and its cache entry pinned if it has one.
+class TableCacheIteratorWrapper : public Iterator {
+public:
+    TableCacheIteratorWrapper(Iterator* iter, Cache* cache, Cache::Handle* handle,
+                              std::shared_ptr<Table> table_ref)
+        : iter_(iter), cache_(cache), handle_(handle), table_ref_(std::move(table_ref)) {}
+    ~TableCacheIteratorWrapper() override {
+        delete iter_;
+        if (handle_ != nullptr) {
+            cache_->Release(handle_);
+        }
+    }
+    bool Valid() const override { return iter_->Valid(); }
+    void SeekToFirst() override { iter_->SeekToFirst(); }
+    void SeekToLast() override { iter_->SeekToLast(); }
+    void Seek(const Slice& target) override { iter_->Seek(target); }
+    void Next() override { iter_->Next(); }
+    void Prev() override { iter_->Prev(); }
+    Slice key() const override { return iter_->key(); }
+    Slice value() const override { return iter_->value(); }
+    Status status() const override { return iter_->status(); }
+private:
+    Iterator* iter_;
+    Cache* cache_;
+    Cache::Handle* handle_;
+    std::shared_ptr<Table> table_ref_;
+};
+
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number,
                                   uint64_t file_size,
-                                  Table** tableptr) {
+                                  Table** tableptr,
+                                  bool for_compaction,
+                                  std::shared_ptr<Table> pinned) {
     if (tableptr != nullptr) {
         *tableptr = nullptr;
     }
 
+    if (for_compaction && options_->use_direct_io_for_flush_and_compaction &&
+        !options_->use_direct_reads) {
+        Options direct_options = *options_;
+        direct_options.use_direct_reads = true;
+        Table* raw_table = nullptr;
+        Status s = Table::Open(direct_options, TableFileName(dbname_, file_number),
+                               file_size, &raw_table);
+        if (!s.ok()) {
+            return NewErrorIterator(s);
+        }
+        std::shared_ptr<Table> table_ref(raw_table);
+        if (tableptr != nullptr) {
+            *tableptr = raw_table;
+        }
+        return new TableCacheIteratorWrapper(raw_table->NewIterator(options, true), cache_,
+                                             nullptr, std::move(table_ref));
+    }
+
     Cache::Handle* handle = nullptr;
-    Status s = FindTable(file_number, file_size, &handle);
-    if (!s.ok()) {
-        return NewErrorIterator(s);
+    std::shared_ptr<Table> table_ref = std::move(pinned);
+    if (table_ref == nullptr) {
+        Status s = FindTable(file_number, file_size, &handle);
+        if (!s.ok()) {
+            return NewErrorIterator(s);
+        }
+        table_ref = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
     }
 
-    Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table.get();
-    std::shared_ptr<Table> table_ref = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    Iterator* result = table->NewIterator(options);
+    Table* table = table_ref.get();
+    Iterator* result = table->NewIterator(options, for_compaction);
 
-    class TableCacheIteratorWrapper : public Iterator {
-    public:
-        TableCacheIteratorWrapper(Iterator* iter, Cache* cache, Cache::Handle* handle,
-                                  std::shared_ptr<Table> table_ref)
-            : iter_(iter), cache_(cache), handle_(handle), table_ref_(std::move(table_ref)) {}
-        ~TableCacheIteratorWrapper() override {
-            delete iter_;
-            cache_->Release(handle_);
-        }
-        bool Valid() const override { return iter_->Valid(); }
-        void SeekToFirst() override { iter_->SeekToFirst(); }
-        void SeekToLast() override { iter_->SeekToLast(); }
-        void Seek(const Slice& target) override { iter_->Seek(target); }
-        void Next() override { iter_->Next(); }
-        void Prev() override { iter_->Prev(); }
-        Slice key() const override { return iter_->key(); }
-        Slice value() const override { return iter_->value(); }
-        Status status() const override { return iter_->status(); }
-    private:
-        Iterator* iter_;
-        Cache* cache_;
-        Cache::Handle* handle_;
-        std::shared_ptr<Table> table_ref_;
-    };
-    
     Iterator* wrapped = new TableCacheIteratorWrapper(result, cache_, handle, table_ref);
     
     if (tableptr != nullptr) {
@@ -117,22 +208,166 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
     return wrapped;
 }
 
+// A row is the table entry a lookup found for its user key: the
+// length-prefixed internal key (carrying the value type) then the value.
+static std::string RowCacheKey(uint64_t file_number, const Slice& internal_key) {
+    std::string key;
+    PutFixed64(&key, file_number);
+    Slice user_key = InternalKey::ExtractUserKey(internal_key);
+    key.append(user_key.data(), user_key.size());
+    return key;
+}
+
+static void DeleteRow(const Slice& /*key*/, void* value) {
+    delete reinterpret_cast<std::string*>(value);
+}
+
+namespace {
+// Forwards a table's lookup result and keeps a copy of it as a row if it
+// is an entry for the user key looked up.
+struct RowSaver {
+    Slice user_key;
+    void* arg;
+    void (*handle_result)(void*, const Slice&, const Slice&);
+    bool found = false;
+    std::string row;
+};
+}
+
+static void SaveRow(void* arg, const Slice& ikey, const Slice& v) {
+    RowSaver* saver = reinterpret_cast<RowSaver*>(arg);
+    if (ikey.size() >= 8 && InternalKey::ExtractUserKey(ikey) == saver->user_key) {
+        saver->found = true;
+        saver->row.clear();
+        PutLengthPrefixedSlice(&saver->row, ikey);
+        saver->row.append(v.data(), v.size());
+    }
+    (*saver->handle_result)(saver->arg, ikey, v);
+}
+
+bool TableCache::LookupRow(const Slice& row_key, void* arg,
+                           void (*handle_result)(void*, const Slice&, const Slice&)) {
+    Cache::Handle* handle = row_cache_->Lookup(row_key);
+    if (handle == nullptr) {
+        return false;
+    }
+    Slice row(*reinterpret_cast<std::string*>(row_cache_->Value(handle)));
+    Slice ikey;
+    if (GetLengthPrefixedSlice(&row, &ikey)) {
+        (*handle_result)(arg, ikey, row);
+    }
+    row_cache_->Release(handle);
+    return true;
+}
+
+void TableCache::InsertRow(const Slice& row_key, const std::string& row) {
+    std::string* value = new std::string(row);
+    row_cache_->Release(row_cache_->Insert(row_key, value, row_key.size() + row.size(),
+                                           &DeleteRow));
+}
+
 Status TableCache::Get(const ReadOptions& options,
                        uint64_t file_number,
                        uint64_t file_size,
                        const Slice& k,
                        void* arg,
-                       void (*handle_result)(void*, const Slice&, const Slice&)) {
+                       void (*handle_result)(void*, const Slice&, const Slice&),
+                       Table* pinned) {
+    std::string row_key;
+    if (row_cache_ != nullptr) {
+        row_key = RowCacheKey(file_number, k);
+        if (LookupRow(row_key, arg, handle_result)) {
+            return Status::OK();
+        }
+    }
+
+    Table* t = nullptr;
     Cache::Handle* handle = nullptr;
-    Status s = FindTable(file_number, file_size, &handle);
+    Status s = GetTable(file_number, file_size, pinned, &t, &handle);
     if (s.ok()) {
-        Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table.get();
-        s = t->InternalGet(options, k, arg, handle_result);
-        cache_->Release(handle);
+        if (row_cache_ == nullptr) {
+            s = t->InternalGet(options, k, arg, handle_result);
+        } else {
+            RowSaver saver;
+            saver.user_key = InternalKey::ExtractUserKey(k);
+            saver.arg = arg;
+            saver.handle_result = handle_result;
+            s = t->InternalGet(options, k, &saver, SaveRow);
+            if (s.ok() && saver.found && options.fill_cache) {
+                InsertRow(row_key, saver.row);
+            }
+        }
+        if (handle != nullptr) {
+            cache_->Release(handle);
+        }
     }
     return s;
 }
 
+void TableCache::MultiGet(const ReadOptions& options,
+                          uint64_t file_number,
+                          uint64_t file_size,
+                          const std::vector<Slice>& keys,
+                          void* const* args,
+                          void (*handle_result)(void*, const Slice&, const Slice&),
+                          Status* statuses,
+                          Table* pinned) {
+    // Only the keys the row cache misses go to the table.
+    std::vector<size_t> misses;
+    std::vector<std::string> row_keys;
+    for (size_t i = 0; i < keys.size(); i++) {
+        statuses[i] = Status::OK();
+        if (row_cache_ != nullptr) {
+            row_keys.push_back(RowCacheKey(file_number, keys[i]));
+            if (LookupRow(row_keys.back(), args[i], handle_result)) {
+                continue;
+            }
+        }
+        misses.push_back(i);
+    }
+    if (misses.empty()) {
+        return;
+    }
+
+    Table* t = nullptr;
+    Cache::Handle* handle = nullptr;
+    Status s = GetTable(file_number, file_size, pinned, &t, &handle);
+    if (!s.ok()) {
+        for (size_t i : misses) {
+            statuses[i] = s;
+        }
+        return;
+    }
+    if (row_cache_ == nullptr) {
+        t->InternalMultiGet(options, keys, args, handle_result, statuses);
+    } else {
+        std::vector<Slice> miss_keys;
+        std::vector<RowSaver> savers(misses.size());
+        std::vector<void*> saver_args;
+        std::vector<Status> miss_statuses(misses.size());
+        for (size_t j = 0; j < misses.size(); j++) {
+            const size_t i = misses[j];
+            miss_keys.push_back(keys[i]);
+            savers[j].user_key = InternalKey::ExtractUserKey(keys[i]);
+            savers[j].arg = args[i];
+            savers[j].handle_result = handle_result;
+            saver_args.push_back(&savers[j]);
+        }
+        t->InternalMultiGet(options, miss_keys, saver_args.data(), SaveRow,
+                            miss_statuses.data());
+        for (size_t j = 0; j < misses.size(); j++) {
+            const size_t i = misses[j];
+            statuses[i] = miss_statuses[j];
+            if (statuses[i].ok() && savers[j].found && options.fill_cache) {
+                InsertRow(row_keys[i], savers[j].row);
+            }
+        }
+    }
+    if (handle != nullptr) {
+        cache_->Release(handle);
+    }
+}
+
 void TableCache::Evict(uint64_t file_number) {
     char buf[sizeof(file_number)];
     EncodeFixed64(buf, file_number);
@@ -140,16 +375,77 @@ void TableCache::Evict(uint64_t file_number) {
 }
 
 bool TableCache::MayContain(uint64_t file_number, uint64_t file_size,
-                            const Slice& user_key) {
+                            const Slice& user_key, Table* pinned) {
+    Table* t = nullptr;
     Cache::Handle* handle = nullptr;
-    Status s = FindTable(file_number, file_size, &handle);
+    Status s = GetTable(file_number, file_size, pinned, &t, &handle);
     if (!s.ok()) {
         return true;
     }
-    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table.get();
     bool result = t->MayContain(user_key);
-    cache_->Release(handle);
+    if (handle != nullptr) {
+        cache_->Release(handle);
+    }
     return result;
 }
 
+Status TableCache::Warm(uint64_t file_number, uint64_t file_size, int data_blocks,
+                        Table* pinned) {
+    Table* t = nullptr;
+    Cache::Handle* handle = nullptr;
+    Status s = GetTable(file_number, file_size, pinned, &t, &handle);
+    if (s.ok() && data_blocks > 0) {
+        s = t->WarmDataBlocks(data_blocks);
+    }
+    if (handle != nullptr) {
+        cache_->Release(handle);
+    }
+    return s;
+}
+
+void TableCache::ListCachedBlocks(std::vector<CachedBlockRef>* blocks) {
+    if (block_cache_ == nullptr) {
+        return;
+    }
+    block_cache_->ApplyToAllEntries([&](const Slice& key, void* value, size_t /*charge*/,
+                                        void (*deleter)(const Slice&, void*),
+                                        Cache::Priority priority) {
+        uint64_t owner, file_number, offset;
+        if (Table::DecodeCachedBlock(key, value, deleter, &owner, &file_number, &offset) &&
+            owner == block_cache_owner_) {
+            blocks->push_back(CachedBlockRef{file_number, offset, priority});
+        }
+    });
+}
+
+Status TableCache::LoadCachedBlocks(uint64_t file_number, uint64_t file_size,
+                                    const std::vector<CachedBlockRef>& blocks, Table* pinned) {
+    std::vector<std::pair<uint64_t, Cache::Priority>> offsets;
+    for (const CachedBlockRef& b : blocks) {
+        offsets.emplace_back(b.offset, b.priority);
+    }
+    Table* t = nullptr;
+    Cache::Handle* handle = nullptr;
+    Status s = GetTable(file_number, file_size, pinned, &t, &handle);
+    if (s.ok()) {
+        s = t->LoadDataBlocks(offsets);
+    }
+    if (handle != nullptr) {
+        cache_->Release(handle);
+    }
+    return s;
+}
+
+Status TableCache::GetTableProperties(uint64_t file_number, uint64_t file_size,
+                                      TableProperties* props) {
+    Cache::Handle* handle = nullptr;
+    Status s = FindTable(file_number, file_size, &handle);
+    if (s.ok()) {
+        Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table.get();
+        *props = t->GetTableProperties();
+        cache_->Release(handle);
+    }
+    return s;
+}
+
 }
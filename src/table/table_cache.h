@@ -1,14 +1,25 @@
 #pragma once
 
+#include <memory>
 #include <string>
+#include <vector>
 #include <stdint.h>
 #include "lsm/db.h"
-#include "src/util/cache.h"
+#include "lsm/cache.h"
+#include "src/util/persistent_cache.h"
+#include "src/util/secondary_cache.h"
 #include "lsm/options.h"
 #include "src/table/sstable_reader.h"
 
 namespace lsm {
 
+// A data block in the block cache, as DumpBlockCache() lists it.
+struct CachedBlockRef {
+    uint64_t file_number;
+    uint64_t offset;
+    Cache::Priority priority;
+};
+
 class TableCache {
 public:
     TableCache(const std::string& dbname, const Options* options, int entries);
@@ -17,31 +28,104 @@ public:
     TableCache(const TableCache&) = delete;
     TableCache& operator=(const TableCache&) = delete;
 
+    // OK unless a cache tier the options ask for could not be opened.
+    Status status() const { return status_; }
+
+    // The lookups below take the file's Table as pinned when the caller
+    // keeps it open itself (FileMetaData::table), and then skip this cache.
+
     // Returns iterator for file. If tableptr is non-null, sets *tableptr
-    // to the underlying Table (cache-owned, valid as long as iterator is live).
+    // to the underlying Table (valid as long as iterator is live).
+    // for_compaction marks a one-pass read of a compaction input, which
+    // reads ahead by Options::compaction_readahead_size. With
+    // use_direct_io_for_flush_and_compaction it gets a private direct-I/O
+    // Table that bypasses both this cache and the OS page cache.
     Iterator* NewIterator(const ReadOptions& options,
                           uint64_t file_number,
                           uint64_t file_size,
-                          Table** tableptr = nullptr);
+                          Table** tableptr = nullptr,
+                          bool for_compaction = false,
+                          std::shared_ptr<Table> pinned = nullptr);
 
     Status Get(const ReadOptions& options,
                uint64_t file_number,
                uint64_t file_size,
                const Slice& k,
                void* arg,
-               void (*handle_result)(void*, const Slice&, const Slice&));
+               void (*handle_result)(void*, const Slice&, const Slice&),
+               Table* pinned = nullptr);
+
+    // Get() for keys in ascending order, with the result for keys[i] passed
+    // to handle_result(args[i], ...) and its status stored in statuses[i].
+    void MultiGet(const ReadOptions& options,
+                  uint64_t file_number,
+                  uint64_t file_size,
+                  const std::vector<Slice>& keys,
+                  void* const* args,
+                  void (*handle_result)(void*, const Slice&, const Slice&),
+                  Status* statuses,
+                  Table* pinned = nullptr);
 
     void Evict(uint64_t file_number);
 
     bool MayContain(uint64_t file_number, uint64_t file_size,
-                    const Slice& user_key);
+                    const Slice& user_key, Table* pinned = nullptr);
+
+    Status GetTableProperties(uint64_t file_number, uint64_t file_size,
+                              TableProperties* props);
+
+    // Opens the table into this cache, unless it is pinned, and reads its
+    // first data_blocks data blocks into the block cache.
+    Status Warm(uint64_t file_number, uint64_t file_size, int data_blocks,
+                Table* pinned = nullptr);
+
+    // Appends every data block of a table opened here that the block cache
+    // holds.
+    void ListCachedBlocks(std::vector<CachedBlockRef>* blocks);
+
+    // Reads the blocks of the file, in ascending offset order, into the
+    // block cache; see Table::LoadDataBlocks().
+    Status LoadCachedBlocks(uint64_t file_number, uint64_t file_size,
+                            const std::vector<CachedBlockRef>& blocks,
+                            Table* pinned = nullptr);
+
+    // Opens the table for a caller that keeps it open, bypassing this cache
+    // but sharing its block cache tiers.
+    Status OpenTable(uint64_t file_number, uint64_t file_size, std::shared_ptr<Table>* table);
 
 private:
     Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle** handle);
+    // Sets *table to pinned if set, else to the cached table, whose *handle
+    // the caller releases if it is non-null.
+    Status GetTable(uint64_t file_number, uint64_t file_size, Table* pinned,
+                    Table** table, Cache::Handle** handle);
+
+    // Passes the row cached for row_key to handle_result. False on a miss.
+    bool LookupRow(const Slice& row_key, void* arg,
+                   void (*handle_result)(void*, const Slice&, const Slice&));
+    void InsertRow(const Slice& row_key, const std::string& row);
 
     const std::string dbname_;
     const Options* const options_;
     Cache* cache_;
+    // Data blocks of every table opened here: Options::block_cache, or one
+    // of Options::block_cache_capacity, or nullptr without either.
+    std::shared_ptr<Cache> block_cache_;
+    // Compressed blocks evicted from block_cache_, or nullptr without
+    // Options::compressed_secondary_cache_capacity.
+    CompressedSecondaryCache* secondary_cache_;
+    // Blocks evicted from block_cache_, on local disk, or nullptr without
+    // Options::persistent_cache_path.
+    PersistentCache* persistent_cache_;
+    Status status_;
+    // Tags the blocks of tables opened here in block_cache_, which may be
+    // shared with other DBs.
+    uint64_t block_cache_owner_;
+    // Entries found by point lookups, or nullptr without
+    // Options::row_cache_capacity. Every lookup reads at the latest
+    // sequence number and tables are immutable, so a row never goes stale;
+    // rows of deleted tables age out.
+    Cache* row_cache_;
 };
 
 }
@@ -1,4 +1,4 @@
-#include "src/util/cache.h"
+#include "lsm/cache.h"
 #include <cassert>
 #include <mutex>
 #include <unordered_map>
@@ -26,6 +26,14 @@ namespace {
 // Elements are moved between these lists by the Ref() and Unref() methods,
 // when they detect an element in the cache acquiring or losing its only
 // external reference.
+//
+// The LRU list is split into two pools. The newest part, up to
+// high_pri_pool_ratio of the capacity, holds high-priority entries and
+// entries that were looked up again after insertion; everything else enters
+// at the midpoint (lru_low_pri_), so a long scan of low-priority entries
+// only cycles through the older part and cannot push out the hot set. When
+// the high-priority pool overflows, its oldest entries move down into the
+// low-priority pool.
 
 struct LRUHandle {
     void* value;
@@ -36,6 +44,10 @@ struct LRUHandle {
     size_t charge;
     size_t key_length;
     bool in_cache;
+    bool is_high_pri;
+    bool in_high_pri_pool;
+    // Looked up since insertion.
+    bool hit;
     uint32_t refs;
     uint32_t hash;
     char key_data[1];
@@ -132,15 +144,32 @@ public:
     LRUCache();
     ~LRUCache();
 
-    void SetCapacity(size_t capacity) { capacity_ = capacity; }
+    void SetCapacity(size_t capacity, double high_pri_pool_ratio) {
+        capacity_ = capacity;
+        high_pri_pool_ratio_ = high_pri_pool_ratio;
+        high_pri_pool_capacity_ = static_cast<size_t>(capacity * high_pri_pool_ratio);
+    }
 
     Cache::Handle* Insert(const Slice& key, uint32_t hash,
                           void* value, size_t charge,
-                          void (*deleter)(const Slice& key, void* value));
+                          void (*deleter)(const Slice& key, void* value),
+                          Cache::Priority priority);
     Cache::Handle* Lookup(const Slice& key, uint32_t hash);
     void Release(Cache::Handle* handle);
     void Erase(const Slice& key, uint32_t hash);
     void Prune();
+    void ApplyToAllEntries(
+        const std::function<void(const Slice&, void*, size_t,
+                                 void (*)(const Slice&, void*), Cache::Priority)>& callback) {
+        std::lock_guard<std::mutex> l(mutex_);
+        for (LRUHandle* list : {&lru_, &in_use_}) {
+            for (LRUHandle* e = list->next; e != list; e = e->next) {
+                callback(e->key(), e->value, e->charge, e->deleter,
+                         e->is_high_pri || e->in_high_pri_pool ? Cache::Priority::kHigh
+                                                               : Cache::Priority::kLow);
+            }
+        }
+    }
     size_t TotalCharge() const {
         std::lock_guard<std::mutex> l(mutex_);
         return usage_;
@@ -149,28 +178,38 @@ public:
 private:
     void LRU_Remove(LRUHandle* e);
     void LRU_Append(LRUHandle* list, LRUHandle* e);
+    // Makes e the newest entry of its pool in the LRU list.
+    void LRU_Insert(LRUHandle* e);
+    void MaintainPoolSize();
     void Ref(LRUHandle* e);
     void Unref(LRUHandle* e);
     bool FinishErase(LRUHandle* e);
 
     size_t capacity_;
+    double high_pri_pool_ratio_;
+    size_t high_pri_pool_capacity_;
 
     // mutex_ protects the following state.
     mutable std::mutex mutex_;
     size_t usage_;
+    size_t high_pri_pool_usage_;
 
     // Dummy head of LRU list.
     // lru.prev is newest entry, lru.next is oldest entry.
     // Entries have refs==1 and in_cache==true.
     LRUHandle lru_;
 
+    // Newest entry of the low-priority pool, or &lru_ if it is empty.
+    LRUHandle* lru_low_pri_;
+
     LRUHandle in_use_;
 
     HandleTable table_;
 };
 
 LRUCache::LRUCache()
-    : capacity_(0), usage_(0) {
+    : capacity_(0), high_pri_pool_ratio_(0), high_pri_pool_capacity_(0), usage_(0),
+      high_pri_pool_usage_(0), lru_low_pri_(&lru_) {
     lru_.next = &lru_;
     lru_.prev = &lru_;
     in_use_.next = &in_use_;
@@ -206,13 +245,45 @@ void LRUCache::Unref(LRUHandle* e) {
         free(e);
     } else if (e->in_cache && e->refs == 1) {
         LRU_Remove(e);
-        LRU_Append(&lru_, e);
+        LRU_Insert(e);
     }
 }
 
 void LRUCache::LRU_Remove(LRUHandle* e) {
+    if (lru_low_pri_ == e) {
+        lru_low_pri_ = e->prev;
+    }
     e->next->prev = e->prev;
     e->prev->next = e->next;
+    if (e->in_high_pri_pool) {
+        e->in_high_pri_pool = false;
+        high_pri_pool_usage_ -= e->charge;
+    }
+}
+
+void LRUCache::LRU_Insert(LRUHandle* e) {
+    if (high_pri_pool_ratio_ > 0 && (e->is_high_pri || e->hit)) {
+        LRU_Append(&lru_, e);
+        e->in_high_pri_pool = true;
+        high_pri_pool_usage_ += e->charge;
+        MaintainPoolSize();
+    } else {
+        // Midpoint insertion: just below the high-priority pool.
+        e->next = lru_low_pri_->next;
+        e->prev = lru_low_pri_;
+        e->prev->next = e;
+        e->next->prev = e;
+        lru_low_pri_ = e;
+    }
+}
+
+void LRUCache::MaintainPoolSize() {
+    while (high_pri_pool_usage_ > high_pri_pool_capacity_) {
+        lru_low_pri_ = lru_low_pri_->next;
+        assert(lru_low_pri_ != &lru_);
+        lru_low_pri_->in_high_pri_pool = false;
+        high_pri_pool_usage_ -= lru_low_pri_->charge;
+    }
 }
 
 void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
@@ -227,6 +298,7 @@ Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
     LRUHandle* e = table_.Lookup(key, hash);
     if (e != nullptr) {
         Ref(e);
+        e->hit = true;
     }
     return reinterpret_cast<Cache::Handle*>(e);
 }
@@ -238,7 +310,7 @@ void LRUCache::Release(Cache::Handle* handle) {
 
 Cache::Handle* LRUCache::Insert(
     const Slice& key, uint32_t hash, void* value, size_t charge,
-    void (*deleter)(const Slice& key, void* value)) {
+    void (*deleter)(const Slice& key, void* value), Cache::Priority priority) {
     std::lock_guard<std::mutex> l(mutex_);
 
     LRUHandle* e = reinterpret_cast<LRUHandle*>(
@@ -249,6 +321,9 @@ Cache::Handle* LRUCache::Insert(
     e->key_length = key.size();
     e->hash = hash;
     e->in_cache = false;
+    e->is_high_pri = (priority == Cache::Priority::kHigh);
+    e->in_high_pri_pool = false;
+    e->hit = false;
     e->refs = 1;
     std::memcpy(e->key_data, key.data(), key.size());
 
@@ -327,19 +402,20 @@ private:
     }
 
 public:
-    explicit ShardedLRUCache(size_t capacity)
+    ShardedLRUCache(size_t capacity, double high_pri_pool_ratio)
         : last_id_(0) {
         const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
         for (int s = 0; s < kNumShards; s++) {
-            shard_[s].SetCapacity(per_shard);
+            shard_[s].SetCapacity(per_shard, high_pri_pool_ratio);
         }
     }
     ~ShardedLRUCache() override {}
 
     Handle* Insert(const Slice& key, void* value, size_t charge,
-                   void (*deleter)(const Slice& key, void* value)) override {
+                   void (*deleter)(const Slice& key, void* value),
+                   Priority priority) override {
         const uint32_t hash = HashSlice(key);
-        return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+        return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter, priority);
     }
 
     Handle* Lookup(const Slice& key) override {
@@ -379,12 +455,20 @@ public:
         }
         return total;
     }
+
+    void ApplyToAllEntries(
+        const std::function<void(const Slice&, void*, size_t,
+                                 void (*)(const Slice&, void*), Priority)>& callback) override {
+        for (int s = 0; s < kNumShards; s++) {
+            shard_[s].ApplyToAllEntries(callback);
+        }
+    }
 };
 
 }
 
-Cache* NewLRUCache(size_t capacity) {
-    return new ShardedLRUCache(capacity);
+Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio) {
+    return new ShardedLRUCache(capacity, high_pri_pool_ratio);
 }
 
 }
@@ -0,0 +1,393 @@
+#include "lsm/cache.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <string>
+
+namespace lsm {
+
+namespace {
+
+// CLOCK cache
+//
+// Each shard is an open-addressed hash table of slots with linear probing.
+// Everything Lookup() and Release() need lives in one 64-bit atomic per
+// slot, so neither takes a lock:
+//
+//   bits 62-63  state: empty, construction, visible or invisible
+//   bits 32-39  clock countdown, raised by hits and lowered by the sweep
+//   bits  0-29  references held by clients
+//
+// A slot moves empty -> construction -> visible -> invisible -> (construction
+// while being freed) -> empty. Only the thread that wins a compare-exchange
+// out of empty or invisible-with-no-references may touch the slot's key and
+// value, and those transitions require the exact expected word. Every other
+// change is a fetch_add/fetch_sub, so a Lookup() that speculatively takes a
+// reference on a slot that changed under it simply gives it back.
+//
+// Lookups stop probing at a slot whose displacement count is zero: no
+// entry's probe sequence passed it, so the key cannot be further along.
+//
+// Insert(), the CLOCK sweep that makes room and Prune() take the shard's
+// mutex; lookups of cached entries never do.
+
+static const int kStateShift = 62;
+static const uint64_t kStateEmpty = 0;
+static const uint64_t kStateConstruction = 1;
+static const uint64_t kStateVisible = 2;
+static const uint64_t kStateInvisible = 3;
+static const int kClockShift = 32;
+static const uint64_t kClockMask = 0xff;
+static const uint64_t kMaxClock = 3;
+static const uint64_t kRefsMask = (1u << 30) - 1;
+
+inline uint64_t StateOf(uint64_t meta) { return meta >> kStateShift; }
+inline uint64_t ClockOf(uint64_t meta) { return (meta >> kClockShift) & kClockMask; }
+inline uint64_t RefsOf(uint64_t meta) { return meta & kRefsMask; }
+
+struct ClockHandle {
+    std::atomic<uint64_t> meta{0};
+    // Number of entries stored past this slot in their probe sequence.
+    std::atomic<uint32_t> displacements{0};
+    std::atomic<uint32_t> hash{0};
+    // Not in the table because it was full; freed by its last Release().
+    bool detached = false;
+    std::string key;
+    void* value = nullptr;
+    void (*deleter)(const Slice&, void* value) = nullptr;
+    size_t charge = 0;
+};
+
+class ClockCacheShard {
+public:
+    ClockCacheShard() : slots_(nullptr), mask_(0), capacity_(0), usage_(0), hand_(0) {}
+
+    ~ClockCacheShard() {
+        for (size_t i = 0; slots_ != nullptr && i <= mask_; i++) {
+            ClockHandle* h = &slots_[i];
+            const uint64_t state = StateOf(h->meta.load(std::memory_order_relaxed));
+            if (state == kStateVisible || state == kStateInvisible) {
+                assert(RefsOf(h->meta.load(std::memory_order_relaxed)) == 0);
+                (*h->deleter)(h->key, h->value);
+            }
+        }
+        delete[] slots_;
+    }
+
+    void Init(size_t capacity, size_t num_slots) {
+        size_t n = 16;
+        while (n < num_slots) {
+            n *= 2;
+        }
+        slots_ = new ClockHandle[n];
+        mask_ = n - 1;
+        capacity_ = capacity;
+    }
+
+    Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value, size_t charge,
+                          void (*deleter)(const Slice& key, void* value),
+                          Cache::Priority priority) {
+        std::lock_guard<std::mutex> l(mutex_);
+
+        // A new entry replaces any old one for the same key.
+        if (ClockHandle* old = Find(key, hash)) {
+            MakeInvisible(old);
+            Release(old);
+        }
+        EvictFor(charge);
+
+        const size_t home = hash & mask_;
+        size_t idx = home;
+        ClockHandle* h = nullptr;
+        for (size_t probes = 0; probes <= mask_; probes++, idx = (idx + 1) & mask_) {
+            uint64_t expected = 0;
+            if (slots_[idx].meta.compare_exchange_strong(
+                    expected, kStateConstruction << kStateShift, std::memory_order_acquire)) {
+                h = &slots_[idx];
+                break;
+            }
+            slots_[idx].displacements.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (h == nullptr) {
+            // Full: undo the displacements and hand out an uncached entry.
+            for (size_t i = 0; i <= mask_; i++) {
+                slots_[i].displacements.fetch_sub(1, std::memory_order_relaxed);
+            }
+            h = new ClockHandle;
+            h->detached = true;
+            h->meta.store((kStateInvisible << kStateShift) | 1, std::memory_order_relaxed);
+        }
+
+        h->hash.store(hash, std::memory_order_relaxed);
+        h->key.assign(key.data(), key.size());
+        h->value = value;
+        h->deleter = deleter;
+        h->charge = charge;
+        if (!h->detached) {
+            usage_.fetch_add(charge, std::memory_order_relaxed);
+            const uint64_t clock = (priority == Cache::Priority::kHigh) ? 2 : 1;
+            // construction -> visible, plus the caller's reference. Added, not
+            // stored, to keep any speculative references from lookups.
+            h->meta.fetch_add(((kStateVisible - kStateConstruction) << kStateShift) |
+                                  (clock << kClockShift) | 1,
+                              std::memory_order_release);
+        }
+        return reinterpret_cast<Cache::Handle*>(h);
+    }
+
+    Cache::Handle* Lookup(const Slice& key, uint32_t hash) {
+        ClockHandle* h = Find(key, hash);
+        if (h != nullptr) {
+            const uint64_t meta = h->meta.load(std::memory_order_relaxed);
+            if (ClockOf(meta) < kMaxClock) {
+                h->meta.fetch_add(uint64_t{1} << kClockShift, std::memory_order_relaxed);
+            }
+        }
+        return reinterpret_cast<Cache::Handle*>(h);
+    }
+
+    void Release(ClockHandle* h) {
+        const uint64_t old = h->meta.fetch_sub(1, std::memory_order_acq_rel);
+        assert(RefsOf(old) > 0);
+        if (StateOf(old) == kStateInvisible && RefsOf(old) == 1) {
+            TryFree(h);
+        }
+    }
+
+    void Erase(const Slice& key, uint32_t hash) {
+        ClockHandle* h = Find(key, hash);
+        if (h != nullptr) {
+            MakeInvisible(h);
+            Release(h);
+        }
+    }
+
+    void Prune() {
+        std::lock_guard<std::mutex> l(mutex_);
+        for (size_t i = 0; i <= mask_; i++) {
+            TryEvict(&slots_[i]);
+        }
+    }
+
+    size_t TotalCharge() const { return usage_.load(std::memory_order_relaxed); }
+
+    // Holding mutex_ keeps new entries out of the slots; a reference keeps
+    // each visible entry from being freed while callback sees it. An entry
+    // with more than the kLow countdown counts as kHigh.
+    void ApplyToAllEntries(
+        const std::function<void(const Slice&, void*, size_t,
+                                 void (*)(const Slice&, void*), Cache::Priority)>& callback) {
+        std::lock_guard<std::mutex> l(mutex_);
+        for (size_t i = 0; slots_ != nullptr && i <= mask_; i++) {
+            ClockHandle* h = &slots_[i];
+            if (StateOf(h->meta.load(std::memory_order_acquire)) != kStateVisible) {
+                continue;
+            }
+            const uint64_t old = h->meta.fetch_add(1, std::memory_order_acq_rel);
+            if (StateOf(old) == kStateVisible) {
+                callback(h->key, h->value, h->charge, h->deleter,
+                         ClockOf(old) > 1 ? Cache::Priority::kHigh : Cache::Priority::kLow);
+            }
+            Release(h);
+        }
+    }
+
+private:
+    // Returns the visible entry for key with a reference taken, or nullptr.
+    ClockHandle* Find(const Slice& key, uint32_t hash) {
+        size_t idx = hash & mask_;
+        for (size_t probes = 0; probes <= mask_; probes++, idx = (idx + 1) & mask_) {
+            ClockHandle* h = &slots_[idx];
+            const uint64_t meta = h->meta.load(std::memory_order_acquire);
+            if (StateOf(meta) == kStateVisible &&
+                h->hash.load(std::memory_order_relaxed) == hash) {
+                const uint64_t old = h->meta.fetch_add(1, std::memory_order_acq_rel);
+                if (StateOf(old) == kStateVisible && Slice(h->key) == key) {
+                    return h;
+                }
+                Release(h);
+            }
+            if (h->displacements.load(std::memory_order_relaxed) == 0) {
+                break;
+            }
+        }
+        return nullptr;
+    }
+
+    static void MakeInvisible(ClockHandle* h) {
+        uint64_t meta = h->meta.load(std::memory_order_relaxed);
+        while (StateOf(meta) == kStateVisible &&
+               !h->meta.compare_exchange_weak(
+                   meta, meta + ((kStateInvisible - kStateVisible) << kStateShift),
+                   std::memory_order_acq_rel)) {
+        }
+    }
+
+    // Frees an invisible entry if nobody references it. Whoever wins the
+    // exchange frees it; everyone else backs off.
+    void TryFree(ClockHandle* h) {
+        uint64_t meta = h->meta.load(std::memory_order_acquire);
+        while (true) {
+            if (StateOf(meta) != kStateInvisible || RefsOf(meta) != 0) {
+                return;
+            }
+            if (h->meta.compare_exchange_weak(meta, kStateConstruction << kStateShift,
+                                              std::memory_order_acq_rel)) {
+                break;
+            }
+        }
+
+        (*h->deleter)(h->key, h->value);
+        if (h->detached) {
+            delete h;
+            return;
+        }
+        usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+        const size_t idx = static_cast<size_t>(h - slots_);
+        for (size_t i = h->hash.load(std::memory_order_relaxed) & mask_; i != idx;
+             i = (i + 1) & mask_) {
+            slots_[i].displacements.fetch_sub(1, std::memory_order_relaxed);
+        }
+        h->key.clear();
+        h->value = nullptr;
+        h->meta.fetch_sub(kStateConstruction << kStateShift, std::memory_order_release);
+    }
+
+    // One step of the CLOCK sweep over h: an unreferenced entry loses a
+    // unit of its countdown, or is evicted once it has none left.
+    void TryEvict(ClockHandle* h) {
+        uint64_t meta = h->meta.load(std::memory_order_relaxed);
+        if (StateOf(meta) != kStateVisible || RefsOf(meta) != 0) {
+            return;
+        }
+        if (ClockOf(meta) > 0) {
+            h->meta.compare_exchange_strong(meta, meta - (uint64_t{1} << kClockShift),
+                                            std::memory_order_relaxed);
+            return;
+        }
+        if (h->meta.compare_exchange_strong(
+                meta, meta + ((kStateInvisible - kStateVisible) << kStateShift),
+                std::memory_order_acq_rel)) {
+            TryFree(h);
+        }
+    }
+
+    // REQUIRES: mutex_ held.
+    void EvictFor(size_t charge) {
+        // Enough turns for every countdown to reach zero; beyond that the
+        // remaining entries are all referenced and the cache runs over.
+        const size_t max_steps = (mask_ + 1) * (kMaxClock + 2);
+        for (size_t steps = 0;
+             steps < max_steps && usage_.load(std::memory_order_relaxed) + charge > capacity_;
+             steps++) {
+            TryEvict(&slots_[hand_]);
+            hand_ = (hand_ + 1) & mask_;
+        }
+    }
+
+    ClockHandle* slots_;
+    size_t mask_;
+    size_t capacity_;
+    std::atomic<size_t> usage_;
+
+    // Serializes Insert() and the sweep.
+    std::mutex mutex_;
+    size_t hand_;
+};
+
+static const int kNumShardBits = 4;
+static const int kNumShards = 1 << kNumShardBits;
+
+inline uint32_t HashSlice(const Slice& s) {
+    uint32_t h = 0x1b873593;
+    for (size_t i = 0; i < s.size(); ++i) {
+        h = (h << 5) + h + s[i];
+    }
+    // Mix so the low bits (home slot) and high bits (shard) both vary.
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    return h;
+}
+
+class ShardedClockCache : public Cache {
+public:
+    ShardedClockCache(size_t capacity, size_t estimated_entry_charge) : last_id_(0) {
+        const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
+        const size_t entries = per_shard / std::max<size_t>(estimated_entry_charge, 1);
+        for (int s = 0; s < kNumShards; s++) {
+            // Keep the table at most half full at the estimated charge.
+            shard_[s].Init(per_shard, 2 * entries);
+        }
+    }
+
+    Handle* Insert(const Slice& key, void* value, size_t charge,
+                   void (*deleter)(const Slice& key, void* value),
+                   Priority priority) override {
+        const uint32_t hash = HashSlice(key);
+        return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter, priority);
+    }
+
+    Handle* Lookup(const Slice& key) override {
+        const uint32_t hash = HashSlice(key);
+        return shard_[Shard(hash)].Lookup(key, hash);
+    }
+
+    void Release(Handle* handle) override {
+        ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+        shard_[Shard(h->hash.load(std::memory_order_relaxed))].Release(h);
+    }
+
+    void* Value(Handle* handle) override {
+        return reinterpret_cast<ClockHandle*>(handle)->value;
+    }
+
+    void Erase(const Slice& key) override {
+        const uint32_t hash = HashSlice(key);
+        shard_[Shard(hash)].Erase(key, hash);
+    }
+
+    uint64_t NewId() override {
+        return last_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    void Prune() override {
+        for (int s = 0; s < kNumShards; s++) {
+            shard_[s].Prune();
+        }
+    }
+
+    size_t TotalCharge() const override {
+        size_t total = 0;
+        for (int s = 0; s < kNumShards; s++) {
+            total += shard_[s].TotalCharge();
+        }
+        return total;
+    }
+
+    void ApplyToAllEntries(
+        const std::function<void(const Slice&, void*, size_t,
+                                 void (*)(const Slice&, void*), Priority)>& callback) override {
+        for (int s = 0; s < kNumShards; s++) {
+            shard_[s].ApplyToAllEntries(callback);
+        }
+    }
+
+private:
+    // The low bits pick the home slot, so shards use the high ones.
+    static uint32_t Shard(uint32_t hash) {
+        return hash >> (32 - kNumShardBits);
+    }
+
+    ClockCacheShard shard_[kNumShards];
+    std::atomic<uint64_t> last_id_;
+};
+
+}
+
+Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge) {
+    return new ShardedClockCache(capacity, estimated_entry_charge);
+}
+
+}
@@ -1,6 +1,14 @@
 #include "crc32.h"
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#include <nmmintrin.h>
+#endif
 
 namespace lsm {
 namespace crc32c {
@@ -62,17 +70,17 @@ static const uint32_t table[256] = {
     0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
     0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90,
     0x9e902e7b, 0x6cfbad78, 0x7fab5e8c, 0x8dc0dd8f,
-    0xe301cbc2, 0x116a48c1, 0x023ab335, 0xf0513036,
-    0x249b5cdd, 0xd6f0dfde, 0xc5a02c2a, 0x37cbaf29,
-    0x69d8930d, 0x9bb3100e, 0x88e3e3fa, 0x7a8860f9,
-    0xae420412, 0x5c298711, 0x4f7974e5, 0xbd12f7e6,
-    0xf35f0b5d, 0x0134885e, 0x12647baa, 0xe00ff8a9,
-    0x34c59c42, 0xc6ae1f41, 0xd5feecb5, 0x27956fb6,
-    0x79865392, 0x8bedd091, 0x98bd2365, 0x6acaa066,
-    0xbefc848d, 0x4c97078e, 0x5fc7f47a, 0xadac7779
+    0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+    0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1,
+    0x69e9f0d5, 0x9b8273d6, 0x88d28022, 0x7ab90321,
+    0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+    0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81,
+    0x34f4f86a, 0xc69f7b69, 0xd5cf889d, 0x27a40b9e,
+    0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+    0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351
 };
 
-uint32_t Extend(uint32_t init_crc, const char* data, size_t n) {
+uint32_t ExtendPortable(uint32_t init_crc, const char* data, size_t n) {
     uint32_t c = init_crc ^ 0xffffffff;
     const uint8_t* u = reinterpret_cast<const uint8_t*>(data);
     for (size_t i = 0; i < n; i++) {
@@ -81,5 +89,194 @@ uint32_t Extend(uint32_t init_crc, const char* data, size_t n) {
     return c ^ 0xffffffff;
 }
 
+#if defined(__x86_64__) || defined(_M_X64)
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define LSM_TARGET_SSE42
+#else
+#define LSM_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+
+// The SSE4.2 path runs three independent crc32 streams over adjacent
+// stretches of the input to hide the instruction's 3-cycle latency, then
+// folds them together by multiplying through the crc of a run of zeros.
+static const size_t kLongStride = 8192;
+static const size_t kShortStride = 256;
+static const uint32_t kPoly = 0x82f63b78;
+
+// Multiplies the GF(2) 32x32 matrix "mat" by "vec".
+static uint32_t GF2MatrixTimes(const uint32_t* mat, uint32_t vec) {
+    uint32_t sum = 0;
+    while (vec) {
+        if (vec & 1) sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+static void GF2MatrixSquare(uint32_t* square, const uint32_t* mat) {
+    for (int n = 0; n < 32; n++) {
+        square[n] = GF2MatrixTimes(mat, mat[n]);
+    }
+}
+
+// Builds the operator that appends len zero bytes to a crc, expanded into
+// four byte-indexed tables so it can be applied with four lookups.
+static void ComputeZerosTable(uint32_t zeros[4][256], size_t len) {
+    uint32_t even[32];
+    uint32_t odd[32];
+    odd[0] = kPoly;
+    uint32_t row = 1;
+    for (int n = 1; n < 32; n++) {
+        odd[n] = row;
+        row <<= 1;
+    }
+    GF2MatrixSquare(even, odd);  // two zero bits
+    GF2MatrixSquare(odd, even);  // four zero bits
+
+    // Each squaring doubles the number of zero bits; the first in the loop
+    // yields one zero byte.
+    const uint32_t* op = nullptr;
+    while (true) {
+        GF2MatrixSquare(even, odd);
+        len >>= 1;
+        if (len == 0) {
+            op = even;
+            break;
+        }
+        GF2MatrixSquare(odd, even);
+        len >>= 1;
+        if (len == 0) {
+            op = odd;
+            break;
+        }
+    }
+
+    for (uint32_t n = 0; n < 256; n++) {
+        zeros[0][n] = GF2MatrixTimes(op, n);
+        zeros[1][n] = GF2MatrixTimes(op, n << 8);
+        zeros[2][n] = GF2MatrixTimes(op, n << 16);
+        zeros[3][n] = GF2MatrixTimes(op, n << 24);
+    }
+}
+
+struct ShiftTables {
+    uint32_t long_zeros[4][256];
+    uint32_t short_zeros[4][256];
+
+    ShiftTables() {
+        ComputeZerosTable(long_zeros, kLongStride);
+        ComputeZerosTable(short_zeros, kShortStride);
+    }
+};
+
+static inline uint32_t Shift(const uint32_t zeros[4][256], uint32_t crc) {
+    return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+           zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+static inline uint64_t Load64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+LSM_TARGET_SSE42
+static uint32_t ExtendSSE42(uint32_t init_crc, const char* data, size_t n) {
+    static const ShiftTables tables;
+    const uint8_t* next = reinterpret_cast<const uint8_t*>(data);
+    uint64_t crc0 = init_crc ^ 0xffffffff;
+
+    while (n > 0 && (reinterpret_cast<uintptr_t>(next) & 7) != 0) {
+        crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *next);
+        next++;
+        n--;
+    }
+
+    while (n >= 3 * kLongStride) {
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        const uint8_t* end = next + kLongStride;
+        do {
+            crc0 = _mm_crc32_u64(crc0, Load64(next));
+            crc1 = _mm_crc32_u64(crc1, Load64(next + kLongStride));
+            crc2 = _mm_crc32_u64(crc2, Load64(next + 2 * kLongStride));
+            next += 8;
+        } while (next < end);
+        crc0 = Shift(tables.long_zeros, static_cast<uint32_t>(crc0)) ^ crc1;
+        crc0 = Shift(tables.long_zeros, static_cast<uint32_t>(crc0)) ^ crc2;
+        next += 2 * kLongStride;
+        n -= 3 * kLongStride;
+    }
+
+    while (n >= 3 * kShortStride) {
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        const uint8_t* end = next + kShortStride;
+        do {
+            crc0 = _mm_crc32_u64(crc0, Load64(next));
+            crc1 = _mm_crc32_u64(crc1, Load64(next + kShortStride));
+            crc2 = _mm_crc32_u64(crc2, Load64(next + 2 * kShortStride));
+            next += 8;
+        } while (next < end);
+        crc0 = Shift(tables.short_zeros, static_cast<uint32_t>(crc0)) ^ crc1;
+        crc0 = Shift(tables.short_zeros, static_cast<uint32_t>(crc0)) ^ crc2;
+        next += 2 * kShortStride;
+        n -= 3 * kShortStride;
+    }
+
+    const uint8_t* end = next + (n - (n & 7));
+    while (next < end) {
+        crc0 = _mm_crc32_u64(crc0, Load64(next));
+        next += 8;
+    }
+    n &= 7;
+    while (n > 0) {
+        crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *next);
+        next++;
+        n--;
+    }
+    return static_cast<uint32_t>(crc0) ^ 0xffffffff;
+}
+
+static bool CpuSupportsSSE42() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+#endif
+
+typedef uint32_t (*ExtendFunction)(uint32_t, const char*, size_t);
+
+static ExtendFunction ChooseExtend() {
+#if defined(__x86_64__) || defined(_M_X64)
+    if (CpuSupportsSSE42()) {
+        return ExtendSSE42;
+    }
+#endif
+    return ExtendPortable;
+}
+
+// Resolved on first use so callers from other static initializers are safe.
+static ExtendFunction SelectedExtend() {
+    static const ExtendFunction extend = ChooseExtend();
+    return extend;
+}
+
+bool IsHardwareAccelerated() {
+    return SelectedExtend() != ExtendPortable;
+}
+
+uint32_t Extend(uint32_t init_crc, const char* data, size_t n) {
+    return SelectedExtend()(init_crc, data, n);
+}
+
 }
 }
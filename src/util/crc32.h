@@ -7,8 +7,17 @@ namespace lsm {
 namespace crc32c {
 
 // Extends init_crc with data[0,n-1] (used to incrementally compute CRC of a stream).
+// Uses the SSE4.2 crc32 instruction when the CPU supports it.
 uint32_t Extend(uint32_t init_crc, const char* data, size_t n);
 
+// Extend() on the portable table whatever the CPU supports, so tests can
+// check the hardware path against it.
+uint32_t ExtendPortable(uint32_t init_crc, const char* data, size_t n);
+
+// Returns true if Extend() runs on the hardware crc32 instruction rather than
+// the portable table.
+bool IsHardwareAccelerated();
+
 inline uint32_t Value(const char* data, size_t n) {
     return Extend(0, data, n);
 }
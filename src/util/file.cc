@@ -0,0 +1,931 @@
+#include "src/util/file.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include "src/util/thread_pool.h"
+
+#ifdef _WIN32
+#include <filesystem>
+#include <fstream>
+#else
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define LSM_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+#endif
+
+namespace lsm {
+
+#ifdef _WIN32
+
+// No direct I/O here; both files fall back to buffered streams.
+
+class StdRandomAccessFile : public RandomAccessFile {
+public:
+    explicit StdRandomAccessFile(const std::string& fname)
+        : fname_(fname), file_(fname, std::ios::in | std::ios::binary) {}
+
+    bool is_open() const { return file_.is_open(); }
+
+    Status Read(uint64_t offset, size_t n, char* scratch) const override {
+        std::lock_guard<std::mutex> lock(mu_);
+        file_.clear();
+        file_.seekg(offset, std::ios::beg);
+        file_.read(scratch, n);
+        if (file_.gcount() != static_cast<std::streamsize>(n)) {
+            return Status::IOError(fname_, "short read");
+        }
+        return Status::OK();
+    }
+
+    bool use_direct_io() const override { return false; }
+
+private:
+    const std::string fname_;
+    mutable std::mutex mu_;
+    mutable std::ifstream file_;
+};
+
+class StdWritableFile : public WritableFile {
+public:
+    explicit StdWritableFile(const std::string& fname)
+        : fname_(fname), file_(fname, std::ios::out | std::ios::binary | std::ios::trunc),
+          size_(0) {}
+    ~StdWritableFile() override { Close(); }
+
+    bool is_open() const { return file_.is_open(); }
+
+    Status Append(const Slice& data) override {
+        file_.write(data.data(), data.size());
+        size_ += data.size();
+        return file_.fail() ? Status::IOError(fname_, "write failed") : Status::OK();
+    }
+
+    Status Flush() override {
+        file_.flush();
+        return file_.fail() ? Status::IOError(fname_, "flush failed") : Status::OK();
+    }
+
+    Status Sync() override { return Flush(); }
+
+    Status Close() override {
+        if (!file_.is_open()) {
+            return Status::OK();
+        }
+        file_.close();
+        return file_.fail() ? Status::IOError(fname_, "close failed") : Status::OK();
+    }
+
+    uint64_t Size() const override { return size_; }
+
+private:
+    const std::string fname_;
+    std::ofstream file_;
+    uint64_t size_;
+};
+
+Status NewRandomAccessFile(const std::string& fname, bool use_direct_io,
+                           RandomAccessFile** result) {
+    (void)use_direct_io;
+    StdRandomAccessFile* file = new StdRandomAccessFile(fname);
+    if (!file->is_open()) {
+        delete file;
+        *result = nullptr;
+        return Status::IOError(fname, "cannot open for reading");
+    }
+    *result = file;
+    return Status::OK();
+}
+
+Status NewWritableFile(const std::string& fname, bool use_direct_io,
+                       WritableFile** result) {
+    (void)use_direct_io;
+    StdWritableFile* file = new StdWritableFile(fname);
+    if (!file->is_open()) {
+        delete file;
+        *result = nullptr;
+        return Status::IOError(fname, "cannot open for writing");
+    }
+    *result = file;
+    return Status::OK();
+}
+
+class StdRandomRWFile : public RandomRWFile {
+public:
+    explicit StdRandomRWFile(const std::string& fname)
+        : fname_(fname), file_(fname, std::ios::in | std::ios::out | std::ios::binary) {}
+
+    bool is_open() const { return file_.is_open(); }
+
+    Status Read(uint64_t offset, size_t n, char* scratch) const override {
+        std::lock_guard<std::mutex> lock(mu_);
+        file_.clear();
+        file_.seekg(offset, std::ios::beg);
+        file_.read(scratch, n);
+        if (file_.gcount() != static_cast<std::streamsize>(n)) {
+            return Status::IOError(fname_, "short read");
+        }
+        return Status::OK();
+    }
+
+    Status Write(uint64_t offset, const Slice& data) override {
+        std::lock_guard<std::mutex> lock(mu_);
+        file_.clear();
+        file_.seekp(offset, std::ios::beg);
+        file_.write(data.data(), data.size());
+        file_.flush();
+        return file_.fail() ? Status::IOError(fname_, "write failed") : Status::OK();
+    }
+
+    Status Sync() override { return Status::OK(); }
+
+private:
+    const std::string fname_;
+    mutable std::mutex mu_;
+    mutable std::fstream file_;
+};
+
+Status NewRandomRWFile(const std::string& fname, uint64_t size, RandomRWFile** result,
+                       bool* reused) {
+    *result = nullptr;
+    std::error_code ec;
+    *reused = std::filesystem::file_size(fname, ec) == size && !ec;
+    if (!*reused) {
+        std::ofstream(fname, std::ios::binary | std::ios::app).close();
+        std::filesystem::resize_file(fname, size, ec);
+        if (ec) {
+            return Status::IOError(fname, ec.message());
+        }
+    }
+    StdRandomRWFile* file = new StdRandomRWFile(fname);
+    if (!file->is_open()) {
+        delete file;
+        return Status::IOError(fname, "cannot open for reading and writing");
+    }
+    *result = file;
+    return Status::OK();
+}
+
+#else  // !_WIN32
+
+static Status PosixError(const std::string& context, int err) {
+    return Status::IOError(context, strerror(err));
+}
+
+static inline uint64_t RoundDown(uint64_t x) {
+    return x & ~static_cast<uint64_t>(kDirectIOAlignment - 1);
+}
+
+static inline uint64_t RoundUp(uint64_t x) {
+    return RoundDown(x + kDirectIOAlignment - 1);
+}
+
+// Heap buffer aligned for direct I/O.
+class AlignedBuffer {
+public:
+    AlignedBuffer() : data_(nullptr), capacity_(0) {}
+    ~AlignedBuffer() { free(data_); }
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    // Grows to at least n bytes; contents are not preserved.
+    bool Reserve(size_t n) {
+        if (n <= capacity_) return true;
+        void* p = nullptr;
+        if (posix_memalign(&p, kDirectIOAlignment, n) != 0) return false;
+        free(data_);
+        data_ = static_cast<char*>(p);
+        capacity_ = n;
+        return true;
+    }
+
+    char* data() const { return data_; }
+
+private:
+    char* data_;
+    size_t capacity_;
+};
+
+// Opens fname with flags, adding O_DIRECT (or F_NOCACHE) if requested.
+// Clears *direct when the file system refuses direct I/O.
+static int OpenFile(const std::string& fname, int flags, bool* direct) {
+    int fd = -1;
+#ifdef O_DIRECT
+    if (*direct) {
+        fd = open(fname.c_str(), flags | O_DIRECT, 0644);
+        if (fd >= 0 || errno != EINVAL) {
+            return fd;
+        }
+    }
+    *direct = false;
+    fd = open(fname.c_str(), flags, 0644);
+#else
+    fd = open(fname.c_str(), flags, 0644);
+#ifdef F_NOCACHE
+    if (fd >= 0 && *direct && fcntl(fd, F_NOCACHE, 1) == -1) {
+        *direct = false;
+    }
+#else
+    *direct = false;
+#endif
+#endif
+    return fd;
+}
+
+// Reads up to n bytes at offset, retrying on short reads until EOF.
+static Status PreadFully(int fd, const std::string& fname, uint64_t offset,
+                         size_t n, char* buf, size_t* bytes_read) {
+    size_t got = 0;
+    while (got < n) {
+        ssize_t r = pread(fd, buf + got, n - got, static_cast<off_t>(offset + got));
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return PosixError(fname, errno);
+        }
+        if (r == 0) break;
+        got += static_cast<size_t>(r);
+    }
+    *bytes_read = got;
+    return Status::OK();
+}
+
+static Status PwriteFully(int fd, const std::string& fname, uint64_t offset,
+                          const char* buf, size_t n) {
+    while (n > 0) {
+        ssize_t r = pwrite(fd, buf, n, static_cast<off_t>(offset));
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return PosixError(fname, errno);
+        }
+        buf += r;
+        n -= static_cast<size_t>(r);
+        offset += static_cast<uint64_t>(r);
+    }
+    return Status::OK();
+}
+
+#ifdef LSM_HAVE_IO_URING
+// A minimal io_uring ring driven through the raw system calls, so there is
+// no liburing dependency. Each reading thread has its own.
+class IoUring {
+public:
+    static constexpr size_t kDepth = 64;
+
+    // Returns this thread's ring, or nullptr once the kernel (or a seccomp
+    // policy) has refused io_uring; it is not tried again after that.
+    static IoUring* ThreadLocal() {
+        static std::atomic<bool> unavailable(false);
+        thread_local std::unique_ptr<IoUring> ring;
+        if (ring == nullptr && !unavailable.load(std::memory_order_relaxed)) {
+            ring.reset(new IoUring);
+            if (!ring->Init()) {
+                ring.reset();
+                unavailable.store(true, std::memory_order_relaxed);
+            }
+        }
+        return ring.get();
+    }
+
+    ~IoUring() {
+        if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_size_);
+        if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_size_);
+        if (sq_ptr_ != MAP_FAILED) munmap(sq_ptr_, sq_size_);
+        if (ring_fd_ >= 0) close(ring_fd_);
+    }
+
+    // Reads reqs[0, n) from fd, n <= kDepth, and stores the bytes each read
+    // returned in done[i]. Failed or unsubmitted reads report 0; finishing
+    // short reads is left to the caller. Returns with nothing in flight.
+    void Read(int fd, const ReadRequest* reqs, size_t n, size_t* done) {
+        std::vector<iovec> iov(n);
+        unsigned tail = *sq_tail_;
+        for (size_t i = 0; i < n; i++) {
+            done[i] = 0;
+            iov[i].iov_base = reqs[i].scratch;
+            iov[i].iov_len = reqs[i].len;
+            const unsigned idx = tail & *sq_mask_;
+            io_uring_sqe* sqe = &sqes_[idx];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READV;
+            sqe->fd = fd;
+            sqe->off = reqs[i].offset;
+            sqe->addr = reinterpret_cast<uint64_t>(&iov[i]);
+            sqe->len = 1;
+            sqe->user_data = i;
+            sq_array_[idx] = idx;
+            tail++;
+        }
+        __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+        size_t submitted = 0;
+        while (submitted < n) {
+            long r = syscall(__NR_io_uring_enter, ring_fd_, n - submitted, 0, 0, nullptr, 0);
+            if (r < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) {
+                continue;
+            }
+            if (r <= 0) {
+                // Withdraw what the kernel has not taken; the caller reads it.
+                __atomic_store_n(sq_tail_, __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE),
+                                 __ATOMIC_RELEASE);
+                break;
+            }
+            submitted += static_cast<size_t>(r);
+        }
+
+        // Every submitted read must complete before its buffer is released.
+        size_t completed = 0;
+        while (completed < submitted) {
+            unsigned head = *cq_head_;
+            const unsigned ctail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            if (head == ctail) {
+                syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                continue;
+            }
+            for (; head != ctail; head++) {
+                const io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+                if (cqe->res > 0) {
+                    done[cqe->user_data] = static_cast<size_t>(cqe->res);
+                }
+                completed++;
+            }
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        }
+    }
+
+private:
+    IoUring()
+        : ring_fd_(-1), sq_ptr_(MAP_FAILED), cq_ptr_(MAP_FAILED), sqes_(
+              static_cast<io_uring_sqe*>(MAP_FAILED)) {}
+
+    bool Init() {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, kDepth, &p));
+        if (ring_fd_ < 0) {
+            return false;
+        }
+        sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        }
+        sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED) {
+            return false;
+        }
+        cq_ptr_ = single_mmap ? sq_ptr_
+                              : mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ptr_ == MAP_FAILED) {
+            return false;
+        }
+        sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                                                MAP_SHARED | MAP_POPULATE, ring_fd_,
+                                                IORING_OFF_SQES));
+        if (sqes_ == MAP_FAILED) {
+            return false;
+        }
+
+        char* sq = static_cast<char*>(sq_ptr_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_mask_ = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        char* cq = static_cast<char*>(cq_ptr_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cq_mask_ = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        return true;
+    }
+
+    int ring_fd_;
+    void* sq_ptr_;
+    void* cq_ptr_;
+    io_uring_sqe* sqes_;
+    size_t sq_size_ = 0;
+    size_t cq_size_ = 0;
+    size_t sqes_size_ = 0;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+};
+#endif  // LSM_HAVE_IO_URING
+
+class PosixRandomAccessFile : public RandomAccessFile {
+public:
+    PosixRandomAccessFile(const std::string& fname, int fd, bool direct)
+        : fname_(fname), fd_(fd), direct_(direct) {}
+    ~PosixRandomAccessFile() override { close(fd_); }
+
+    Status Read(uint64_t offset, size_t n, char* scratch) const override {
+        size_t got = 0;
+        if (!direct_) {
+            Status s = PreadFully(fd_, fname_, offset, n, scratch, &got);
+            if (s.ok() && got != n) {
+                s = Status::IOError(fname_, "short read");
+            }
+            return s;
+        }
+
+        // Widen the read to aligned bounds, then copy out the requested bytes.
+        const uint64_t start = RoundDown(offset);
+        const size_t len = static_cast<size_t>(RoundUp(offset + n) - start);
+        thread_local AlignedBuffer buf;
+        if (!buf.Reserve(len)) {
+            return Status::IOError(fname_, "cannot allocate aligned read buffer");
+        }
+        Status s = PreadFully(fd_, fname_, start, len, buf.data(), &got);
+        if (!s.ok()) {
+            return s;
+        }
+        const size_t skip = static_cast<size_t>(offset - start);
+        if (got < skip + n) {
+            return Status::IOError(fname_, "short read");
+        }
+        memcpy(scratch, buf.data() + skip, n);
+        return Status::OK();
+    }
+
+    void MultiRead(ReadRequest* reqs, size_t n) const override {
+#ifdef LSM_HAVE_IO_URING
+        // Direct reads need aligned buffers and go through Read() instead.
+        IoUring* ring = (n > 1 && !direct_) ? IoUring::ThreadLocal() : nullptr;
+        if (ring != nullptr) {
+            std::vector<size_t> done(n);
+            for (size_t i = 0; i < n; i += IoUring::kDepth) {
+                ring->Read(fd_, reqs + i, std::min(n - i, IoUring::kDepth), &done[i]);
+            }
+            // Short and failed reads are finished, or their error reported, by pread.
+            for (size_t i = 0; i < n; i++) {
+                ReadRequest& req = reqs[i];
+                req.status = (done[i] == req.len)
+                                 ? Status::OK()
+                                 : Read(req.offset + done[i], req.len - done[i],
+                                        req.scratch + done[i]);
+            }
+            return;
+        }
+#endif
+        RandomAccessFile::MultiRead(reqs, n);
+    }
+
+    bool use_direct_io() const override { return direct_; }
+
+    void Hint(AccessPattern pattern, uint64_t offset, uint64_t length) const override {
+#ifdef POSIX_FADV_SEQUENTIAL
+        if (direct_) {
+            return;
+        }
+        int advice = POSIX_FADV_NORMAL;
+        switch (pattern) {
+            case kNormal: advice = POSIX_FADV_NORMAL; break;
+            case kSequential: advice = POSIX_FADV_SEQUENTIAL; break;
+            case kDontNeed: advice = POSIX_FADV_DONTNEED; break;
+        }
+        posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(length), advice);
+#else
+        (void)pattern;
+        (void)offset;
+        (void)length;
+#endif
+    }
+
+private:
+    const std::string fname_;
+    const int fd_;
+    const bool direct_;
+};
+
+class PosixWritableFile : public WritableFile {
+public:
+    PosixWritableFile(const std::string& fname, int fd, bool direct)
+        : fname_(fname), fd_(fd), direct_(direct), pos_(0), file_offset_(0), size_(0) {
+        buf_.Reserve(kBufferSize);
+    }
+    ~PosixWritableFile() override { Close(); }
+
+    Status Append(const Slice& data) override {
+        const char* p = data.data();
+        size_t left = data.size();
+        size_ += left;
+        while (left > 0) {
+            if (pos_ == kBufferSize) {
+                Status s = WriteBuffered(pos_);
+                if (!s.ok()) return s;
+            }
+            const size_t n = std::min(left, kBufferSize - pos_);
+            memcpy(buf_.data() + pos_, p, n);
+            pos_ += n;
+            p += n;
+            left -= n;
+        }
+        return Status::OK();
+    }
+
+    Status Flush() override {
+        if (fd_ < 0) {
+            return Status::OK();
+        }
+        return WriteBuffered(direct_ ? static_cast<size_t>(RoundDown(pos_)) : pos_);
+    }
+
+    Status Sync() override {
+        Status s = Flush();
+        if (s.ok() && fd_ >= 0) {
+#if defined(__APPLE__)
+            if (fsync(fd_) != 0) s = PosixError(fname_, errno);
+#else
+            if (fdatasync(fd_) != 0) s = PosixError(fname_, errno);
+#endif
+        }
+        return s;
+    }
+
+    Status Close() override {
+        if (fd_ < 0) {
+            return Status::OK();
+        }
+        Status s;
+        if (direct_ && pos_ > 0) {
+            // The tail must still be written as whole pages: pad it, then cut
+            // the file back to its real size.
+            const size_t padded = static_cast<size_t>(RoundUp(pos_));
+            memset(buf_.data() + pos_, 0, padded - pos_);
+            s = PwriteFully(fd_, fname_, file_offset_, buf_.data(), padded);
+            if (s.ok() && ftruncate(fd_, static_cast<off_t>(size_)) != 0) {
+                s = PosixError(fname_, errno);
+            }
+            pos_ = 0;
+        } else {
+            s = WriteBuffered(pos_);
+        }
+        if (close(fd_) != 0 && s.ok()) {
+            s = PosixError(fname_, errno);
+        }
+        fd_ = -1;
+        return s;
+    }
+
+    uint64_t Size() const override { return size_; }
+
+private:
+    // Multiple of kDirectIOAlignment, so a full buffer is always aligned.
+    static const size_t kBufferSize = 256 * 1024;
+
+    // Writes the first n buffered bytes and keeps the rest.
+    Status WriteBuffered(size_t n) {
+        if (n == 0) {
+            return Status::OK();
+        }
+        Status s = PwriteFully(fd_, fname_, file_offset_, buf_.data(), n);
+        if (!s.ok()) {
+            return s;
+        }
+        file_offset_ += n;
+        memmove(buf_.data(), buf_.data() + n, pos_ - n);
+        pos_ -= n;
+        return Status::OK();
+    }
+
+    const std::string fname_;
+    int fd_;
+    const bool direct_;
+    AlignedBuffer buf_;
+    size_t pos_;
+    uint64_t file_offset_;
+    uint64_t size_;
+};
+
+Status NewRandomAccessFile(const std::string& fname, bool use_direct_io,
+                           RandomAccessFile** result) {
+    bool direct = use_direct_io;
+    int fd = OpenFile(fname, O_RDONLY | O_CLOEXEC, &direct);
+    if (fd < 0) {
+        *result = nullptr;
+        return PosixError(fname, errno);
+    }
+    *result = new PosixRandomAccessFile(fname, fd, direct);
+    return Status::OK();
+}
+
+Status NewWritableFile(const std::string& fname, bool use_direct_io,
+                       WritableFile** result) {
+    bool direct = use_direct_io;
+    int fd = OpenFile(fname, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, &direct);
+    if (fd < 0) {
+        *result = nullptr;
+        return PosixError(fname, errno);
+    }
+    *result = new PosixWritableFile(fname, fd, direct);
+    return Status::OK();
+}
+
+class PosixRandomRWFile : public RandomRWFile {
+public:
+    PosixRandomRWFile(const std::string& fname, int fd) : fname_(fname), fd_(fd) {}
+    ~PosixRandomRWFile() override { close(fd_); }
+
+    Status Read(uint64_t offset, size_t n, char* scratch) const override {
+        size_t got = 0;
+        Status s = PreadFully(fd_, fname_, offset, n, scratch, &got);
+        if (s.ok() && got != n) {
+            s = Status::IOError(fname_, "short read");
+        }
+        return s;
+    }
+
+    Status Write(uint64_t offset, const Slice& data) override {
+        return PwriteFully(fd_, fname_, offset, data.data(), data.size());
+    }
+
+    Status Sync() override {
+#if defined(__APPLE__)
+        if (fsync(fd_) != 0) return PosixError(fname_, errno);
+#else
+        if (fdatasync(fd_) != 0) return PosixError(fname_, errno);
+#endif
+        return Status::OK();
+    }
+
+private:
+    const std::string fname_;
+    const int fd_;
+};
+
+Status NewRandomRWFile(const std::string& fname, uint64_t size, RandomRWFile** result,
+                       bool* reused) {
+    *result = nullptr;
+    int fd = open(fname.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return PosixError(fname, errno);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        Status s = PosixError(fname, errno);
+        close(fd);
+        return s;
+    }
+    *reused = static_cast<uint64_t>(st.st_size) == size;
+    if (!*reused) {
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            Status s = PosixError(fname, errno);
+            close(fd);
+            return s;
+        }
+#ifdef __linux__
+        // Best effort: reserving the blocks up front keeps the file
+        // contiguous, but not every file system supports it.
+        (void)posix_fallocate(fd, 0, static_cast<off_t>(size));
+#endif
+    }
+    *result = new PosixRandomRWFile(fname, fd);
+    return Status::OK();
+}
+
+#endif  // _WIN32
+
+void RandomAccessFile::MultiRead(ReadRequest* reqs, size_t n) const {
+    // The first read runs on this thread while the I/O pool runs the rest.
+    std::mutex mu;
+    std::condition_variable cv;
+    size_t pending = n > 1 ? n - 1 : 0;
+    for (size_t i = 1; i < n; i++) {
+        ReadRequest* req = &reqs[i];
+        IOThreadPool()->Schedule([&, req] {
+            req->status = Read(req->offset, req->len, req->scratch);
+            std::lock_guard<std::mutex> l(mu);
+            if (--pending == 0) {
+                cv.notify_one();
+            }
+        });
+    }
+    if (n > 0) {
+        reqs[0].status = Read(reqs[0].offset, reqs[0].len, reqs[0].scratch);
+    }
+    std::unique_lock<std::mutex> l(mu);
+    cv.wait(l, [&pending] { return pending == 0; });
+}
+
+class ReadaheadRandomAccessFile : public RandomAccessFile {
+public:
+    ReadaheadRandomAccessFile(const RandomAccessFile* base, uint64_t file_size,
+                              size_t readahead_size, bool drop_behind)
+        : base_(base), file_size_(file_size), readahead_size_(readahead_size),
+          drop_behind_(drop_behind), buffer_offset_(0), buffer_len_(0) {
+        if (drop_behind_) {
+            base_->Hint(kSequential);
+        }
+    }
+
+    ~ReadaheadRandomAccessFile() override {
+        if (drop_behind_) {
+            DropBuffered();
+            base_->Hint(kNormal);
+        }
+    }
+
+    Status Read(uint64_t offset, size_t n, char* scratch) const override {
+        if (offset >= buffer_offset_ && offset + n <= buffer_offset_ + buffer_len_) {
+            memcpy(scratch, buffer_.data() + (offset - buffer_offset_), n);
+            return Status::OK();
+        }
+        if (n >= readahead_size_) {
+            return base_->Read(offset, n, scratch);
+        }
+
+        if (drop_behind_) {
+            DropBuffered();
+        }
+        // Never read past the end; the last window is just shorter.
+        size_t len = readahead_size_;
+        if (offset < file_size_ && file_size_ - offset < len) {
+            len = static_cast<size_t>(file_size_ - offset);
+        }
+        len = std::max(len, n);
+        buffer_.resize(len);
+        buffer_len_ = 0;
+        Status s = base_->Read(offset, len, &buffer_[0]);
+        if (!s.ok()) {
+            return s;
+        }
+        buffer_offset_ = offset;
+        buffer_len_ = len;
+        memcpy(scratch, buffer_.data(), n);
+        return Status::OK();
+    }
+
+    // Batches bypass the buffer.
+    void MultiRead(ReadRequest* reqs, size_t n) const override { base_->MultiRead(reqs, n); }
+
+    bool use_direct_io() const override { return base_->use_direct_io(); }
+
+    void Hint(AccessPattern pattern, uint64_t offset, uint64_t length) const override {
+        base_->Hint(pattern, offset, length);
+    }
+
+private:
+    void DropBuffered() const {
+        if (buffer_len_ > 0) {
+            base_->Hint(kDontNeed, buffer_offset_, buffer_len_);
+        }
+    }
+
+    const RandomAccessFile* const base_;
+    const uint64_t file_size_;
+    const size_t readahead_size_;
+    const bool drop_behind_;
+    mutable std::string buffer_;
+    mutable uint64_t buffer_offset_;
+    mutable size_t buffer_len_;
+};
+
+RandomAccessFile* NewReadaheadRandomAccessFile(const RandomAccessFile* base,
+                                               uint64_t file_size,
+                                               size_t readahead_size,
+                                               bool drop_behind) {
+    return new ReadaheadRandomAccessFile(base, file_size, readahead_size, drop_behind);
+}
+
+class AutoReadaheadRandomAccessFile : public RandomAccessFile {
+public:
+    AutoReadaheadRandomAccessFile(const RandomAccessFile* base, uint64_t file_size,
+                                  size_t initial_size, size_t max_size)
+        : base_(base), file_size_(file_size), initial_size_(initial_size),
+          max_size_(std::max(initial_size, max_size)), window_size_(initial_size),
+          next_offset_(0), sequential_reads_(0), prefetch_inflight_(false) {}
+
+    ~AutoReadaheadRandomAccessFile() override { WaitForPrefetch(); }
+
+    Status Read(uint64_t offset, size_t n, char* scratch) const override {
+        if (offset == next_offset_) {
+            sequential_reads_++;
+        } else {
+            sequential_reads_ = 0;
+            window_size_ = initial_size_;
+        }
+        next_offset_ = offset + n;
+
+        // Past the current window: take the prefetched one if it has the
+        // bytes, otherwise drop it.
+        if (!current_.Covers(offset, n) && (prefetch_inflight_ || prefetch_.len > 0)) {
+            WaitForPrefetch();
+            if (prefetch_.status.ok() && prefetch_.Covers(offset, n)) {
+                std::swap(current_, prefetch_);
+            }
+            prefetch_.len = 0;
+        }
+
+        Status s;
+        if (current_.Covers(offset, n)) {
+            memcpy(scratch, current_.data.data() + (offset - current_.offset), n);
+        } else {
+            s = base_->Read(offset, n, scratch);
+        }
+        if (s.ok() && sequential_reads_ >= kAutoReadaheadTrigger) {
+            StartPrefetch();
+        }
+        return s;
+    }
+
+    // Batches bypass the buffer.
+    void MultiRead(ReadRequest* reqs, size_t n) const override { base_->MultiRead(reqs, n); }
+
+    bool use_direct_io() const override { return base_->use_direct_io(); }
+
+    void Hint(AccessPattern pattern, uint64_t offset, uint64_t length) const override {
+        base_->Hint(pattern, offset, length);
+    }
+
+private:
+    struct Window {
+        uint64_t offset = 0;
+        size_t len = 0;
+        std::string data;
+        Status status;
+
+        bool Covers(uint64_t off, size_t n) const {
+            return len > 0 && off >= offset && off + n <= offset + len;
+        }
+    };
+
+    // Reads the window following the data already at hand, unless one is
+    // pending or ready.
+    void StartPrefetch() const {
+        if (prefetch_inflight_ || prefetch_.len > 0) {
+            return;
+        }
+        const uint64_t start = current_.Covers(next_offset_, 0)
+                                   ? current_.offset + current_.len : next_offset_;
+        if (start >= file_size_) {
+            return;
+        }
+        prefetch_.offset = start;
+        prefetch_.len = static_cast<size_t>(std::min<uint64_t>(window_size_, file_size_ - start));
+        prefetch_.data.resize(prefetch_.len);
+        prefetch_inflight_ = true;
+        window_size_ = std::min(window_size_ * 2, max_size_);
+
+        IOThreadPool()->Schedule([this] {
+            Status s = base_->Read(prefetch_.offset, prefetch_.len, &prefetch_.data[0]);
+            std::lock_guard<std::mutex> l(mu_);
+            prefetch_.status = s;
+            prefetch_inflight_ = false;
+            cv_.notify_all();
+        });
+    }
+
+    void WaitForPrefetch() const {
+        std::unique_lock<std::mutex> l(mu_);
+        cv_.wait(l, [this] { return !prefetch_inflight_; });
+    }
+
+    const RandomAccessFile* const base_;
+    const uint64_t file_size_;
+    const size_t initial_size_;
+    const size_t max_size_;
+    mutable size_t window_size_;
+    mutable uint64_t next_offset_;
+    mutable int sequential_reads_;
+
+    mutable std::mutex mu_;
+    mutable std::condition_variable cv_;
+    mutable Window current_;
+    // Owned by the I/O thread while prefetch_inflight_ is set.
+    mutable Window prefetch_;
+    mutable bool prefetch_inflight_;
+};
+
+RandomAccessFile* NewAutoReadaheadRandomAccessFile(const RandomAccessFile* base,
+                                                   uint64_t file_size,
+                                                   size_t initial_size,
+                                                   size_t max_size) {
+    return new AutoReadaheadRandomAccessFile(base, file_size, initial_size, max_size);
+}
+
+}
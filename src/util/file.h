@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "lsm/slice.h"
+#include "lsm/status.h"
+
+namespace lsm {
+
+// Offsets, lengths and buffers of direct I/O are multiples of this. 4 KB
+// covers the logical block size of every common device.
+static const size_t kDirectIOAlignment = 4096;
+
+// One read of a RandomAccessFile::MultiRead() batch.
+struct ReadRequest {
+    uint64_t offset = 0;
+    size_t len = 0;
+    char* scratch = nullptr;
+    Status status;
+};
+
+// Positional reads from a file. Thread-safe.
+class RandomAccessFile {
+public:
+    virtual ~RandomAccessFile() = default;
+
+    // Reads exactly n bytes at offset into scratch. Returns IOError on a
+    // short read.
+    virtual Status Read(uint64_t offset, size_t n, char* scratch) const = 0;
+
+    // Reads every request of reqs[0, n), each like Read(), with all of them
+    // in flight at once so the device sees more than one outstanding read.
+    // Buffered files on Linux submit the batch through io_uring; elsewhere,
+    // or where the kernel refuses io_uring, the reads run in parallel on
+    // IOThreadPool().
+    virtual void MultiRead(ReadRequest* reqs, size_t n) const;
+
+    // True if reads bypass the OS page cache.
+    virtual bool use_direct_io() const = 0;
+
+    enum AccessPattern { kNormal, kSequential, kDontNeed };
+
+    // Advises the OS how [offset, offset+length) will be read; length 0
+    // means through the end of the file. A no-op with direct I/O and where
+    // there is no posix_fadvise.
+    virtual void Hint(AccessPattern pattern, uint64_t offset = 0,
+                      uint64_t length = 0) const {
+        (void)pattern;
+        (void)offset;
+        (void)length;
+    }
+};
+
+// Sequential appends to a new file. Not thread-safe.
+class WritableFile {
+public:
+    virtual ~WritableFile() = default;
+
+    virtual Status Append(const Slice& data) = 0;
+
+    // Hands buffered data to the OS. With direct I/O only whole aligned
+    // pages are written; the tail stays buffered until Close().
+    virtual Status Flush() = 0;
+
+    virtual Status Sync() = 0;
+
+    // Writes everything still buffered and closes the file. Idempotent; the
+    // destructor calls it if the owner did not.
+    virtual Status Close() = 0;
+
+    // Bytes appended so far.
+    virtual uint64_t Size() const = 0;
+};
+
+// A fixed-size file read and overwritten in place. Thread-safe, though
+// a Read() racing a Write() to the same bytes may see either version.
+class RandomRWFile {
+public:
+    virtual ~RandomRWFile() = default;
+
+    // Reads exactly n bytes at offset into scratch.
+    virtual Status Read(uint64_t offset, size_t n, char* scratch) const = 0;
+
+    virtual Status Write(uint64_t offset, const Slice& data) = 0;
+
+    virtual Status Sync() = 0;
+};
+
+// Opens fname for reading. With use_direct_io the file is opened with
+// O_DIRECT (F_NOCACHE on macOS) and reads are widened to aligned ranges.
+// Where the platform or file system has no direct I/O, the file is opened
+// buffered instead; see RandomAccessFile::use_direct_io().
+Status NewRandomAccessFile(const std::string& fname, bool use_direct_io,
+                           RandomAccessFile** result);
+
+// Creates (or truncates) fname for writing, with the same direct I/O
+// fallback as NewRandomAccessFile.
+Status NewWritableFile(const std::string& fname, bool use_direct_io,
+                       WritableFile** result);
+
+// Opens fname for positional reads and writes, creating it if missing.
+// A file that is not already size bytes long is resized, and on Linux
+// preallocated, to size and *reused is set to false.
+Status NewRandomRWFile(const std::string& fname, uint64_t size, RandomRWFile** result,
+                       bool* reused);
+
+// Returns a view of base (file_size bytes long) that serves reads from a
+// buffer refilled readahead_size bytes at a time, so a scan costs one read
+// per window instead of one per block. base must outlive the view. Meant
+// for a single sequential reader; not thread-safe. With drop_behind, base
+// is hinted kSequential while the view lives and every window is hinted
+// kDontNeed once the reader moves past it.
+RandomAccessFile* NewReadaheadRandomAccessFile(const RandomAccessFile* base,
+                                               uint64_t file_size,
+                                               size_t readahead_size,
+                                               bool drop_behind);
+
+// Returns a view of base for a single reader that detects sequential access.
+// Once kAutoReadaheadTrigger reads in a row each start where the previous
+// one ended, the bytes after them are prefetched on IOThreadPool(), so the
+// next reads overlap with the caller's work. The prefetch window starts at
+// initial_size and doubles up to max_size while the pattern holds; a read
+// anywhere else (e.g. after a seek) resets it. base must outlive the view.
+static const int kAutoReadaheadTrigger = 2;
+RandomAccessFile* NewAutoReadaheadRandomAccessFile(const RandomAccessFile* base,
+                                                   uint64_t file_size,
+                                                   size_t initial_size,
+                                                   size_t max_size);
+
+}
@@ -59,4 +59,79 @@ uint32_t Hash(const char* data, size_t n, uint32_t seed) {
     return h;
 }
 
+static const uint64_t kPrime64_1 = 0x9E3779B185EBCA87ull;
+static const uint64_t kPrime64_2 = 0xC2B2AE3D27D4EB4Full;
+static const uint64_t kPrime64_3 = 0x165667B19E3779F9ull;
+static const uint64_t kPrime64_4 = 0x85EBCA77C2B2AE63ull;
+static const uint64_t kPrime64_5 = 0x27D4EB2F165667C5ull;
+
+static inline uint64_t Rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t XXH64Round(uint64_t acc, uint64_t input) {
+    acc += input * kPrime64_2;
+    acc = Rotl64(acc, 31);
+    return acc * kPrime64_1;
+}
+
+static inline uint64_t XXH64MergeRound(uint64_t acc, uint64_t val) {
+    acc ^= XXH64Round(0, val);
+    return acc * kPrime64_1 + kPrime64_4;
+}
+
+uint64_t XXHash64(const char* data, size_t n, uint64_t seed) {
+    const char* p = data;
+    const char* const end = data + n;
+    uint64_t h;
+
+    if (n >= 32) {
+        uint64_t v1 = seed + kPrime64_1 + kPrime64_2;
+        uint64_t v2 = seed + kPrime64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - kPrime64_1;
+        const char* const limit = end - 32;
+        do {
+            v1 = XXH64Round(v1, DecodeFixed64(p));
+            v2 = XXH64Round(v2, DecodeFixed64(p + 8));
+            v3 = XXH64Round(v3, DecodeFixed64(p + 16));
+            v4 = XXH64Round(v4, DecodeFixed64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = Rotl64(v1, 1) + Rotl64(v2, 7) + Rotl64(v3, 12) + Rotl64(v4, 18);
+        h = XXH64MergeRound(h, v1);
+        h = XXH64MergeRound(h, v2);
+        h = XXH64MergeRound(h, v3);
+        h = XXH64MergeRound(h, v4);
+    } else {
+        h = seed + kPrime64_5;
+    }
+
+    h += static_cast<uint64_t>(n);
+
+    while (p + 8 <= end) {
+        h ^= XXH64Round(0, DecodeFixed64(p));
+        h = Rotl64(h, 27) * kPrime64_1 + kPrime64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<uint64_t>(DecodeFixed32(p)) * kPrime64_1;
+        h = Rotl64(h, 23) * kPrime64_2 + kPrime64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= static_cast<uint64_t>(static_cast<uint8_t>(*p)) * kPrime64_5;
+        h = Rotl64(h, 11) * kPrime64_1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime64_2;
+    h ^= h >> 29;
+    h *= kPrime64_3;
+    h ^= h >> 32;
+    return h;
+}
+
 }
@@ -7,4 +7,8 @@ namespace lsm {
 
 uint32_t Hash(const char* data, size_t n, uint32_t seed);
 
+// xxHash64 of data[0,n-1]; a fast non-cryptographic checksum alternative
+// to crc32c on CPUs without a crc32 instruction.
+uint64_t XXHash64(const char* data, size_t n, uint64_t seed);
+
 }
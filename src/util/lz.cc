@@ -0,0 +1,179 @@
+#include "src/util/lz.h"
+#include "src/util/coding.h"
+#include <cstdint>
+#include <cstring>
+
+namespace lsm {
+namespace lz {
+
+static const size_t kMinMatch = 4;
+static const int kHashBits = 13;
+static const size_t kMaxOffset = 0xffff;
+
+// Keep the tail of the input as literals so a decoder never needs to read
+// past a match; mirrors the LZ4 end-of-block rules.
+static const size_t kLastLiterals = 5;
+static const size_t kMatchSearchMargin = 12;
+
+static inline uint32_t Load32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t HashBytes(uint32_t v) {
+    return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+static void PutLengthExtension(std::string* dst, size_t len) {
+    while (len >= 255) {
+        dst->push_back(static_cast<char>(255));
+        len -= 255;
+    }
+    dst->push_back(static_cast<char>(len));
+}
+
+static void EmitSequence(std::string* dst, const uint8_t* literals, size_t lit_len,
+                         size_t offset, size_t match_len) {
+    const size_t ml = match_len - kMinMatch;
+    const uint8_t token = static_cast<uint8_t>(((lit_len < 15 ? lit_len : 15) << 4) |
+                                               (ml < 15 ? ml : 15));
+    dst->push_back(static_cast<char>(token));
+    if (lit_len >= 15) PutLengthExtension(dst, lit_len - 15);
+    dst->append(reinterpret_cast<const char*>(literals), lit_len);
+    dst->push_back(static_cast<char>(offset & 0xff));
+    dst->push_back(static_cast<char>(offset >> 8));
+    if (ml >= 15) PutLengthExtension(dst, ml - 15);
+}
+
+static void EmitLastLiterals(std::string* dst, const uint8_t* literals, size_t lit_len) {
+    const uint8_t token = static_cast<uint8_t>((lit_len < 15 ? lit_len : 15) << 4);
+    dst->push_back(static_cast<char>(token));
+    if (lit_len >= 15) PutLengthExtension(dst, lit_len - 15);
+    dst->append(reinterpret_cast<const char*>(literals), lit_len);
+}
+
+void Compress(const char* input, size_t n, std::string* output) {
+    output->clear();
+    output->reserve(n + n / 255 + 16);
+    PutVarint32(output, static_cast<uint32_t>(n));
+
+    const uint8_t* const base = reinterpret_cast<const uint8_t*>(input);
+    const uint8_t* const end = base + n;
+    const uint8_t* anchor = base;
+
+    if (n > kMatchSearchMargin) {
+        const uint8_t* const match_limit = end - kLastLiterals;
+        const uint8_t* const search_limit = end - kMatchSearchMargin;
+        uint32_t table[1 << kHashBits];
+        std::memset(table, 0, sizeof(table));
+
+        const uint8_t* ip = base + 1;
+        // Skip ahead faster through incompressible stretches.
+        size_t misses = 0;
+        while (ip < search_limit) {
+            const uint32_t seq = Load32(ip);
+            const uint32_t h = HashBytes(seq);
+            const uint8_t* candidate = base + table[h];
+            table[h] = static_cast<uint32_t>(ip - base);
+
+            if (candidate < ip && static_cast<size_t>(ip - candidate) <= kMaxOffset &&
+                Load32(candidate) == seq) {
+                // Extend backwards over pending literals, then forwards.
+                while (ip > anchor && candidate > base && ip[-1] == candidate[-1]) {
+                    ip--;
+                    candidate--;
+                }
+                size_t match_len = kMinMatch;
+                while (ip + match_len < match_limit &&
+                       ip[match_len] == candidate[match_len]) {
+                    match_len++;
+                }
+                EmitSequence(output, anchor, ip - anchor, ip - candidate, match_len);
+                ip += match_len;
+                anchor = ip;
+                misses = 0;
+                if (ip < search_limit) {
+                    table[HashBytes(Load32(ip - 2))] = static_cast<uint32_t>(ip - 2 - base);
+                }
+            } else {
+                ip += 1 + (misses++ >> 6);
+            }
+        }
+    }
+
+    EmitLastLiterals(output, anchor, end - anchor);
+}
+
+bool GetUncompressedLength(const char* input, size_t n, size_t* result) {
+    uint32_t len;
+    if (GetVarint32Ptr(input, input + n, &len) == nullptr) {
+        return false;
+    }
+    *result = len;
+    return true;
+}
+
+static bool GetLengthExtension(const uint8_t** ip, const uint8_t* end, size_t* len) {
+    uint8_t b;
+    do {
+        if (*ip >= end) return false;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+bool Uncompress(const char* input, size_t n, char* output) {
+    uint32_t expected;
+    const char* start = GetVarint32Ptr(input, input + n, &expected);
+    if (start == nullptr) {
+        return false;
+    }
+
+    const uint8_t* ip = reinterpret_cast<const uint8_t*>(start);
+    const uint8_t* const end = reinterpret_cast<const uint8_t*>(input + n);
+    uint8_t* const out = reinterpret_cast<uint8_t*>(output);
+    uint8_t* op = out;
+    uint8_t* const out_end = out + expected;
+
+    while (ip < end) {
+        const uint8_t token = *ip++;
+
+        size_t lit_len = token >> 4;
+        if (lit_len == 15 && !GetLengthExtension(&ip, end, &lit_len)) return false;
+        if (lit_len > static_cast<size_t>(end - ip) ||
+            lit_len > static_cast<size_t>(out_end - op)) {
+            return false;
+        }
+        std::memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+        if (ip == end) break;
+
+        if (end - ip < 2) return false;
+        const size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - out)) return false;
+
+        size_t match_len = token & 0xf;
+        if (match_len == 15 && !GetLengthExtension(&ip, end, &match_len)) return false;
+        match_len += kMinMatch;
+        if (match_len > static_cast<size_t>(out_end - op)) return false;
+
+        const uint8_t* match = op - offset;
+        if (offset >= match_len) {
+            std::memcpy(op, match, match_len);
+            op += match_len;
+        } else {
+            // Overlapping copy replicates the last "offset" bytes.
+            for (size_t i = 0; i < match_len; i++) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return op == out_end;
+}
+
+}
+}
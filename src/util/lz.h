@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace lsm {
+namespace lz {
+
+// A dependency-free LZ77 block compressor tuned for speed over ratio.
+// Compressed form: varint32 uncompressed length, then a sequence of
+// [token][literal length ext][literals][offset:2][match length ext] groups
+// in the LZ4 block layout. Matches reach back at most 64 KB.
+
+// Replaces *output with the compressed form of input[0,n-1].
+void Compress(const char* input, size_t n, std::string* output);
+
+// Stores the uncompressed length recorded in a compressed buffer.
+// Returns false if the header is malformed.
+bool GetUncompressedLength(const char* input, size_t n, size_t* result);
+
+// Decompresses input[0,n-1] into output, which must have room for
+// GetUncompressedLength() bytes. Returns false on malformed input.
+bool Uncompress(const char* input, size_t n, char* output);
+
+}
+}
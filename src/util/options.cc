@@ -7,4 +7,15 @@ Options::Options()
     : comparator(BytewiseComparator()) {
 }
 
+Options::CompressionType Options::CompressionForLevel(int level) const {
+    if (compression_per_level.empty()) {
+        return compression;
+    }
+    if (level < 0) {
+        level = 0;
+    }
+    const size_t n = compression_per_level.size();
+    return compression_per_level[static_cast<size_t>(level) < n ? level : n - 1];
+}
+
 }
@@ -0,0 +1,279 @@
+#include "src/util/persistent_cache.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include "src/util/coding.h"
+#include "src/util/crc32.h"
+#include "src/util/file.h"
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define mkdir(dir, mode) _mkdir(dir)
+#endif
+
+namespace lsm {
+
+// Record: fixed32 masked crc of the rest, fixed32 key length, fixed32
+// contents length, key, contents.
+static const size_t kRecordHeaderSize = 12;
+
+// Index checkpoint: fixed64 magic, fixed64 capacity, fixed64 head, then
+// per record, oldest first, varint32 key length, key, fixed64 offset and
+// fixed32 size; finally fixed32 masked crc of everything before it.
+static const uint64_t kIndexMagic = 0x70636163686531ull;
+
+static std::string DataFileName(const std::string& dir) {
+    return dir + "/CACHE";
+}
+
+static std::string IndexFileName(const std::string& dir) {
+    return dir + "/INDEX";
+}
+
+Status PersistentCache::Open(const std::string& dir, uint64_t capacity,
+                             PersistentCache** result) {
+    *result = nullptr;
+    if (capacity < kWriteBufferSize) {
+        return Status::InvalidArgument(dir, "persistent cache smaller than its write buffer");
+    }
+    struct stat st;
+    if (stat(dir.c_str(), &st) != 0) {
+        mkdir(dir.c_str(), 0755);
+    }
+    RandomRWFile* file = nullptr;
+    bool reused = false;
+    Status s = NewRandomRWFile(DataFileName(dir), capacity, &file, &reused);
+    if (!s.ok()) {
+        return s;
+    }
+    PersistentCache* cache = new PersistentCache(dir, capacity, file);
+    if (reused) {
+        // A missing or stale checkpoint just means starting cold.
+        cache->LoadIndex();
+    }
+    *result = cache;
+    return Status::OK();
+}
+
+PersistentCache::PersistentCache(const std::string& dir, uint64_t capacity, RandomRWFile* file)
+    : dir_(dir), capacity_(capacity), file_(file), head_(0), buffer_offset_(0) {}
+
+PersistentCache::~PersistentCache() {
+    Checkpoint();
+    delete file_;
+}
+
+Status PersistentCache::LoadIndex() {
+    std::ifstream in(IndexFileName(dir_), std::ios::binary);
+    if (!in) {
+        return Status::NotFound(IndexFileName(dir_));
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (data.size() < 28 ||
+        crc32c::Unmask(DecodeFixed32(data.data() + data.size() - 4)) !=
+            crc32c::Value(data.data(), data.size() - 4)) {
+        return Status::Corruption(IndexFileName(dir_), "bad checksum");
+    }
+    Slice input(data.data(), data.size() - 4);
+    if (DecodeFixed64(input.data()) != kIndexMagic ||
+        DecodeFixed64(input.data() + 8) != capacity_) {
+        return Status::Corruption(IndexFileName(dir_), "not an index for this cache");
+    }
+    const uint64_t head = DecodeFixed64(input.data() + 16);
+    input.remove_prefix(24);
+    std::unordered_map<std::string, Record> index;
+    std::deque<std::pair<uint64_t, std::string>> log;
+    while (!input.empty()) {
+        Slice key;
+        if (!GetLengthPrefixedSlice(&input, &key) || input.size() < 12) {
+            return Status::Corruption(IndexFileName(dir_), "truncated record");
+        }
+        Record r;
+        r.offset = DecodeFixed64(input.data());
+        r.size = DecodeFixed32(input.data() + 8);
+        input.remove_prefix(12);
+        if (r.offset + r.size > capacity_) {
+            return Status::Corruption(IndexFileName(dir_), "record past the end of the cache");
+        }
+        index[key.ToString()] = r;
+        log.emplace_back(r.offset, key.ToString());
+    }
+    std::lock_guard<std::mutex> l(mu_);
+    index_.swap(index);
+    log_.swap(log);
+    head_ = head;
+    buffer_offset_ = head;
+    return Status::OK();
+}
+
+Status PersistentCache::Checkpoint() {
+    std::string data;
+    {
+        std::lock_guard<std::mutex> l(mu_);
+        Status s = FlushBuffer();
+        if (s.ok()) {
+            s = file_->Sync();
+        }
+        if (!s.ok()) {
+            return s;
+        }
+        PutFixed64(&data, kIndexMagic);
+        PutFixed64(&data, capacity_);
+        PutFixed64(&data, head_);
+        for (const auto& entry : log_) {
+            auto it = index_.find(entry.second);
+            if (it == index_.end() || it->second.offset != entry.first) {
+                continue;
+            }
+            PutLengthPrefixedSlice(&data, entry.second);
+            PutFixed64(&data, it->second.offset);
+            PutFixed32(&data, it->second.size);
+        }
+    }
+    PutFixed32(&data, crc32c::Mask(crc32c::Value(data.data(), data.size())));
+
+    const std::string fname = IndexFileName(dir_);
+    const std::string tmp = fname + ".tmp";
+    WritableFile* out = nullptr;
+    Status s = NewWritableFile(tmp, false, &out);
+    if (!s.ok()) {
+        return s;
+    }
+    s = out->Append(data);
+    if (s.ok()) {
+        s = out->Sync();
+    }
+    if (s.ok()) {
+        s = out->Close();
+    }
+    delete out;
+    if (s.ok()) {
+#ifdef _WIN32
+        std::remove(fname.c_str());
+#endif
+        if (std::rename(tmp.c_str(), fname.c_str()) != 0) {
+            s = Status::IOError(tmp, "rename failed");
+        }
+    }
+    return s;
+}
+
+Status PersistentCache::FlushBuffer() {
+    if (buffer_.empty()) {
+        return Status::OK();
+    }
+    Status s = file_->Write(buffer_offset_, buffer_);
+    buffer_offset_ += buffer_.size();
+    buffer_.clear();
+    return s;
+}
+
+void PersistentCache::DropOldest() {
+    auto it = index_.find(log_.front().second);
+    if (it != index_.end() && it->second.offset == log_.front().first) {
+        index_.erase(it);
+    }
+    log_.pop_front();
+}
+
+void PersistentCache::Insert(const Slice& key, const Slice& contents) {
+    const uint64_t size = kRecordHeaderSize + key.size() + contents.size();
+    if (size > kWriteBufferSize) {
+        return;
+    }
+    std::lock_guard<std::mutex> l(mu_);
+    if (index_.count(key.ToString()) != 0) {
+        return;
+    }
+    if (head_ + size > capacity_) {
+        // Wrap around; everything left past head_ is the oldest data.
+        if (!FlushBuffer().ok()) {
+            return;
+        }
+        while (!log_.empty() && log_.front().first >= head_) {
+            DropOldest();
+        }
+        head_ = 0;
+        buffer_offset_ = 0;
+    }
+    while (!log_.empty() && log_.front().first >= head_ && log_.front().first < head_ + size) {
+        DropOldest();
+    }
+
+    char header[kRecordHeaderSize];
+    EncodeFixed32(header + 4, static_cast<uint32_t>(key.size()));
+    EncodeFixed32(header + 8, static_cast<uint32_t>(contents.size()));
+    uint32_t crc = crc32c::Value(header + 4, 8);
+    crc = crc32c::Extend(crc, key.data(), key.size());
+    crc = crc32c::Extend(crc, contents.data(), contents.size());
+    EncodeFixed32(header, crc32c::Mask(crc));
+    buffer_.append(header, sizeof(header));
+    buffer_.append(key.data(), key.size());
+    buffer_.append(contents.data(), contents.size());
+
+    Record r;
+    r.offset = head_;
+    r.size = static_cast<uint32_t>(size);
+    index_[key.ToString()] = r;
+    log_.emplace_back(head_, key.ToString());
+    head_ += size;
+    if (buffer_.size() >= kWriteBufferSize) {
+        FlushBuffer();
+    }
+}
+
+bool PersistentCache::DecodeRecord(const Slice& key, const char* record, size_t size,
+                                   char** contents, size_t* n) {
+    if (size < kRecordHeaderSize) {
+        return false;
+    }
+    const uint32_t key_size = DecodeFixed32(record + 4);
+    const uint32_t contents_size = DecodeFixed32(record + 8);
+    if (kRecordHeaderSize + key_size + contents_size != size ||
+        crc32c::Unmask(DecodeFixed32(record)) != crc32c::Value(record + 4, size - 4) ||
+        Slice(record + kRecordHeaderSize, key_size) != key) {
+        return false;
+    }
+    *contents = new char[contents_size];
+    memcpy(*contents, record + kRecordHeaderSize + key_size, contents_size);
+    *n = contents_size;
+    return true;
+}
+
+bool PersistentCache::Lookup(const Slice& key, char** contents, size_t* n) {
+    Record r;
+    {
+        std::lock_guard<std::mutex> l(mu_);
+        auto it = index_.find(key.ToString());
+        if (it == index_.end()) {
+            return false;
+        }
+        r = it->second;
+        if (r.offset >= buffer_offset_ && r.offset < buffer_offset_ + buffer_.size()) {
+            return DecodeRecord(key, buffer_.data() + (r.offset - buffer_offset_), r.size,
+                                contents, n);
+        }
+    }
+
+    // The record may be overwritten while it is read; the crc catches that.
+    std::string record(r.size, '\0');
+    if (file_->Read(r.offset, r.size, &record[0]).ok() &&
+        DecodeRecord(key, record.data(), record.size(), contents, n)) {
+        return true;
+    }
+    std::lock_guard<std::mutex> l(mu_);
+    auto it = index_.find(key.ToString());
+    if (it != index_.end() && it->second.offset == r.offset) {
+        index_.erase(it);
+    }
+    return false;
+}
+
+size_t PersistentCache::NumEntries() const {
+    std::lock_guard<std::mutex> l(mu_);
+    return index_.size();
+}
+
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include "lsm/slice.h"
+#include "lsm/status.h"
+
+namespace lsm {
+
+class RandomRWFile;
+
+// A block cache tier on a fast local device, for tables on slower storage.
+// Blocks are appended to a log that wraps around a preallocated data file;
+// an in-memory index maps each key to its record, and the oldest records
+// are dropped as the log overwrites them. Appends collect in a write buffer
+// and reach the file kWriteBufferSize bytes at a time. Every record carries
+// a CRC of its key and contents, so a record overwritten under a reader, or
+// changed since the index was saved, reads as a miss, never as wrong data.
+// The index is checkpointed on Checkpoint() and on destruction, and reloaded
+// by Open(), so the cache survives restarts. Thread-safe.
+class PersistentCache {
+public:
+    // Opens the cache kept in dir, which is created if missing, with a data
+    // file of capacity bytes. The index checkpoint is reloaded if it matches
+    // the data file; otherwise the cache starts empty.
+    static Status Open(const std::string& dir, uint64_t capacity, PersistentCache** result);
+
+    ~PersistentCache();
+
+    PersistentCache(const PersistentCache&) = delete;
+    PersistentCache& operator=(const PersistentCache&) = delete;
+
+    // Appends contents under key. Keys name immutable blocks, so a key
+    // already cached is left alone.
+    void Insert(const Slice& key, const Slice& contents);
+
+    // On a hit, sets *contents to a new[] buffer of the *n bytes stored
+    // under key, which the caller owns, and returns true.
+    bool Lookup(const Slice& key, char** contents, size_t* n);
+
+    // Writes out the write buffer and saves the index, so that a later
+    // Open() finds everything cached so far.
+    Status Checkpoint();
+
+    // Blocks currently indexed.
+    size_t NumEntries() const;
+
+private:
+    static const size_t kWriteBufferSize = 256 * 1024;
+
+    struct Record {
+        uint64_t offset;
+        uint32_t size;
+    };
+
+    PersistentCache(const std::string& dir, uint64_t capacity, RandomRWFile* file);
+
+    Status LoadIndex();
+    // Writes buffer_ at buffer_offset_. REQUIRES: mu_ held.
+    Status FlushBuffer();
+    // Drops the oldest record. REQUIRES: mu_ held.
+    void DropOldest();
+    // Checks a record read back for key and copies its contents out.
+    static bool DecodeRecord(const Slice& key, const char* record, size_t size,
+                             char** contents, size_t* n);
+
+    const std::string dir_;
+    const uint64_t capacity_;
+    RandomRWFile* const file_;
+
+    mutable std::mutex mu_;
+    std::unordered_map<std::string, Record> index_;
+    // Offsets and keys of the records written, oldest first; that is also
+    // file order, starting at head_. A key whose index_ entry is elsewhere
+    // was dropped after a failed read.
+    std::deque<std::pair<uint64_t, std::string>> log_;
+    // Where the next record goes.
+    uint64_t head_;
+    // Records appended but not yet written, which belong at buffer_offset_.
+    std::string buffer_;
+    uint64_t buffer_offset_;
+};
+
+}
@@ -0,0 +1,65 @@
+#include "src/util/secondary_cache.h"
+#include <string>
+#include "lsm/cache.h"
+#include "src/util/lz.h"
+
+namespace lsm {
+
+static void DeleteCompressed(const Slice& /*key*/, void* value) {
+    delete reinterpret_cast<std::string*>(value);
+}
+
+CompressedSecondaryCache::CompressedSecondaryCache(size_t capacity)
+    : cache_(NewLRUCache(capacity)), closed_(false) {}
+
+CompressedSecondaryCache::~CompressedSecondaryCache() {
+    delete cache_;
+}
+
+void CompressedSecondaryCache::Insert(const Slice& key, const Slice& contents) {
+    if (closed_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    std::string* compressed = new std::string;
+    lz::Compress(contents.data(), contents.size(), compressed);
+    compressed->shrink_to_fit();
+    cache_->Release(cache_->Insert(key, compressed, compressed->size(), &DeleteCompressed));
+}
+
+bool CompressedSecondaryCache::Lookup(const Slice& key, char** contents, size_t* n) {
+    Cache::Handle* h = cache_->Lookup(key);
+    if (h == nullptr) {
+        return false;
+    }
+    const std::string* compressed = reinterpret_cast<std::string*>(cache_->Value(h));
+    size_t ulength = 0;
+    bool ok = lz::GetUncompressedLength(compressed->data(), compressed->size(), &ulength);
+    char* buf = nullptr;
+    if (ok) {
+        buf = new char[ulength];
+        ok = lz::Uncompress(compressed->data(), compressed->size(), buf);
+    }
+    cache_->Release(h);
+    if (!ok) {
+        delete[] buf;
+        cache_->Erase(key);
+        return false;
+    }
+    *contents = buf;
+    *n = ulength;
+    return true;
+}
+
+void CompressedSecondaryCache::Erase(const Slice& key) {
+    cache_->Erase(key);
+}
+
+void CompressedSecondaryCache::Close() {
+    closed_.store(true, std::memory_order_relaxed);
+}
+
+size_t CompressedSecondaryCache::TotalCharge() const {
+    return cache_->TotalCharge();
+}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include "lsm/slice.h"
+
+namespace lsm {
+
+class Cache;
+
+// A second block cache tier holding lz-compressed copies of the blocks the
+// primary block cache evicts. A block compresses to a third or half of its
+// size, so the same memory holds several times as many blocks as it would
+// uncompressed, and a hit costs a decompression instead of a file read.
+// Entries are kept in a sharded LRU cache charged at their compressed size.
+// Thread-safe.
+class CompressedSecondaryCache {
+public:
+    explicit CompressedSecondaryCache(size_t capacity);
+    ~CompressedSecondaryCache();
+
+    CompressedSecondaryCache(const CompressedSecondaryCache&) = delete;
+    CompressedSecondaryCache& operator=(const CompressedSecondaryCache&) = delete;
+
+    // Compresses contents and stores them under key, replacing any entry
+    // already there. A no-op after Close().
+    void Insert(const Slice& key, const Slice& contents);
+
+    // On a hit, sets *contents to a new[] buffer of the *n uncompressed bytes
+    // stored under key, which the caller owns, and returns true.
+    bool Lookup(const Slice& key, char** contents, size_t* n);
+
+    void Erase(const Slice& key);
+
+    // Stops accepting inserts. Called before the primary cache is destroyed,
+    // so that its teardown does not compress every block it still holds.
+    void Close();
+
+    // Compressed bytes held.
+    size_t TotalCharge() const;
+
+private:
+    Cache* cache_;
+    std::atomic<bool> closed_;
+};
+
+}
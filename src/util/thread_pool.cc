@@ -0,0 +1,51 @@
+#include "src/util/thread_pool.h"
+
+namespace lsm {
+
+ThreadPool::ThreadPool(int num_threads) : stop_(false) {
+    for (int i = 0; i < num_threads; i++) {
+        workers_.emplace_back([this] { WorkerMain(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> l(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : workers_) {
+        t.join();
+    }
+}
+
+void ThreadPool::Schedule(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> l(mu_);
+        queue_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+void ThreadPool::WorkerMain() {
+    std::unique_lock<std::mutex> l(mu_);
+    while (true) {
+        cv_.wait(l, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+        std::function<void()> task = std::move(queue_.front());
+        queue_.pop_front();
+        l.unlock();
+        task();
+        l.lock();
+    }
+}
+
+ThreadPool* IOThreadPool() {
+    static const int kIOThreads = 4;
+    static ThreadPool pool(kIOThreads);
+    return &pool;
+}
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lsm {
+
+// Fixed set of worker threads running queued tasks in FIFO order. The
+// destructor runs every queued task before joining.
+class ThreadPool {
+public:
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void Schedule(std::function<void()> task);
+
+private:
+    void WorkerMain();
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> queue_;
+    bool stop_;
+    std::vector<std::thread> workers_;
+};
+
+// Process-wide pool for background reads (prefetching), created on first
+// use. Small tasks only: nothing queued here may block on another task.
+ThreadPool* IOThreadPool();
+
+}
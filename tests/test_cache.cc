@@ -0,0 +1,286 @@
+#include <gtest/gtest.h>
+#include "lsm/cache.h"
+#include "src/util/coding.h"
+#include "src/util/persistent_cache.h"
+#include "src/util/secondary_cache.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace lsm;
+
+static std::string Key(int k) {
+    std::string result;
+    PutFixed64(&result, static_cast<uint64_t>(k));
+    return result;
+}
+
+static void NoopDeleter(const Slice& /*key*/, void* /*value*/) {}
+
+static void InsertAndRelease(Cache* cache, int k, Cache::Priority priority) {
+    cache->Release(cache->Insert(Key(k), nullptr, 1, &NoopDeleter, priority));
+}
+
+static bool Contains(Cache* cache, int k) {
+    Cache::Handle* h = cache->Lookup(Key(k));
+    if (h == nullptr) {
+        return false;
+    }
+    cache->Release(h);
+    return true;
+}
+
+// Hot entries that were hit, or inserted at high priority, survive a scan
+// of low-priority entries many times the cache size.
+TEST(CacheTest, HighPriorityPoolResistsScans) {
+    const int kHot = 200;
+    const int kScan = 20000;
+    for (double ratio : {0.0, 0.5}) {
+        std::unique_ptr<Cache> cache(NewLRUCache(1600, ratio));
+        for (int i = 0; i < kHot; i++) {
+            InsertAndRelease(cache.get(), i, Cache::Priority::kLow);
+            ASSERT_TRUE(Contains(cache.get(), i));
+        }
+        for (int i = kHot; i < 2 * kHot; i++) {
+            InsertAndRelease(cache.get(), i, Cache::Priority::kHigh);
+        }
+        for (int i = 0; i < kScan; i++) {
+            InsertAndRelease(cache.get(), 1000000 + i, Cache::Priority::kLow);
+        }
+        ASSERT_LE(cache->TotalCharge(), 1600u);
+
+        int survivors = 0;
+        for (int i = 0; i < 2 * kHot; i++) {
+            survivors += Contains(cache.get(), i) ? 1 : 0;
+        }
+        if (ratio > 0) {
+            ASSERT_EQ(2 * kHot, survivors);
+        } else {
+            ASSERT_EQ(0, survivors);
+        }
+    }
+}
+
+// Without scans in the way, low-priority entries still use the whole cache,
+// and high-priority ones overflowing their pool are demoted, not dropped.
+TEST(CacheTest, PoolsShareCapacity) {
+    std::unique_ptr<Cache> cache(NewLRUCache(1600, 0.5));
+    for (int i = 0; i < 1000; i++) {
+        InsertAndRelease(cache.get(), i, Cache::Priority::kHigh);
+    }
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_TRUE(Contains(cache.get(), i));
+    }
+    ASSERT_EQ(1000u, cache->TotalCharge());
+
+    // Erasing from either pool keeps the accounting straight.
+    for (int i = 0; i < 1000; i += 2) {
+        cache->Erase(Key(i));
+    }
+    ASSERT_EQ(500u, cache->TotalCharge());
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_EQ(i % 2 == 1, Contains(cache.get(), i));
+    }
+}
+
+TEST(CacheTest, ClockCacheBasics) {
+    std::unique_ptr<Cache> cache(NewClockCache(1600, 1));
+    int values[100];
+    for (int i = 0; i < 100; i++) {
+        values[i] = i * 3;
+        cache->Release(cache->Insert(Key(i), &values[i], 1, &NoopDeleter));
+    }
+    ASSERT_EQ(100u, cache->TotalCharge());
+    for (int i = 0; i < 100; i++) {
+        Cache::Handle* h = cache->Lookup(Key(i));
+        ASSERT_TRUE(h != nullptr);
+        ASSERT_EQ(i * 3, *reinterpret_cast<int*>(cache->Value(h)));
+        cache->Release(h);
+    }
+
+    // Replacing or erasing an entry a client still holds keeps it alive
+    // until the client releases it.
+    Cache::Handle* held = cache->Lookup(Key(7));
+    int replacement = -1;
+    cache->Release(cache->Insert(Key(7), &replacement, 1, &NoopDeleter));
+    ASSERT_EQ(21, *reinterpret_cast<int*>(cache->Value(held)));
+    Cache::Handle* h = cache->Lookup(Key(7));
+    ASSERT_EQ(-1, *reinterpret_cast<int*>(cache->Value(h)));
+    cache->Release(h);
+    cache->Erase(Key(7));
+    ASSERT_FALSE(Contains(cache.get(), 7));
+    cache->Release(held);
+    ASSERT_EQ(99u, cache->TotalCharge());
+
+    // Far more inserts than capacity: usage stays bounded.
+    for (int i = 1000; i < 20000; i++) {
+        InsertAndRelease(cache.get(), i, Cache::Priority::kLow);
+    }
+    ASSERT_LE(cache->TotalCharge(), 1600u);
+    cache->Prune();
+}
+
+// Every entry is visited once, pinned or not, with its insertion priority.
+TEST(CacheTest, ApplyToAllEntries) {
+    std::unique_ptr<Cache> lru(NewLRUCache(1000, 0.5));
+    std::unique_ptr<Cache> clock(NewClockCache(1000, 1));
+    for (Cache* cache : {lru.get(), clock.get()}) {
+        for (int k = 0; k < 100; k++) {
+            InsertAndRelease(cache, k, k % 2 == 0 ? Cache::Priority::kHigh
+                                                  : Cache::Priority::kLow);
+        }
+        Cache::Handle* pinned = cache->Lookup(Key(7));
+        std::vector<int> seen(100, 0);
+        cache->ApplyToAllEntries([&](const Slice& key, void* /*value*/, size_t charge,
+                                     void (*deleter)(const Slice&, void*),
+                                     Cache::Priority priority) {
+            const int k = static_cast<int>(DecodeFixed64(key.data()));
+            ASSERT_LT(k, 100);
+            ASSERT_EQ(1u, charge);
+            ASSERT_EQ(&NoopDeleter, deleter);
+            if (k % 2 == 0) {
+                ASSERT_EQ(Cache::Priority::kHigh, priority);
+            } else if (k != 7) {
+                ASSERT_EQ(Cache::Priority::kLow, priority);
+            }
+            seen[k]++;
+        });
+        cache->Release(pinned);
+        for (int k = 0; k < 100; k++) {
+            ASSERT_EQ(1, seen[k]) << k;
+        }
+    }
+}
+
+static std::atomic<int> live_values(0);
+
+static void CountingDeleter(const Slice& /*key*/, void* value) {
+    delete reinterpret_cast<std::string*>(value);
+    live_values.fetch_sub(1);
+}
+
+// Readers, writers and erasers race on a small key space. Every value a
+// reader sees matches its key, and every value is deleted exactly once.
+TEST(CacheTest, ClockCacheConcurrentAccess) {
+    live_values = 0;
+    {
+        std::unique_ptr<Cache> cache(NewClockCache(256, 1));
+        std::vector<std::thread> threads;
+        std::atomic<bool> failed(false);
+        for (int t = 0; t < 8; t++) {
+            threads.emplace_back([&, t] {
+                uint32_t seed = 301 + t;
+                for (int i = 0; i < 20000; i++) {
+                    seed = seed * 1103515245 + 12345;
+                    const int k = (seed >> 8) % 512;
+                    const int op = (seed >> 20) % 10;
+                    if (op < 7) {
+                        Cache::Handle* h = cache->Lookup(Key(k));
+                        if (h != nullptr) {
+                            if (*reinterpret_cast<std::string*>(cache->Value(h)) !=
+                                std::to_string(k)) {
+                                failed = true;
+                            }
+                            cache->Release(h);
+                        }
+                    } else if (op < 9) {
+                        live_values.fetch_add(1);
+                        cache->Release(cache->Insert(Key(k), new std::string(std::to_string(k)),
+                                                     1, &CountingDeleter,
+                                                     (op == 7) ? Cache::Priority::kHigh
+                                                               : Cache::Priority::kLow));
+                    } else {
+                        cache->Erase(Key(k));
+                    }
+                }
+            });
+        }
+        for (auto& th : threads) {
+            th.join();
+        }
+        ASSERT_FALSE(failed.load());
+        ASSERT_LE(cache->TotalCharge(), 256u);
+    }
+    ASSERT_EQ(0, live_values.load());
+}
+
+TEST(CacheTest, CompressedSecondaryCache) {
+    CompressedSecondaryCache cache(64 * 1024);
+    std::string contents;
+    for (int i = 0; i < 400; i++) {
+        contents += "key" + std::to_string(i) + "value" + std::string(10, 'v');
+    }
+    cache.Insert(Key(1), contents);
+    ASSERT_LT(cache.TotalCharge(), contents.size() / 2);
+
+    char* buf = nullptr;
+    size_t n = 0;
+    ASSERT_TRUE(cache.Lookup(Key(1), &buf, &n));
+    ASSERT_EQ(contents, std::string(buf, n));
+    delete[] buf;
+    ASSERT_FALSE(cache.Lookup(Key(2), &buf, &n));
+
+    cache.Erase(Key(1));
+    ASSERT_FALSE(cache.Lookup(Key(1), &buf, &n));
+    cache.Close();
+    cache.Insert(Key(3), contents);
+    ASSERT_EQ(0u, cache.TotalCharge());
+}
+
+static void RemoveDir(const std::string& dir) {
+#ifdef _WIN32
+    system(("rmdir /S /Q " + dir).c_str());
+#else
+    system(("rm -rf " + dir).c_str());
+#endif
+}
+
+static std::string BlockContents(int k) {
+    return std::string(1000 + k % 500, static_cast<char>('a' + k % 26));
+}
+
+// The log wraps around the file, dropping the oldest blocks, and the index
+// survives a reopen.
+TEST(CacheTest, PersistentCache) {
+    const std::string dir = "test_persistent_cache_dir";
+    RemoveDir(dir);
+    const uint64_t kCapacity = 1024 * 1024;
+    const int kNumBlocks = 2000;
+
+    PersistentCache* cache = nullptr;
+    ASSERT_TRUE(PersistentCache::Open(dir, kCapacity, &cache).ok());
+    for (int i = 0; i < kNumBlocks; i++) {
+        cache->Insert(Key(i), BlockContents(i));
+    }
+    const size_t entries = cache->NumEntries();
+    ASSERT_GT(entries, 300u);
+    ASSERT_LT(entries, static_cast<size_t>(kNumBlocks));
+
+    auto check = [&](PersistentCache* c) {
+        for (int i = 0; i < kNumBlocks; i++) {
+            char* buf = nullptr;
+            size_t n = 0;
+            const bool hit = c->Lookup(Key(i), &buf, &n);
+            ASSERT_EQ(i >= kNumBlocks - static_cast<int>(entries), hit) << i;
+            if (hit) {
+                ASSERT_EQ(BlockContents(i), std::string(buf, n));
+                delete[] buf;
+            }
+        }
+    };
+    check(cache);
+    delete cache;
+
+    ASSERT_TRUE(PersistentCache::Open(dir, kCapacity, &cache).ok());
+    ASSERT_EQ(entries, cache->NumEntries());
+    check(cache);
+    delete cache;
+
+    // A different size starts over.
+    ASSERT_TRUE(PersistentCache::Open(dir, 2 * kCapacity, &cache).ok());
+    ASSERT_EQ(0u, cache->NumEntries());
+    delete cache;
+    RemoveDir(dir);
+}
@@ -1,8 +1,13 @@
 #include <gtest/gtest.h>
 #include "lsm/db.h"
 #include "lsm/options.h"
+#include "lsm/sst_file_writer.h"
 #include "lsm/status.h"
+#include <chrono>
+#include <map>
+#include <random>
 #include <string>
+#include <thread>
 
 using namespace lsm;
 
@@ -56,3 +61,496 @@ TEST_F(CompactionTest, BulkWriteTrigger) {
         ASSERT_EQ(200, value.size());
     }
 }
+
+TEST_F(CompactionTest, TablePropertiesOfLiveFiles) {
+    WriteOptions wo;
+    for (int i = 0; i < 2000; ++i) {
+        ASSERT_TRUE(db_->Put(wo, "key" + std::to_string(i), std::string(200, 'x')).ok());
+    }
+
+    TablePropertiesCollection props;
+    ASSERT_TRUE(db_->GetPropertiesOfAllTables(&props).ok());
+    ASSERT_FALSE(props.empty());
+    uint64_t entries = 0;
+    for (const auto& kv : props) {
+        const TableProperties& p = kv.second;
+        ASSERT_GT(p.num_entries, 0u);
+        ASSERT_EQ(0u, p.num_deletions);
+        ASSERT_EQ(p.num_entries * 200, p.raw_value_size);
+        ASSERT_LE(p.smallest_seqno, p.largest_seqno);
+        ASSERT_GT(p.data_size, 0u);
+        ASSERT_GT(p.creation_time, 0u);
+        entries += p.num_entries;
+    }
+    ASSERT_LE(entries, 2000u);
+}
+
+TEST_F(CompactionTest, LongKeysStayOrdered) {
+    // User keys longer than an internal key trailer exercise the compaction
+    // merge ordering beyond the first 8 bytes.
+    WriteOptions wo;
+    ReadOptions ro;
+    char buf[32];
+    for (int i = 0; i < 3000; ++i) {
+        snprintf(buf, sizeof(buf), "user_key_%06d", (i * 7919) % 3000);
+        ASSERT_TRUE(db_->Put(wo, buf, std::string(100, 'v')).ok());
+    }
+
+    Iterator* it = db_->NewIterator(ro);
+    std::string last;
+    int count = 0;
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        ASSERT_LT(last, it->key().ToString());
+        last = it->key().ToString();
+        count++;
+    }
+    ASSERT_TRUE(it->status().ok());
+    ASSERT_EQ(3000, count);
+    delete it;
+}
+
+TEST_F(CompactionTest, DirectIOForFlushAndCompaction) {
+    delete db_;
+    db_ = nullptr;
+    Options options;
+    options.create_if_missing = true;
+    options.write_buffer_size = 10 * 1024;
+    options.use_direct_reads = true;
+    options.use_direct_io_for_flush_and_compaction = true;
+    ASSERT_TRUE(DB::Open(options, dbname_, &db_).ok());
+
+    WriteOptions wo;
+    ReadOptions ro;
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < 2000; ++i) {
+            std::string key = "key" + std::to_string(i);
+            ASSERT_TRUE(db_->Put(wo, key, std::string(150 + round, 'a' + i % 26)).ok());
+        }
+    }
+
+    std::string value;
+    for (int i = 0; i < 2000; ++i) {
+        std::string key = "key" + std::to_string(i);
+        Status s = db_->Get(ro, key, &value);
+        ASSERT_TRUE(s.ok()) << "Missing key: " << key;
+        ASSERT_EQ(std::string(151, 'a' + i % 26), value);
+    }
+}
+
+TEST_F(CompactionTest, MultiGetMatchesGet) {
+    WriteOptions wo;
+    for (int i = 0; i < 2000; ++i) {
+        ASSERT_TRUE(db_->Put(wo, "key" + std::to_string(i), std::string(200, 'a' + i % 26)).ok());
+    }
+    // Newer versions and tombstones spread over the memtable and L0.
+    for (int i = 0; i < 2000; i += 7) {
+        ASSERT_TRUE(db_->Put(wo, "key" + std::to_string(i), "v2-" + std::to_string(i)).ok());
+    }
+    for (int i = 3; i < 2000; i += 11) {
+        ASSERT_TRUE(db_->Delete(wo, "key" + std::to_string(i)).ok());
+    }
+
+    // Unsorted, with duplicates and keys that never existed.
+    std::vector<std::string> names;
+    for (int i = 0; i < 300; ++i) {
+        names.push_back("key" + std::to_string((i * 997) % 2100));
+    }
+    names.push_back("key5");
+    names.push_back("key5");
+    names.push_back("");
+    std::vector<Slice> keys(names.begin(), names.end());
+
+    ReadOptions ro;
+    std::vector<std::string> values;
+    std::vector<Status> statuses = db_->MultiGet(ro, keys, &values);
+    ASSERT_EQ(keys.size(), statuses.size());
+    ASSERT_EQ(keys.size(), values.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        std::string expected;
+        Status s = db_->Get(ro, keys[i], &expected);
+        ASSERT_EQ(s.ok(), statuses[i].ok()) << names[i];
+        ASSERT_EQ(s.IsNotFound(), statuses[i].IsNotFound()) << names[i];
+        if (s.ok()) {
+            ASSERT_EQ(expected, values[i]) << names[i];
+        }
+    }
+
+    ASSERT_TRUE(db_->MultiGet(ro, std::vector<Slice>(), &values).empty());
+}
+
+TEST_F(CompactionTest, RowCacheServesRepeatedLookups) {
+    delete db_;
+    db_ = nullptr;
+    Options options;
+    options.write_buffer_size = 10 * 1024;
+    options.row_cache_capacity = 1 << 20;
+    ASSERT_TRUE(DB::Open(options, dbname_, &db_).ok());
+
+    WriteOptions wo;
+    ReadOptions ro;
+    auto expected = [](int i, int round) {
+        return std::to_string(round) + std::string(200, 'a' + i % 26);
+    };
+    for (int round = 0; round < 2; ++round) {
+        // Round 1 rewrites and deletes keys the row cache already holds rows
+        // for; lookups must see the newer tables, not the old rows.
+        for (int i = 0; i < 1000; ++i) {
+            ASSERT_TRUE(db_->Put(wo, "key" + std::to_string(i), expected(i, round)).ok());
+        }
+        for (int i = round; i < 1000; i += 10) {
+            ASSERT_TRUE(db_->Delete(wo, "key" + std::to_string(i)).ok());
+        }
+        for (int pass = 0; pass < 2; ++pass) {
+            std::vector<std::string> names;
+            for (int i = 0; i < 1000; ++i) {
+                names.push_back("key" + std::to_string(i));
+                std::string value;
+                Status s = db_->Get(ro, names.back(), &value);
+                if (i % 10 == round) {
+                    ASSERT_TRUE(s.IsNotFound()) << names.back();
+                } else {
+                    ASSERT_TRUE(s.ok()) << names.back();
+                    ASSERT_EQ(expected(i, round), value);
+                }
+            }
+            std::vector<Slice> keys(names.begin(), names.end());
+            std::vector<std::string> values;
+            std::vector<Status> statuses = db_->MultiGet(ro, keys, &values);
+            for (int i = 0; i < 1000; ++i) {
+                if (i % 10 == round) {
+                    ASSERT_TRUE(statuses[i].IsNotFound()) << names[i];
+                } else {
+                    ASSERT_TRUE(statuses[i].ok()) << names[i];
+                    ASSERT_EQ(expected(i, round), values[i]);
+                }
+            }
+        }
+    }
+}
+
+TEST_F(CompactionTest, UnlimitedOpenFilesPinsTables) {
+    delete db_;
+    db_ = nullptr;
+    Options options;
+    options.write_buffer_size = 10 * 1024;
+    options.max_open_files = -1;
+    ASSERT_TRUE(DB::Open(options, dbname_, &db_).ok());
+
+    // Flushes, compactions and trivial moves all install tables that are
+    // then read only through their FileMetaData.
+    WriteOptions wo;
+    ReadOptions ro;
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < 2000; ++i) {
+            std::string key = "key" + std::to_string(i);
+            ASSERT_TRUE(db_->Put(wo, key, std::string(150 + round, 'a' + i % 26)).ok());
+        }
+    }
+    for (int i = 0; i < 2000; i += 9) {
+        ASSERT_TRUE(db_->Delete(wo, "key" + std::to_string(i)).ok());
+    }
+
+    std::vector<std::string> names;
+    for (int i = 0; i < 2000; ++i) {
+        names.push_back("key" + std::to_string(i));
+        std::string value;
+        Status s = db_->Get(ro, names.back(), &value);
+        if (i % 9 == 0) {
+            ASSERT_TRUE(s.IsNotFound()) << names.back();
+        } else {
+            ASSERT_TRUE(s.ok()) << names.back();
+            ASSERT_EQ(std::string(151, 'a' + i % 26), value);
+        }
+    }
+    std::vector<Slice> keys(names.begin(), names.end());
+    std::vector<std::string> values;
+    std::vector<Status> statuses = db_->MultiGet(ro, keys, &values);
+    for (int i = 0; i < 2000; ++i) {
+        ASSERT_EQ(i % 9 != 0, statuses[i].ok()) << names[i];
+    }
+
+    Iterator* it = db_->NewIterator(ro);
+    int count = 0;
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        count++;
+    }
+    ASSERT_TRUE(it->status().ok());
+    ASSERT_EQ(2000 - 223, count);
+    delete it;
+
+    TablePropertiesCollection props;
+    ASSERT_TRUE(db_->GetPropertiesOfAllTables(&props).ok());
+    ASSERT_FALSE(props.empty());
+}
+
+// Writes an external table of keys key<begin>..key<end-1>, zero-padded to
+// six digits, with value_size-byte values, for ingestion.
+static std::string WriteSstFile(const std::string& path, int begin, int end,
+                                size_t value_size) {
+    SstFileWriter writer{Options()};
+    EXPECT_TRUE(writer.Open(path).ok());
+    for (int i = begin; i < end; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%06d", i);
+        EXPECT_TRUE(writer.Put(key, std::string(value_size, 'v')).ok());
+    }
+    EXPECT_TRUE(writer.Finish().ok());
+    return path;
+}
+
+// Writes 110 keys in a strided order, so that each of the two memtables
+// flushed holds keys from across the whole range and every level-0 table
+// overlaps every lookup.
+static void WriteOverlappingTables(DB* db) {
+    for (int i = 0; i < 110; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%03d", i * 7 % 110);
+        ASSERT_TRUE(db->Put(WriteOptions(), key, std::string(200, 'v')).ok());
+    }
+}
+
+static std::string FilesAtLevel0(DB* db);
+
+// Waits for the background thread to flush the last full memtable.
+static bool WaitForLevel0Files(DB* db, const std::string& files) {
+    for (int i = 0; i < 500 && FilesAtLevel0(db) != files; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return FilesAtLevel0(db) == files;
+}
+
+static std::string FilesAtLevel0(DB* db) {
+    std::string value;
+    EXPECT_TRUE(db->GetProperty("lsm.num-files-at-level0", &value));
+    return value;
+}
+
+
+TEST_F(CompactionTest, SeekCompactionOnGet) {
+    WriteOverlappingTables(db_);
+    ASSERT_TRUE(WaitForLevel0Files(db_, "2"));
+
+    // Lookups that probe a newer table before finding their key in an
+    // older one use up the newer table's seeks.
+    ReadOptions ro;
+    std::string value;
+    for (int round = 0; round < 10; ++round) {
+        for (int i = 0; i < 110; ++i) {
+            char key[16];
+            snprintf(key, sizeof(key), "key%03d", i);
+            ASSERT_TRUE(db_->Get(ro, key, &value).ok()) << key;
+        }
+    }
+    ASSERT_TRUE(WaitForLevel0Files(db_, "0"));
+    std::string files;
+    ASSERT_TRUE(db_->GetProperty("lsm.num-files-at-level1", &files));
+    ASSERT_NE("0", files);
+    ASSERT_FALSE(db_->GetProperty("lsm.num-files-at-level7", &files));
+}
+
+TEST_F(CompactionTest, SeekCompactionOnIteration) {
+    WriteOverlappingTables(db_);
+    ASSERT_TRUE(WaitForLevel0Files(db_, "2"));
+
+    // Scans never call Get; the keys they sample charge the tables instead.
+    ReadOptions ro;
+    for (int round = 0; round < 5000 && FilesAtLevel0(db_) != "0"; ++round) {
+        Iterator* it = db_->NewIterator(ro);
+        int count = 0;
+        for (it->SeekToFirst(); it->Valid(); it->Next()) {
+            count++;
+        }
+        ASSERT_EQ(110, count);
+        delete it;
+    }
+    ASSERT_TRUE(WaitForLevel0Files(db_, "0"));
+}
+
+TEST_F(CompactionTest, DynamicLevelBytesCompactsToLastLevel) {
+    delete db_;
+    db_ = nullptr;
+    Options options;
+    options.write_buffer_size = 10 * 1024;
+    options.level_compaction_dynamic_level_bytes = true;
+    ASSERT_TRUE(DB::Open(options, dbname_, &db_).ok());
+
+    // Far below the 10 MB base level target, everything compacted out of
+    // level 0 goes straight to the last level.
+    WriteOptions wo;
+    for (int i = 0; i < 3000; ++i) {
+        ASSERT_TRUE(db_->Put(wo, "key" + std::to_string(i % 1000), std::string(200, 'a' + i % 26)).ok());
+    }
+    std::string files;
+    ASSERT_TRUE(db_->GetProperty("lsm.num-files-at-level6", &files));
+    ASSERT_NE("0", files);
+    for (int level = 1; level < 6; ++level) {
+        ASSERT_TRUE(db_->GetProperty("lsm.num-files-at-level" + std::to_string(level), &files));
+        ASSERT_EQ("0", files) << "level " << level;
+    }
+
+    ReadOptions ro;
+    std::string value;
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_TRUE(db_->Get(ro, "key" + std::to_string(i), &value).ok()) << i;
+        ASSERT_EQ(std::string(200, 'a' + (2000 + i) % 26), value);
+    }
+}
+
+TEST_F(CompactionTest, CompactionPriorities) {
+    for (Options::CompactionPri pri : {Options::kRoundRobin, Options::kMinOverlappingRatio,
+                                       Options::kOldestSmallestSeqFirst}) {
+        delete db_;
+        db_ = nullptr;
+        #ifdef _WIN32
+        system(("rmdir /S /Q " + dbname_).c_str());
+        #else
+        system(("rm -rf " + dbname_).c_str());
+        #endif
+        Options options;
+        options.write_buffer_size = 1024 * 1024;
+        options.compaction_pri = pri;
+        ASSERT_TRUE(DB::Open(options, dbname_, &db_).ok());
+
+        // Enough random overwrites to take level 1 past its 10 MB target.
+        WriteOptions wo;
+        std::map<std::string, std::string> expected;
+        std::mt19937 rnd(pri);
+        for (int i = 0; i < 16000; ++i) {
+            char key[16];
+            snprintf(key, sizeof(key), "key%05d", static_cast<int>(rnd() % 20000));
+            std::string value(1000, 'a' + i % 26);
+            ASSERT_TRUE(db_->Put(wo, key, value).ok());
+            expected[key] = value;
+        }
+        std::string files;
+        for (int i = 0; i < 500; ++i) {
+            ASSERT_TRUE(db_->GetProperty("lsm.num-files-at-level2", &files));
+            if (files != "0") break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        ASSERT_NE("0", files) << "priority " << pri;
+
+        std::string value;
+        for (const auto& kv : expected) {
+            ASSERT_TRUE(db_->Get(ReadOptions(), kv.first, &value).ok()) << kv.first;
+            ASSERT_EQ(kv.second, value) << kv.first << " priority " << pri;
+        }
+    }
+}
+
+TEST_F(CompactionTest, DeletionCompactionPushesTombstonesDown) {
+    for (double ratio : {0.0, 0.5}) {
+        delete db_;
+        db_ = nullptr;
+        #ifdef _WIN32
+        system(("rmdir /S /Q " + dbname_).c_str());
+        #else
+        system(("rm -rf " + dbname_).c_str());
+        #endif
+        Options options;
+        options.write_buffer_size = 10 * 1024;
+        options.deletion_compaction_ratio = ratio;
+        ASSERT_TRUE(DB::Open(options, dbname_, &db_).ok());
+
+        // The data sits in the last level, so level-0 compactions into
+        // level 1 have to keep the tombstones deleting it.
+        IngestExternalFileOptions ingest;
+        ingest.move_files = true;
+        ASSERT_TRUE(db_->IngestExternalFiles(
+            ingest, {WriteSstFile("test_compaction_ingest.sst", 0, 2000, 100)}).ok());
+        for (int i = 0; i < 2000; ++i) {
+            char key[16];
+            snprintf(key, sizeof(key), "key%06d", i);
+            ASSERT_TRUE(db_->Delete(WriteOptions(), key).ok());
+        }
+
+        auto middle_files = [this] {
+            int files = 0;
+            for (int level = 1; level < 6; ++level) {
+                std::string value;
+                EXPECT_TRUE(db_->GetProperty("lsm.num-files-at-level" + std::to_string(level),
+                                             &value));
+                files += std::stoi(value);
+            }
+            return files;
+        };
+        for (int i = 0; i < 500 && (ratio > 0) != (middle_files() == 0); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (ratio > 0) {
+            // Tombstone-only tables move down until they meet the data.
+            ASSERT_EQ(0, middle_files());
+        } else {
+            ASSERT_NE(0, middle_files());
+        }
+        std::string value;
+        ASSERT_TRUE(db_->Get(ReadOptions(), "key000123", &value).IsNotFound());
+    }
+}
+
+TEST_F(CompactionTest, CompactionPriorityPicksFile) {
+    // Level 1 is laid out as A = [0, 3700), B = [10000, 13700) and
+    // C = [20000, 23700), ingested in the order B, A, C. Level 2 holds as
+    // much data as A and B under them but only 100 entries under C.
+    const std::pair<Options::CompactionPri, char> cases[] = {
+        {Options::kRoundRobin, 'A'},
+        {Options::kMinOverlappingRatio, 'C'},
+        {Options::kOldestSmallestSeqFirst, 'B'},
+    };
+    for (const auto& c : cases) {
+        delete db_;
+        db_ = nullptr;
+        #ifdef _WIN32
+        system(("rmdir /S /Q " + dbname_).c_str());
+        #else
+        system(("rm -rf " + dbname_).c_str());
+        #endif
+        Options options;
+        options.compaction_pri = c.first;
+        ASSERT_TRUE(DB::Open(options, dbname_, &db_).ok());
+
+        IngestExternalFileOptions ingest;
+        ingest.move_files = true;
+        auto ingest_file = [&](int begin, int end, size_t value_size) {
+            EXPECT_TRUE(db_->IngestExternalFiles(
+                ingest, {WriteSstFile("test_compaction_ingest.sst", begin, end, value_size)}).ok());
+            TablePropertiesCollection props;
+            EXPECT_TRUE(db_->GetPropertiesOfAllTables(&props).ok());
+            return props.rbegin()->first;
+        };
+
+        // Each ingested file lands just above the one it overlaps: four
+        // spanning files fill levels 6 to 3, then level 2, then level 1.
+        for (int i = 0; i < 4; ++i) {
+            ingest_file(0, 30000, 0);
+        }
+        ingest_file(0, 3700, 1000);
+        ingest_file(10000, 13700, 1000);
+        ingest_file(20000, 20100, 1000);
+        std::map<char, uint64_t> l1;
+        l1['B'] = ingest_file(10000, 13700, 1000);
+        l1['A'] = ingest_file(0, 3700, 1000);
+        std::string files;
+        ASSERT_TRUE(db_->GetProperty("lsm.num-files-at-level1", &files));
+        ASSERT_EQ("2", files);
+        ASSERT_TRUE(db_->GetProperty("lsm.num-files-at-level2", &files));
+        ASSERT_EQ("3", files);
+
+        // The third table takes level 1 past its 10 MB target, and
+        // compacting any one of them brings it back under.
+        l1['C'] = ingest_file(20000, 23700, 1000);
+        for (int i = 0; i < 500; ++i) {
+            ASSERT_TRUE(db_->GetProperty("lsm.num-files-at-level1", &files));
+            if (files == "2") break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        ASSERT_EQ("2", files) << "priority " << c.first;
+
+        TablePropertiesCollection props;
+        ASSERT_TRUE(db_->GetPropertiesOfAllTables(&props).ok());
+        for (const auto& f : l1) {
+            ASSERT_EQ(f.first != c.second, props.count(f.second) == 1)
+                << "priority " << c.first << " table " << f.first;
+        }
+    }
+}
@@ -0,0 +1,254 @@
+#include <gtest/gtest.h>
+#include "lsm/options.h"
+#include "src/table/sstable_builder.h"
+#include "src/table/sstable_reader.h"
+#include "src/util/file.h"
+#include "src/util/lz.h"
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+
+using namespace lsm;
+
+static std::string RoundTrip(const std::string& input) {
+    std::string compressed;
+    lz::Compress(input.data(), input.size(), &compressed);
+    size_t ulength = 0;
+    EXPECT_TRUE(lz::GetUncompressedLength(compressed.data(), compressed.size(), &ulength));
+    EXPECT_EQ(input.size(), ulength);
+    std::string output(ulength, '\0');
+    EXPECT_TRUE(lz::Uncompress(compressed.data(), compressed.size(), &output[0]));
+    return output;
+}
+
+TEST(LZTest, RoundTrip) {
+    std::mt19937 rnd(301);
+    std::vector<std::string> inputs = {"", "a", "abcdefghijklm", std::string(100000, 'x')};
+
+    std::string text;
+    for (int i = 0; i < 5000; i++) {
+        text += "key" + std::to_string(i % 97) + "=value" + std::to_string(i % 13) + ";";
+    }
+    inputs.push_back(text);
+
+    std::string random(70000, '\0');
+    for (auto& c : random) c = static_cast<char>(rnd());
+    inputs.push_back(random);
+
+    // Short-period repeats exercise overlapping match copies.
+    std::string periodic;
+    for (int i = 0; i < 1000; i++) periodic += "abc";
+    inputs.push_back(periodic);
+
+    for (const auto& input : inputs) {
+        ASSERT_EQ(input, RoundTrip(input));
+    }
+
+    std::string compressed;
+    lz::Compress(text.data(), text.size(), &compressed);
+    ASSERT_LT(compressed.size(), text.size() / 2);
+}
+
+TEST(LZTest, RejectsCorruptInput) {
+    std::string input;
+    for (int i = 0; i < 1000; i++) input += "hello world " + std::to_string(i % 10);
+    std::string compressed;
+    lz::Compress(input.data(), input.size(), &compressed);
+
+    std::string output(input.size(), '\0');
+    // Truncation must fail cleanly rather than overrun.
+    for (size_t len = 0; len < compressed.size(); len += 7) {
+        ASSERT_FALSE(lz::Uncompress(compressed.data(), len, &output[0]));
+    }
+
+    std::mt19937 rnd(7);
+    for (int trial = 0; trial < 200; trial++) {
+        std::string bad = compressed;
+        bad[1 + rnd() % (bad.size() - 1)] ^= static_cast<char>(1 + rnd() % 255);
+        // Either rejected or decoded within bounds; never a crash.
+        lz::Uncompress(bad.data(), bad.size(), &output[0]);
+    }
+}
+
+TEST(LZTest, CompressionForLevel) {
+    Options options;
+    options.compression = Options::kLZCompression;
+    ASSERT_EQ(Options::kLZCompression, options.CompressionForLevel(3));
+
+    options.compression_per_level = {Options::kNoCompression, Options::kNoCompression,
+                                     Options::kLZCompression};
+    ASSERT_EQ(Options::kNoCompression, options.CompressionForLevel(0));
+    ASSERT_EQ(Options::kNoCompression, options.CompressionForLevel(1));
+    ASSERT_EQ(Options::kLZCompression, options.CompressionForLevel(2));
+    ASSERT_EQ(Options::kLZCompression, options.CompressionForLevel(6));
+}
+
+// Fixed so that tables built from the same entries match byte for byte.
+static const uint64_t kCreationTime = 1700000000;
+
+static uint64_t BuildTable(const Options& options, const std::string& fname,
+                           bool compressible) {
+    std::mt19937 rnd(42);
+    WritableFile* outfile = nullptr;
+    EXPECT_TRUE(NewWritableFile(fname, false, &outfile).ok());
+    TableBuilder builder(options, outfile);
+    builder.SetCreationTime(kCreationTime);
+    for (int i = 0; i < 2000; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "key%06d", i);
+        std::string value(100, 'v');
+        if (!compressible) {
+            for (auto& c : value) c = static_cast<char>(rnd());
+        }
+        builder.Add(key, value);
+    }
+    EXPECT_TRUE(builder.Finish().ok());
+    uint64_t size = builder.FileSize();
+    delete outfile;
+    return size;
+}
+
+static void VerifyTable(const Options& options, const std::string& fname, uint64_t size) {
+    Table* table = nullptr;
+    ASSERT_TRUE(Table::Open(options, fname, size, &table).ok());
+    ReadOptions ro;
+    ro.verify_checksums = true;
+    Iterator* iter = table->NewIterator(ro);
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        char key[32];
+        snprintf(key, sizeof(key), "key%06d", count);
+        ASSERT_EQ(key, iter->key().ToString());
+        count++;
+    }
+    ASSERT_TRUE(iter->status().ok());
+    ASSERT_EQ(2000, count);
+    delete iter;
+    delete table;
+}
+
+TEST(LZTest, CompressedTable) {
+    Options plain;
+    Options lz;
+    lz.compression = Options::kLZCompression;
+
+    uint64_t plain_size = BuildTable(plain, "test_lz_plain.sst", true);
+    uint64_t lz_size = BuildTable(lz, "test_lz.sst", true);
+    ASSERT_LT(lz_size, plain_size / 2);
+    VerifyTable(lz, "test_lz.sst", lz_size);
+
+    // Incompressible data blocks fall back to raw storage, so the file is
+    // never larger than an uncompressed one.
+    uint64_t random_plain = BuildTable(plain, "test_lz_plain.sst", false);
+    uint64_t random_lz = BuildTable(lz, "test_lz.sst", false);
+    ASSERT_LE(random_lz, random_plain);
+    VerifyTable(lz, "test_lz.sst", random_lz);
+
+    remove("test_lz_plain.sst");
+    remove("test_lz.sst");
+}
+
+static std::string ReadFile(const std::string& fname) {
+    std::ifstream in(fname, std::ios::in | std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+TEST(LZTest, ParallelCompressionMatchesSerial) {
+    Options serial;
+    serial.compression = Options::kLZCompression;
+    serial.block_size = 1024;
+    Options parallel = serial;
+    parallel.parallel_compression_threads = 4;
+
+    for (bool compressible : {true, false}) {
+        uint64_t serial_size = BuildTable(serial, "test_lz_serial.sst", compressible);
+        uint64_t parallel_size = BuildTable(parallel, "test_lz_parallel.sst", compressible);
+        ASSERT_EQ(serial_size, parallel_size);
+        ASSERT_EQ(ReadFile("test_lz_serial.sst"), ReadFile("test_lz_parallel.sst"));
+        VerifyTable(parallel, "test_lz_parallel.sst", parallel_size);
+    }
+
+    remove("test_lz_serial.sst");
+    remove("test_lz_parallel.sst");
+}
+
+#ifdef LSM_HAVE_ZSTD
+static uint64_t BuildJsonTable(const Options& options, const std::string& fname) {
+    WritableFile* outfile = nullptr;
+    EXPECT_TRUE(NewWritableFile(fname, false, &outfile).ok());
+    TableBuilder builder(options, outfile);
+    builder.SetCreationTime(kCreationTime);
+    std::mt19937 rnd(11);
+    static const char* kNames[] = {"alice", "bob", "carol", "dave", "erin"};
+    for (int i = 0; i < 20000; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "user%08d", i);
+        std::string value = "{\"name\":\"" + std::string(kNames[rnd() % 5]) +
+                            "\",\"age\":" + std::to_string(rnd() % 90) +
+                            ",\"active\":" + (rnd() % 2 ? "true" : "false") +
+                            ",\"score\":" + std::to_string(rnd() % 100000) + "}";
+        builder.Add(key, value);
+    }
+    EXPECT_TRUE(builder.Finish().ok());
+    uint64_t size = builder.FileSize();
+    delete outfile;
+    return size;
+}
+
+TEST(ZstdTest, DictionaryCompression) {
+    Options zstd;
+    zstd.compression = Options::kZstdCompression;
+    Options dict = zstd;
+    dict.zstd_max_dict_bytes = 4096;
+    dict.zstd_max_train_bytes = 64 * 1024;
+
+    uint64_t plain_size = BuildJsonTable(zstd, "test_zstd.sst");
+    uint64_t dict_size = BuildJsonTable(dict, "test_zstd_dict.sst");
+    ASSERT_LT(dict_size, plain_size);
+
+    Table* table = nullptr;
+    ASSERT_TRUE(Table::Open(dict, "test_zstd_dict.sst", dict_size, &table).ok());
+    ReadOptions ro;
+    ro.verify_checksums = true;
+    Iterator* iter = table->NewIterator(ro);
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        char key[32];
+        snprintf(key, sizeof(key), "user%08d", count);
+        ASSERT_EQ(key, iter->key().ToString());
+        count++;
+    }
+    ASSERT_TRUE(iter->status().ok());
+    ASSERT_EQ(20000, count);
+    iter->Seek("user00012345");
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("user00012345", iter->key().ToString());
+    delete iter;
+    delete table;
+
+    // Dictionary training followed by parallel compression of later blocks.
+    Options parallel = dict;
+    parallel.parallel_compression_threads = 3;
+    uint64_t parallel_size = BuildJsonTable(parallel, "test_zstd_parallel.sst");
+    ASSERT_EQ(dict_size, parallel_size);
+    ASSERT_EQ(ReadFile("test_zstd_dict.sst"), ReadFile("test_zstd_parallel.sst"));
+    remove("test_zstd_parallel.sst");
+
+    // A table smaller than the training budget trains on what it has.
+    Options small = dict;
+    small.zstd_max_train_bytes = 1 << 30;
+    uint64_t small_size = BuildJsonTable(small, "test_zstd_dict.sst");
+    ASSERT_TRUE(Table::Open(small, "test_zstd_dict.sst", small_size, &table).ok());
+    iter = table->NewIterator(ro);
+    count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) count++;
+    ASSERT_TRUE(iter->status().ok());
+    ASSERT_EQ(20000, count);
+    delete iter;
+    delete table;
+
+    remove("test_zstd.sst");
+    remove("test_zstd_dict.sst");
+}
+#endif
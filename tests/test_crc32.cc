@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include "src/util/crc32.h"
+#include "src/util/hash.h"
+#include <cstring>
+#include <string>
+
+using namespace lsm;
+
+TEST(CRC32Test, StandardResults) {
+    // From rfc3720 section B.4.
+    char buf[32];
+
+    memset(buf, 0, sizeof(buf));
+    ASSERT_EQ(0x8a9136aau, crc32c::Value(buf, sizeof(buf)));
+
+    memset(buf, 0xff, sizeof(buf));
+    ASSERT_EQ(0x62a8ab43u, crc32c::Value(buf, sizeof(buf)));
+
+    for (int i = 0; i < 32; i++) {
+        buf[i] = static_cast<char>(i);
+    }
+    ASSERT_EQ(0x46dd794eu, crc32c::Value(buf, sizeof(buf)));
+
+    for (int i = 0; i < 32; i++) {
+        buf[i] = static_cast<char>(31 - i);
+    }
+    ASSERT_EQ(0x113fdb5cu, crc32c::Value(buf, sizeof(buf)));
+
+    ASSERT_EQ(0xe3069283u, crc32c::Value("123456789", 9));
+    ASSERT_EQ(0xe3069283u, crc32c::ExtendPortable(0, "123456789", 9));
+}
+
+TEST(CRC32Test, ExtendMatchesPortable) {
+    // Large enough to exercise the interleaved long and short strides of
+    // the hardware path, which is checked against the portable table.
+    std::string data(100000, '\0');
+    uint32_t x = 12345;
+    for (size_t i = 0; i < data.size(); i++) {
+        x = x * 1103515245 + 12345;
+        data[i] = static_cast<char>(x >> 16);
+    }
+
+    for (size_t offset : {0, 1, 3, 7}) {
+        for (size_t len : {0, 5, 255, 768, 769, 24576, 24583, 99990}) {
+            const char* p = data.data() + offset;
+            const uint32_t expected = crc32c::ExtendPortable(0, p, len);
+            ASSERT_EQ(expected, crc32c::Value(p, len))
+                << "offset " << offset << " len " << len;
+            // Extending in pieces gives the same result.
+            const size_t half = len / 2;
+            ASSERT_EQ(expected, crc32c::Extend(crc32c::Value(p, half), p + half, len - half))
+                << "offset " << offset << " len " << len;
+        }
+    }
+}
+
+TEST(CRC32Test, Mask) {
+    uint32_t crc = crc32c::Value("foo", 3);
+    ASSERT_NE(crc, crc32c::Mask(crc));
+    ASSERT_NE(crc, crc32c::Mask(crc32c::Mask(crc)));
+    ASSERT_EQ(crc, crc32c::Unmask(crc32c::Mask(crc)));
+    ASSERT_EQ(crc, crc32c::Unmask(crc32c::Unmask(crc32c::Mask(crc32c::Mask(crc)))));
+}
+
+TEST(CRC32Test, XXHash64StandardResults) {
+    ASSERT_EQ(0xef46db3751d8e999ull, XXHash64("", 0, 0));
+    ASSERT_EQ(0xd24ec4f1a98c6e5bull, XXHash64("a", 1, 0));
+    ASSERT_EQ(0x44bc2cf5ad770999ull, XXHash64("abc", 3, 0));
+    const std::string fox = "The quick brown fox jumps over the lazy dog";
+    ASSERT_EQ(0x0b242d361fda71bcull, XXHash64(fox.data(), fox.size(), 0));
+}
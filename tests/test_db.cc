@@ -1,7 +1,10 @@
 #include <gtest/gtest.h>
 #include "lsm/db.h"
+#include "lsm/cache.h"
 #include "lsm/options.h"
+#include "lsm/sst_file_writer.h"
 #include "lsm/status.h"
+#include <fstream>
 
 using namespace lsm;
 
@@ -70,6 +73,18 @@ TEST_F(DBTest, Delete) {
     ASSERT_TRUE(db_->Get(ro, "foo", &value).IsNotFound());
 }
 
+TEST_F(DBTest, RejectsHashIndexUtilRatioOutOfRange) {
+    for (double ratio : {0.0, -0.5, 1.5}) {
+        Options options;
+        options.data_block_hash_index = true;
+        options.data_block_hash_table_util_ratio = ratio;
+        DB* db = nullptr;
+        Status s = DB::Open(options, dbname_ + "_ratio", &db);
+        ASSERT_TRUE(s.IsInvalidArgument()) << ratio;
+        ASSERT_EQ(nullptr, db);
+    }
+}
+
 TEST_F(DBTest, Iterator) {
     WriteOptions wo;
     ReadOptions ro;
@@ -98,3 +113,162 @@ TEST_F(DBTest, Iterator) {
 
     delete iter;
 }
+
+TEST_F(DBTest, IteratorSkipsOverwrittenVersions) {
+    WriteOptions wo;
+    ReadOptions ro;
+
+    db_->Put(wo, "a", "va1");
+    db_->Put(wo, "b", "vb1");
+    db_->Put(wo, "a", "va2");
+    db_->Put(wo, "b", "vb2");
+    db_->Put(wo, "c", "vc1");
+    db_->Delete(wo, "c");
+    db_->Put(wo, "d", "vd1");
+
+    Iterator* iter = db_->NewIterator(ro);
+    iter->SeekToFirst();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("a", iter->key().ToString());
+    ASSERT_EQ("va2", iter->value().ToString());
+
+    iter->Next();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("b", iter->key().ToString());
+    ASSERT_EQ("vb2", iter->value().ToString());
+
+    iter->Next();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("d", iter->key().ToString());
+
+    iter->Next();
+    ASSERT_FALSE(iter->Valid());
+
+    // Backwards, each key shows its newest version once, and the deleted
+    // key not at all.
+    iter->SeekToLast();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("d", iter->key().ToString());
+    ASSERT_EQ("vd1", iter->value().ToString());
+
+    iter->Prev();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("b", iter->key().ToString());
+    ASSERT_EQ("vb2", iter->value().ToString());
+
+    iter->Prev();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("a", iter->key().ToString());
+    ASSERT_EQ("va2", iter->value().ToString());
+
+    iter->Prev();
+    ASSERT_FALSE(iter->Valid());
+
+    // Switching direction mid-scan.
+    iter->Seek("b");
+    ASSERT_TRUE(iter->Valid());
+    iter->Prev();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("a", iter->key().ToString());
+    ASSERT_EQ("va2", iter->value().ToString());
+    iter->Next();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("b", iter->key().ToString());
+    ASSERT_EQ("vb2", iter->value().ToString());
+    iter->Next();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("d", iter->key().ToString());
+
+    delete iter;
+}
+
+TEST_F(DBTest, TableWarmupProgress) {
+    std::string value;
+    ASSERT_TRUE(db_->GetProperty("lsm.table-warmup-progress", &value));
+    ASSERT_EQ("0/0", value);
+    ASSERT_FALSE(db_->GetProperty("lsm.no-such-property", &value));
+
+    for (bool background : {false, true}) {
+        delete db_;
+        db_ = nullptr;
+        Options options;
+        options.table_warmup_threads = 4;
+        options.table_warmup_data_blocks = 2;
+        options.table_warmup_in_background = background;
+        ASSERT_TRUE(DB::Open(options, dbname_, &db_).ok());
+        ASSERT_TRUE(db_->Put(WriteOptions(), "a", "va").ok());
+        ASSERT_TRUE(db_->GetProperty("lsm.table-warmup-progress", &value));
+        ASSERT_TRUE(db_->Get(ReadOptions(), "a", &value).ok());
+        ASSERT_EQ("va", value);
+    }
+}
+
+TEST_F(DBTest, BlockCacheDumpAndLoad) {
+    delete db_;
+    db_ = nullptr;
+    Options options;
+    options.block_cache.reset(NewLRUCache(4 * 1024 * 1024));
+    options.block_cache_dump_path = dbname_ + "/BLOCK_CACHE";
+    ASSERT_TRUE(DB::Open(options, dbname_, &db_).ok());
+
+    // An ingested table is not flushed or compacted, so the same blocks
+    // are live from the dump to the load.
+    const std::string sst = dbname_ + "/ingest.sst";
+    {
+        SstFileWriter writer(options);
+        ASSERT_TRUE(writer.Open(sst).ok());
+        for (int i = 0; i < 2000; ++i) {
+            char key[16];
+            snprintf(key, sizeof(key), "key%06d", i);
+            ASSERT_TRUE(writer.Put(key, std::string(100, 'v')).ok());
+        }
+        ASSERT_TRUE(writer.Finish().ok());
+    }
+    IngestExternalFileOptions ingest;
+    ingest.move_files = true;
+    ASSERT_TRUE(db_->IngestExternalFiles(ingest, {sst}).ok());
+    ReadOptions ro;
+    std::string value;
+    for (int i = 0; i < 2000; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "key%06d", i);
+        ASSERT_TRUE(db_->Get(ro, key, &value).ok());
+    }
+
+    auto file_size = [](const std::string& fname) {
+        return static_cast<int64_t>(std::ifstream(fname, std::ios::binary | std::ios::ate).tellg());
+    };
+    const std::string dump = dbname_ + "/dump";
+    ASSERT_TRUE(db_->DumpBlockCache(dump).ok());
+    ASSERT_GT(file_size(dump), 12 + 2000 * 100 / 4096);
+
+    // Emptied of every block, the cache gets back exactly those it listed.
+    std::vector<std::string> keys;
+    options.block_cache->ApplyToAllEntries(
+        [&](const Slice& key, void*, size_t, void (*)(const Slice&, void*), Cache::Priority) {
+            keys.push_back(key.ToString());
+        });
+    for (const std::string& key : keys) {
+        options.block_cache->Erase(key);
+    }
+    ASSERT_EQ(0u, options.block_cache->TotalCharge());
+    ASSERT_TRUE(db_->LoadBlockCache(dump).ok());
+    ASSERT_GT(options.block_cache->TotalCharge(), 2000u * 100);
+    const std::string reloaded = dbname_ + "/reloaded";
+    ASSERT_TRUE(db_->DumpBlockCache(reloaded).ok());
+    ASSERT_EQ(file_size(dump), file_size(reloaded));
+
+    ASSERT_TRUE(db_->LoadBlockCache(dbname_ + "/missing").IsNotFound());
+    {
+        std::ofstream out(dump, std::ios::binary | std::ios::app);
+        out << "junk";
+    }
+    ASSERT_TRUE(db_->LoadBlockCache(dump).IsCorruption());
+
+    // Closing writes the dump. The load at open is not checked here: the
+    // DB does not recover its tables yet, so it has nothing to load into.
+    delete db_;
+    db_ = nullptr;
+    ASSERT_TRUE(std::ifstream(options.block_cache_dump_path).good());
+    ASSERT_TRUE(DB::Open(options, dbname_, &db_).ok());
+}
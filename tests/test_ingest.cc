@@ -0,0 +1,184 @@
+#include <gtest/gtest.h>
+#include "lsm/db.h"
+#include "lsm/options.h"
+#include "lsm/sst_file_writer.h"
+#include "lsm/status.h"
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace lsm;
+
+class IngestTest : public ::testing::Test {
+protected:
+    std::string dbname_ = "test_ingest_dir";
+    std::string extdir_ = "test_ingest_ext";
+    DB* db_ = nullptr;
+
+    void SetUp() override {
+        std::filesystem::remove_all(dbname_);
+        std::filesystem::remove_all(extdir_);
+        std::filesystem::create_directory(extdir_);
+        Options options;
+        options.create_if_missing = true;
+        options.write_buffer_size = 64 * 1024;
+        Status s = DB::Open(options, dbname_, &db_);
+        ASSERT_TRUE(s.ok()) << s.ToString();
+    }
+
+    void TearDown() override {
+        delete db_;
+        std::filesystem::remove_all(dbname_);
+        std::filesystem::remove_all(extdir_);
+    }
+
+    static std::string Key(int i) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "key%06d", i);
+        return buf;
+    }
+
+    // Writes keys [begin, end) with values prefix + key; every key divisible
+    // by delete_every (if non-zero) is written as a deletion instead.
+    std::string WriteFile(const std::string& name, int begin, int end,
+                          const std::string& prefix, int delete_every = 0) {
+        std::string path = extdir_ + "/" + name;
+        SstFileWriter writer{Options()};
+        EXPECT_TRUE(writer.Open(path).ok());
+        for (int i = begin; i < end; i++) {
+            Status s = (delete_every != 0 && i % delete_every == 0)
+                           ? writer.Delete(Key(i))
+                           : writer.Put(Key(i), prefix + Key(i));
+            EXPECT_TRUE(s.ok()) << s.ToString();
+        }
+        ExternalSstFileInfo info;
+        Status s = writer.Finish(&info);
+        EXPECT_TRUE(s.ok()) << s.ToString();
+        EXPECT_EQ(info.num_entries, static_cast<uint64_t>(end - begin));
+        EXPECT_EQ(info.smallest_key, Key(begin));
+        EXPECT_EQ(info.largest_key, Key(end - 1));
+        return path;
+    }
+
+    std::string Get(const std::string& key) {
+        std::string value;
+        Status s = db_->Get(ReadOptions(), key, &value);
+        if (s.IsNotFound()) return "NOT_FOUND";
+        if (!s.ok()) return s.ToString();
+        return value;
+    }
+};
+
+TEST_F(IngestTest, WriterRejectsUnsortedKeys) {
+    SstFileWriter writer{Options()};
+    ASSERT_TRUE(writer.Open(extdir_ + "/bad.sst").ok());
+    ASSERT_TRUE(writer.Put("b", "1").ok());
+    EXPECT_TRUE(writer.Put("a", "2").IsInvalidArgument());
+    EXPECT_TRUE(writer.Put("b", "3").IsInvalidArgument());
+}
+
+TEST_F(IngestTest, WriterRejectsEmptyFile) {
+    SstFileWriter writer{Options()};
+    ASSERT_TRUE(writer.Open(extdir_ + "/empty.sst").ok());
+    EXPECT_TRUE(writer.Finish().IsInvalidArgument());
+}
+
+TEST_F(IngestTest, IngestIntoEmptyDB) {
+    std::string path = WriteFile("a.sst", 0, 1000, "v-");
+    Status s = db_->IngestExternalFiles(IngestExternalFileOptions(), {path});
+    ASSERT_TRUE(s.ok()) << s.ToString();
+
+    // Copied by default, so the source stays.
+    EXPECT_TRUE(std::filesystem::exists(path));
+
+    for (int i = 0; i < 1000; i += 37) {
+        EXPECT_EQ(Get(Key(i)), "v-" + Key(i));
+    }
+    EXPECT_EQ(Get(Key(1000)), "NOT_FOUND");
+
+    std::unique_ptr<Iterator> iter(db_->NewIterator(ReadOptions()));
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        EXPECT_EQ(iter->key().ToString(), Key(count));
+        count++;
+    }
+    EXPECT_EQ(count, 1000);
+}
+
+TEST_F(IngestTest, IngestedDataIsNewerThanExistingData) {
+    WriteOptions wo;
+    for (int i = 0; i < 100; i++) {
+        ASSERT_TRUE(db_->Put(wo, Key(i), "old").ok());
+    }
+    std::string path = WriteFile("a.sst", 50, 150, "new-");
+    ASSERT_TRUE(db_->IngestExternalFiles(IngestExternalFileOptions(), {path}).ok());
+
+    EXPECT_EQ(Get(Key(10)), "old");
+    EXPECT_EQ(Get(Key(50)), "new-" + Key(50));
+    EXPECT_EQ(Get(Key(99)), "new-" + Key(99));
+    EXPECT_EQ(Get(Key(149)), "new-" + Key(149));
+
+    // Later writes win over ingested data.
+    ASSERT_TRUE(db_->Put(wo, Key(60), "newest").ok());
+    ASSERT_TRUE(db_->Delete(wo, Key(61)).ok());
+    EXPECT_EQ(Get(Key(60)), "newest");
+    EXPECT_EQ(Get(Key(61)), "NOT_FOUND");
+}
+
+TEST_F(IngestTest, IngestedDeletionHidesOlderData) {
+    WriteOptions wo;
+    for (int i = 0; i < 100; i++) {
+        ASSERT_TRUE(db_->Put(wo, Key(i), "old").ok());
+    }
+    std::string path = WriteFile("a.sst", 0, 100, "new-", 10);
+    ASSERT_TRUE(db_->IngestExternalFiles(IngestExternalFileOptions(), {path}).ok());
+
+    EXPECT_EQ(Get(Key(0)), "NOT_FOUND");
+    EXPECT_EQ(Get(Key(30)), "NOT_FOUND");
+    EXPECT_EQ(Get(Key(31)), "new-" + Key(31));
+}
+
+TEST_F(IngestTest, RejectsOverlappingFiles) {
+    std::string a = WriteFile("a.sst", 0, 100, "a-");
+    std::string b = WriteFile("b.sst", 50, 150, "b-");
+    Status s = db_->IngestExternalFiles(IngestExternalFileOptions(), {a, b});
+    EXPECT_TRUE(s.IsInvalidArgument()) << s.ToString();
+    EXPECT_EQ(Get(Key(0)), "NOT_FOUND");
+}
+
+TEST_F(IngestTest, MoveFilesAndBatch) {
+    // Out of order on purpose; ingestion sorts them.
+    std::string b = WriteFile("b.sst", 100, 200, "b-");
+    std::string a = WriteFile("a.sst", 0, 100, "a-");
+    IngestExternalFileOptions options;
+    options.move_files = true;
+    ASSERT_TRUE(db_->IngestExternalFiles(options, {b, a}).ok());
+    EXPECT_FALSE(std::filesystem::exists(a));
+    EXPECT_FALSE(std::filesystem::exists(b));
+    EXPECT_EQ(Get(Key(5)), "a-" + Key(5));
+    EXPECT_EQ(Get(Key(150)), "b-" + Key(150));
+}
+
+TEST_F(IngestTest, SurvivesCompaction) {
+    std::string path = WriteFile("a.sst", 0, 2000, "ingested-");
+    ASSERT_TRUE(db_->IngestExternalFiles(IngestExternalFileOptions(), {path}).ok());
+
+    // Push enough overlapping writes through to compact with the file.
+    WriteOptions wo;
+    std::string filler(200, 'x');
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 2000; i += 2) {
+            ASSERT_TRUE(db_->Put(wo, Key(i), filler + std::to_string(round)).ok());
+        }
+    }
+
+    for (int i = 0; i < 2000; i += 97) {
+        if (i % 2 == 0) {
+            EXPECT_EQ(Get(Key(i)), filler + "2");
+        } else {
+            EXPECT_EQ(Get(Key(i)), "ingested-" + Key(i));
+        }
+    }
+}
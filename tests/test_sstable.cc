@@ -2,6 +2,13 @@
 #include "lsm/options.h"
 #include "src/table/sstable_builder.h"
 #include "src/table/sstable_reader.h"
+#include "src/util/file.h"
+#include "src/table/table_cache.h"
+#include "src/util/persistent_cache.h"
+#include "src/util/secondary_cache.h"
+#include "src/db/memtable.h"
+#include "lsm/comparator.h"
+#include <algorithm>
 #include <fstream>
 
 using namespace lsm;
@@ -11,7 +18,8 @@ TEST(SSTableTest, BuildAndRead) {
     std::string fname = "test_sstable.sst";
 
     // Build SSTable
-    std::ofstream* outfile = new std::ofstream(fname, std::ios::out | std::ios::binary);
+    WritableFile* outfile = nullptr;
+    ASSERT_TRUE(NewWritableFile(fname, false, &outfile).ok());
     TableBuilder builder(options, outfile);
     builder.Add("key1", "val1");
     builder.Add("key2", "val2");
@@ -61,3 +69,590 @@ TEST(SSTableTest, BuildAndRead) {
     delete table;
     remove(fname.c_str());
 }
+
+struct GetResult {
+    bool found = false;
+    std::string key;
+    std::string value;
+};
+
+static void SaveGetResult(void* arg, const Slice& k, const Slice& v) {
+    GetResult* r = reinterpret_cast<GetResult*>(arg);
+    r->found = true;
+    r->key = k.ToString();
+    r->value = v.ToString();
+}
+
+TEST(SSTableTest, HashIndexPointLookup) {
+    InternalKeyComparator icmp(BytewiseComparator());
+    Options options;
+    options.comparator = &icmp;
+    options.data_block_hash_index = true;
+    const uint64_t file_number = 901;
+    std::string fname = "./000901.sst";
+
+    // Two versions per user key so some keys straddle restart intervals.
+    WritableFile* outfile = nullptr;
+    ASSERT_TRUE(NewWritableFile(fname, false, &outfile).ok());
+    TableBuilder builder(options, outfile);
+    const int kNumKeys = 2000;
+    for (int i = 0; i < kNumKeys; i++) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "key%06d", i * 2);
+        builder.Add(InternalKey(buf, 200, kTypeValue).Encode(), "new" + std::to_string(i));
+        builder.Add(InternalKey(buf, 100, kTypeValue).Encode(), "old" + std::to_string(i));
+    }
+    ASSERT_TRUE(builder.Finish().ok());
+    uint64_t size = builder.FileSize();
+    delete outfile;
+
+    TableCache cache(".", &options, 10);
+    ReadOptions ro;
+    for (int i = 0; i < kNumKeys; i++) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "key%06d", i * 2);
+
+        GetResult latest;
+        LookupKey lkey(buf, kMaxSequenceNumber);
+        ASSERT_TRUE(cache.Get(ro, file_number, size, lkey.internal_key(),
+                              &latest, SaveGetResult).ok());
+        ASSERT_TRUE(latest.found);
+        ASSERT_EQ("new" + std::to_string(i), latest.value);
+
+        GetResult older;
+        LookupKey old_lkey(buf, 150);
+        ASSERT_TRUE(cache.Get(ro, file_number, size, old_lkey.internal_key(),
+                              &older, SaveGetResult).ok());
+        ASSERT_TRUE(older.found);
+        ASSERT_EQ("old" + std::to_string(i), older.value);
+
+        // Odd keys are absent; any entry returned must be for another user key.
+        snprintf(buf, sizeof(buf), "key%06d", i * 2 + 1);
+        GetResult missing;
+        LookupKey missing_lkey(buf, kMaxSequenceNumber);
+        ASSERT_TRUE(cache.Get(ro, file_number, size, missing_lkey.internal_key(),
+                              &missing, SaveGetResult).ok());
+        if (missing.found) {
+            ASSERT_NE(std::string(buf), InternalKey::ExtractUserKey(missing.key).ToString());
+        }
+    }
+
+    // Iteration over hash-indexed blocks is unaffected.
+    Iterator* iter = cache.NewIterator(ro, file_number, size);
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        count++;
+    }
+    ASSERT_TRUE(iter->status().ok());
+    ASSERT_EQ(2 * kNumKeys, count);
+    delete iter;
+
+    cache.Evict(file_number);
+    remove(fname.c_str());
+}
+
+TEST(SSTableTest, HashIndexUtilRatioOutOfRange) {
+    InternalKeyComparator icmp(BytewiseComparator());
+    ReadOptions ro;
+    // Tables built outside DB::Open's checks treat such ratios as 1.
+    for (double ratio : {0.0, -1.0, 2.0}) {
+        Options options;
+        options.comparator = &icmp;
+        options.data_block_hash_index = true;
+        options.data_block_hash_table_util_ratio = ratio;
+        const uint64_t file_number = 902;
+        std::string fname = "./000902.sst";
+
+        WritableFile* outfile = nullptr;
+        ASSERT_TRUE(NewWritableFile(fname, false, &outfile).ok());
+        TableBuilder builder(options, outfile);
+        for (int i = 0; i < 500; i++) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "key%06d", i);
+            builder.Add(InternalKey(buf, 100, kTypeValue).Encode(), "v" + std::to_string(i));
+        }
+        ASSERT_TRUE(builder.Finish().ok());
+        uint64_t size = builder.FileSize();
+        delete outfile;
+
+        TableCache cache(".", &options, 10);
+        for (int i = 0; i < 500; i++) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "key%06d", i);
+            GetResult result;
+            LookupKey lkey(buf, kMaxSequenceNumber);
+            ASSERT_TRUE(cache.Get(ro, file_number, size, lkey.internal_key(),
+                                  &result, SaveGetResult).ok());
+            ASSERT_TRUE(result.found) << buf << " ratio " << ratio;
+            ASSERT_EQ("v" + std::to_string(i), result.value);
+        }
+        cache.Evict(file_number);
+        remove(fname.c_str());
+    }
+}
+
+TEST(SSTableTest, XXHashChecksumVerified) {
+    Options options;
+    options.checksum = Options::kXXHash64;
+    options.paranoid_checks = true;
+    std::string fname = "test_sstable_xxhash.sst";
+
+    WritableFile* outfile = nullptr;
+    ASSERT_TRUE(NewWritableFile(fname, false, &outfile).ok());
+    TableBuilder builder(options, outfile);
+    for (int i = 0; i < 100; i++) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "key%04d", i);
+        builder.Add(buf, std::string(50, 'v'));
+    }
+    ASSERT_TRUE(builder.Finish().ok());
+    uint64_t size = builder.FileSize();
+    delete outfile;
+
+    ReadOptions ro;
+    ro.verify_checksums = true;
+    {
+        Table* table = nullptr;
+        ASSERT_TRUE(Table::Open(options, fname, size, &table).ok());
+        Iterator* iter = table->NewIterator(ro);
+        int count = 0;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            count++;
+        }
+        ASSERT_TRUE(iter->status().ok());
+        ASSERT_EQ(100, count);
+        delete iter;
+        delete table;
+    }
+
+    // Flip a byte inside the first data block.
+    {
+        std::fstream f(fname, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(10);
+        f.put('X');
+    }
+    {
+        Table* table = nullptr;
+        ASSERT_TRUE(Table::Open(options, fname, size, &table).ok());
+        Iterator* iter = table->NewIterator(ro);
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        }
+        ASSERT_TRUE(iter->status().IsCorruption());
+        delete iter;
+        delete table;
+    }
+    remove(fname.c_str());
+}
+
+TEST(SSTableTest, TablePropertiesRoundTrip) {
+    InternalKeyComparator icmp(BytewiseComparator());
+    Options options;
+    options.comparator = &icmp;
+    options.compression = Options::kLZCompression;
+    std::string fname = "test_sstable_props.sst";
+
+    WritableFile* outfile = nullptr;
+    ASSERT_TRUE(NewWritableFile(fname, false, &outfile).ok());
+    TableBuilder builder(options, outfile);
+    uint64_t raw_keys = 0, raw_values = 0;
+    for (int i = 0; i < 1000; i++) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "key%06d", i);
+        // Every fourth key is a tombstone.
+        const bool deleted = (i % 4 == 0);
+        InternalKey ikey(buf, 100 + i, deleted ? kTypeDeletion : kTypeValue);
+        const std::string value = deleted ? "" : std::string(100, 'a' + i % 26);
+        builder.Add(ikey.Encode(), value);
+        raw_keys += ikey.Encode().size();
+        raw_values += value.size();
+    }
+    ASSERT_TRUE(builder.Finish().ok());
+    uint64_t size = builder.FileSize();
+    delete outfile;
+
+    const TableProperties& written = builder.GetTableProperties();
+    ASSERT_EQ(1000u, written.num_entries);
+    ASSERT_EQ(250u, written.num_deletions);
+    ASSERT_EQ(raw_keys, written.raw_key_size);
+    ASSERT_EQ(raw_values, written.raw_value_size);
+    ASSERT_EQ(100u, written.smallest_seqno);
+    ASSERT_EQ(1099u, written.largest_seqno);
+    ASSERT_GT(written.creation_time, 0u);
+    ASSERT_GT(written.CompressionRatio(), 1.0);
+    ASSERT_DOUBLE_EQ(0.25, written.DeletionRatio());
+
+    Table* table = nullptr;
+    ASSERT_TRUE(Table::Open(options, fname, size, &table).ok());
+    const TableProperties& read = table->GetTableProperties();
+    ASSERT_EQ(written.num_entries, read.num_entries);
+    ASSERT_EQ(written.num_deletions, read.num_deletions);
+    ASSERT_EQ(written.raw_key_size, read.raw_key_size);
+    ASSERT_EQ(written.raw_value_size, read.raw_value_size);
+    ASSERT_EQ(written.raw_data_size, read.raw_data_size);
+    ASSERT_EQ(written.data_size, read.data_size);
+    ASSERT_EQ(written.smallest_seqno, read.smallest_seqno);
+    ASSERT_EQ(written.largest_seqno, read.largest_seqno);
+    ASSERT_EQ(written.creation_time, read.creation_time);
+    delete table;
+    remove(fname.c_str());
+}
+
+static const int kNumKeys = 5000;
+
+static std::string TestKey(int i) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    return buf;
+}
+
+// Varying value sizes keep blocks and the file end off page boundaries.
+static std::string TestValue(int i) {
+    return std::string(50 + i % 7, 'a' + i % 26);
+}
+
+// Writes kNumKeys entries to fname and returns the file size.
+static uint64_t BuildTable(const Options& options, const std::string& fname,
+                           bool direct = false) {
+    WritableFile* outfile = nullptr;
+    EXPECT_TRUE(NewWritableFile(fname, direct, &outfile).ok());
+    TableBuilder builder(options, outfile);
+    for (int i = 0; i < kNumKeys; i++) {
+        builder.Add(TestKey(i), TestValue(i));
+    }
+    EXPECT_TRUE(builder.Finish().ok());
+    uint64_t size = builder.FileSize();
+    delete outfile;
+    return size;
+}
+
+// Scans iter from the start and checks every entry BuildTable wrote.
+static void VerifyScan(Iterator* iter) {
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        ASSERT_EQ(TestKey(count), iter->key().ToString());
+        ASSERT_EQ(TestValue(count), iter->value().ToString());
+        count++;
+    }
+    ASSERT_TRUE(iter->status().ok()) << iter->status().ToString();
+    ASSERT_EQ(kNumKeys, count);
+}
+
+TEST(SSTableTest, DirectIORoundTrip) {
+    Options options;
+    options.use_direct_reads = true;
+    std::string fname = "test_sstable_direct.sst";
+    uint64_t size = BuildTable(options, fname, true);
+
+    // The padded tail page was truncated back to the real size.
+    std::ifstream in(fname, std::ios::binary | std::ios::ate);
+    ASSERT_EQ(size, static_cast<uint64_t>(in.tellg()));
+    in.close();
+
+    Table* table = nullptr;
+    ASSERT_TRUE(Table::Open(options, fname, size, &table).ok());
+    ReadOptions ro;
+    ro.verify_checksums = true;
+    Iterator* iter = table->NewIterator(ro);
+    VerifyScan(iter);
+    delete iter;
+    delete table;
+    remove(fname.c_str());
+}
+
+TEST(SSTableTest, ReadaheadIterators) {
+    Options options;
+    options.compaction_readahead_size = 48 * 1024;
+    std::string fname = "test_sstable_readahead.sst";
+    uint64_t size = BuildTable(options, fname);
+
+    Table* table = nullptr;
+    ASSERT_TRUE(Table::Open(options, fname, size, &table).ok());
+
+    // A window that does not divide the file exercises the short last read.
+    ReadOptions ro;
+    ro.verify_checksums = true;
+    ro.readahead_size = 20 * 1024 + 3;
+    for (bool for_compaction : {false, true}) {
+        Iterator* iter = table->NewIterator(ro, for_compaction);
+        VerifyScan(iter);
+
+        // Backward and random access are served correctly too.
+        int count = kNumKeys;
+        for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+            count--;
+        }
+        ASSERT_EQ(0, count);
+        iter->Seek("key004321");
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_EQ("key004321", iter->key().ToString());
+        iter->Seek("key000007");
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_EQ("key000007", iter->key().ToString());
+        delete iter;
+    }
+
+    delete table;
+    remove(fname.c_str());
+}
+
+TEST(SSTableTest, AutoReadaheadScan) {
+    Options options;
+    options.max_auto_readahead_size = 32 * 1024;
+    std::string fname = "test_sstable_auto_readahead.sst";
+    uint64_t size = BuildTable(options, fname);
+
+    Table* table = nullptr;
+    ASSERT_TRUE(Table::Open(options, fname, size, &table).ok());
+
+    ReadOptions ro;
+    ro.verify_checksums = true;
+    Iterator* iter = table->NewIterator(ro);
+    VerifyScan(iter);
+
+    // Seeks break the sequential run; scanning on from each one ramps the
+    // prefetch up again from its initial size.
+    for (int start : {3000, 17, 4100, 1200}) {
+        int i = start;
+        for (iter->Seek(TestKey(start)); iter->Valid() && i < start + 1500; iter->Next(), i++) {
+            ASSERT_EQ(TestKey(i), iter->key().ToString());
+            ASSERT_EQ(TestValue(i), iter->value().ToString());
+        }
+        ASSERT_TRUE(iter->status().ok());
+    }
+
+    int count = kNumKeys;
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+        count--;
+    }
+    ASSERT_TRUE(iter->status().ok());
+    ASSERT_EQ(0, count);
+
+    // Destroying an iterator mid-scan waits for its prefetch.
+    iter->SeekToFirst();
+    for (int i = 0; i < 1000 && iter->Valid(); i++) {
+        iter->Next();
+    }
+    delete iter;
+
+    delete table;
+    remove(fname.c_str());
+}
+
+TEST(SSTableTest, MultiReadBatches) {
+    std::string fname = "test_sstable_multiread.dat";
+    std::string contents;
+    for (int i = 0; i < 300000; i++) {
+        contents.push_back(static_cast<char>('a' + (i * 7 + i / 13) % 26));
+    }
+    {
+        WritableFile* outfile = nullptr;
+        ASSERT_TRUE(NewWritableFile(fname, false, &outfile).ok());
+        ASSERT_TRUE(outfile->Append(contents).ok());
+        ASSERT_TRUE(outfile->Close().ok());
+        delete outfile;
+    }
+
+    // More requests than one io_uring submission holds, plus one past EOF.
+    // Direct files take the thread pool path, and readahead views forward
+    // the batch to the file below them.
+    for (bool direct : {false, true}) {
+        RandomAccessFile* file = nullptr;
+        ASSERT_TRUE(NewRandomAccessFile(fname, direct, &file).ok());
+        std::unique_ptr<RandomAccessFile> view(
+            NewReadaheadRandomAccessFile(file, contents.size(), 16 * 1024, false));
+        for (const RandomAccessFile* reader : {file, view.get()}) {
+            const size_t kNumReads = 150;
+            std::vector<ReadRequest> reqs(kNumReads + 1);
+            std::vector<std::string> bufs(kNumReads + 1);
+            for (size_t i = 0; i < kNumReads; i++) {
+                reqs[i].offset = (i * 104729) % (contents.size() - 5000);
+                reqs[i].len = 1 + (i * 31) % 5000;
+            }
+            reqs[kNumReads].offset = contents.size() - 10;
+            reqs[kNumReads].len = 20;
+            for (size_t i = 0; i < reqs.size(); i++) {
+                bufs[i].resize(reqs[i].len);
+                reqs[i].scratch = &bufs[i][0];
+            }
+
+            reader->MultiRead(reqs.data(), reqs.size());
+            for (size_t i = 0; i < kNumReads; i++) {
+                ASSERT_TRUE(reqs[i].status.ok()) << reqs[i].status.ToString();
+                ASSERT_EQ(contents.substr(reqs[i].offset, reqs[i].len), bufs[i]);
+            }
+            ASSERT_FALSE(reqs[kNumReads].status.ok());
+        }
+        view.reset();
+        delete file;
+    }
+    remove(fname.c_str());
+}
+
+TEST(SSTableTest, CompressedSecondaryCacheTier) {
+    Options options;
+    std::string fname = "test_sstable_secondary.sst";
+    uint64_t size = BuildTable(options, fname);
+
+    // The block cache holds a handful of blocks; everything it evicts goes
+    // to the secondary tier, compressed well below its size.
+    CompressedSecondaryCache secondary(1024 * 1024);
+    std::unique_ptr<Cache> block_cache(NewLRUCache(16 * 1024));
+    Table* table = nullptr;
+    ASSERT_TRUE(Table::Open(options, fname, size, &table, block_cache.get(), &secondary).ok());
+
+    auto scan = [&]() {
+        Iterator* iter = table->NewIterator(ReadOptions());
+        VerifyScan(iter);
+        delete iter;
+    };
+    scan();
+    ASSERT_GT(secondary.TotalCharge(), 0u);
+    ASSERT_LT(secondary.TotalCharge(), size / 4);
+
+    // With the file emptied, every block must come from one of the tiers.
+    std::ofstream(fname, std::ios::binary | std::ios::trunc).close();
+    scan();
+    scan();
+
+    delete table;
+    secondary.Close();
+    remove(fname.c_str());
+}
+
+TEST(SSTableTest, PersistentCacheTier) {
+    Options options;
+    std::string fname = "test_sstable_persistent.sst";
+    const std::string dir = "test_sstable_persistent_dir";
+#ifdef _WIN32
+    system(("rmdir /S /Q " + dir).c_str());
+#else
+    system(("rm -rf " + dir).c_str());
+#endif
+    uint64_t size = BuildTable(options, fname);
+
+    auto scan = [&](Table* table) {
+        Iterator* iter = table->NewIterator(ReadOptions());
+        VerifyScan(iter);
+        delete iter;
+    };
+    // Blocks evicted from a small block cache, and those left in it when
+    // it is destroyed, spill to the persistent tier.
+    {
+        PersistentCache* persistent = nullptr;
+        ASSERT_TRUE(PersistentCache::Open(dir, 4 * 1024 * 1024, &persistent).ok());
+        std::unique_ptr<Cache> block_cache(NewLRUCache(16 * 1024));
+        Table* table = nullptr;
+        ASSERT_TRUE(Table::Open(options, fname, size, &table, block_cache.get(), nullptr,
+                                persistent).ok());
+        scan(table);
+        delete table;
+        block_cache.reset();
+        delete persistent;
+    }
+
+    // After a "restart", with the first half of the file zeroed, every
+    // data block is still served from the persistent tier.
+    {
+        std::fstream f(fname, std::ios::in | std::ios::out | std::ios::binary);
+        f.write(std::string(size / 2, '\0').data(), size / 2);
+    }
+    PersistentCache* persistent = nullptr;
+    ASSERT_TRUE(PersistentCache::Open(dir, 4 * 1024 * 1024, &persistent).ok());
+    std::unique_ptr<Cache> block_cache(NewLRUCache(16 * 1024));
+    Table* table = nullptr;
+    ASSERT_TRUE(Table::Open(options, fname, size, &table, block_cache.get(), nullptr,
+                            persistent).ok());
+    scan(table);
+    delete table;
+    block_cache.reset();
+    delete persistent;
+
+#ifdef _WIN32
+    system(("rmdir /S /Q " + dir).c_str());
+#else
+    system(("rm -rf " + dir).c_str());
+#endif
+    remove(fname.c_str());
+}
+
+TEST(SSTableTest, WarmDataBlocks) {
+    Options options;
+    options.block_cache.reset(NewLRUCache(4 * 1024 * 1024));
+    const uint64_t file_number = 902;
+    std::string fname = "./000902.sst";
+    uint64_t size = BuildTable(options, fname);
+
+    TableCache cache(".", &options, 10);
+    ASSERT_TRUE(cache.Warm(file_number, size, 0).ok());
+    ASSERT_EQ(0u, options.block_cache->TotalCharge());
+    ASSERT_TRUE(cache.Warm(file_number, size, 3).ok());
+    const size_t three_blocks = options.block_cache->TotalCharge();
+    ASSERT_GE(three_blocks, 3 * options.block_size);
+    ASSERT_LT(three_blocks, 4 * options.block_size);
+    ASSERT_TRUE(cache.Warm(file_number, size, kNumKeys).ok());
+    ASSERT_GT(options.block_cache->TotalCharge(), size / 2);
+
+    // With the file emptied, the table cache still has the index and the
+    // block cache every data block.
+    std::ofstream(fname, std::ios::binary | std::ios::trunc).close();
+    Iterator* iter = cache.NewIterator(ReadOptions(), file_number, size);
+    VerifyScan(iter);
+    delete iter;
+    remove(fname.c_str());
+}
+
+TEST(SSTableTest, BlockCacheDumpAndLoad) {
+    Options options;
+    options.block_cache.reset(NewLRUCache(4 * 1024 * 1024, 0.5));
+    const uint64_t file_number = 903;
+    std::string fname = "./000903.sst";
+    uint64_t size = BuildTable(options, fname);
+    // Every other block, so loading them back takes reads with gaps.
+    std::vector<CachedBlockRef> blocks;
+    {
+        TableCache cache(".", &options, 10);
+        ASSERT_TRUE(cache.Warm(file_number, size, kNumKeys).ok());
+        cache.ListCachedBlocks(&blocks);
+    }
+    ASSERT_GT(blocks.size(), 10u);
+    std::sort(blocks.begin(), blocks.end(), [](const CachedBlockRef& a, const CachedBlockRef& b) {
+        return a.offset < b.offset;
+    });
+    std::vector<CachedBlockRef> half;
+    for (size_t i = 0; i < blocks.size(); i += 2) {
+        ASSERT_EQ(file_number, blocks[i].file_number);
+        half.push_back(blocks[i]);
+    }
+    half.push_back(CachedBlockRef{file_number, 1, Cache::Priority::kHigh});  // Not a block.
+    std::sort(half.begin(), half.end(), [](const CachedBlockRef& a, const CachedBlockRef& b) {
+        return a.offset < b.offset;
+    });
+
+    // A new block cache, as after a restart, gets just those blocks back.
+    options.block_cache.reset(NewLRUCache(4 * 1024 * 1024, 0.5));
+    TableCache cache(".", &options, 10);
+    ASSERT_TRUE(cache.LoadCachedBlocks(file_number, size, half).ok());
+    std::vector<CachedBlockRef> loaded;
+    cache.ListCachedBlocks(&loaded);
+    ASSERT_EQ(half.size() - 1, loaded.size());
+    ASSERT_TRUE(cache.LoadCachedBlocks(file_number, size, half).ok());
+    loaded.clear();
+    cache.ListCachedBlocks(&loaded);
+    ASSERT_EQ(half.size() - 1, loaded.size());
+
+    // Loaded blocks are read from the cache once the file is gone; the
+    // iterator fails at the first block that was not loaded.
+    std::ofstream(fname, std::ios::binary | std::ios::trunc).close();
+    Iterator* iter = cache.NewIterator(ReadOptions(), file_number, size);
+    iter->SeekToFirst();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(TestValue(0), iter->value().ToString());
+    int count = 0;
+    for (; iter->Valid(); iter->Next()) {
+        count++;
+    }
+    ASSERT_FALSE(iter->status().ok());
+    ASSERT_GT(count, 0);
+    delete iter;
+    remove(fname.c_str());
+}
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include "lsm/cache.h"
+#include "lsm/db.h"
+#include "lsm/options.h"
+#include "lsm/write_buffer_manager.h"
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace lsm;
+
+static void DestroyDir(const std::string& dir) {
+#ifdef _WIN32
+    system(("rmdir /S /Q " + dir).c_str());
+#else
+    system(("rm -rf " + dir).c_str());
+#endif
+}
+
+static size_t NumTables(DB* db) {
+    TablePropertiesCollection props;
+    EXPECT_TRUE(db->GetPropertiesOfAllTables(&props).ok());
+    return props.size();
+}
+
+TEST(WriteBufferManagerTest, ChargesCache) {
+    std::shared_ptr<Cache> cache(NewLRUCache(4 * 1024 * 1024));
+    const size_t kDummy = WriteBufferManager::kDummyEntrySize;
+    {
+        WriteBufferManager wbm(1024 * 1024, cache);
+        wbm.ReserveMem(300 * 1024);
+        ASSERT_EQ(2 * kDummy, wbm.dummy_entries_in_cache_usage());
+        ASSERT_EQ(2 * kDummy, cache->TotalCharge());
+        ASSERT_FALSE(wbm.ShouldFlush());
+
+        wbm.ReserveMem(700 * 1024);
+        ASSERT_TRUE(wbm.ShouldFlush());
+        // Memory waiting on a flush does not call for another one.
+        wbm.ScheduleFreeMem(1000 * 1024);
+        ASSERT_FALSE(wbm.ShouldFlush());
+        ASSERT_EQ(1000u * 1024, wbm.memory_usage());
+
+        // Freed memory gives the cache back all but one spare entry.
+        wbm.FreeMem(1000 * 1024);
+        ASSERT_EQ(0u, wbm.memory_usage());
+        ASSERT_EQ(kDummy, cache->TotalCharge());
+    }
+    ASSERT_EQ(0u, cache->TotalCharge());
+}
+
+// Memory written to one DB gets the idle DB with the larger memtable
+// flushed, and total memtable memory stays near the shared limit.
+TEST(WriteBufferManagerTest, FlushesLargestMemtableAcrossDBs) {
+    const std::string name_a = "test_wbm_db_a";
+    const std::string name_b = "test_wbm_db_b";
+    DestroyDir(name_a);
+    DestroyDir(name_b);
+
+    const size_t kLimit = 1024 * 1024;
+    std::shared_ptr<Cache> cache(NewLRUCache(8 * 1024 * 1024));
+    Options options;
+    options.write_buffer_size = 64 * 1024 * 1024;
+    options.block_cache = cache;
+    options.write_buffer_manager = std::make_shared<WriteBufferManager>(kLimit, cache);
+
+    DB* a = nullptr;
+    DB* b = nullptr;
+    ASSERT_TRUE(DB::Open(options, name_a, &a).ok());
+    ASSERT_TRUE(DB::Open(options, name_b, &b).ok());
+
+    const std::string value(1000, 'v');
+    int i = 0;
+    while (options.write_buffer_manager->memory_usage() < kLimit * 3 / 4) {
+        ASSERT_TRUE(b->Put(WriteOptions(), "b" + std::to_string(i++), value).ok());
+    }
+    ASSERT_EQ(0u, NumTables(b));
+
+    size_t peak = 0;
+    for (int j = 0; j < 4000; j++) {
+        ASSERT_TRUE(a->Put(WriteOptions(), "a" + std::to_string(j), value).ok());
+        peak = std::max(peak, options.write_buffer_manager->memory_usage());
+    }
+    ASSERT_LT(peak, 3 * kLimit);
+    ASSERT_GT(cache->TotalCharge(), 0u);
+
+    for (int wait = 0; wait < 500 && (NumTables(a) == 0 || NumTables(b) == 0); wait++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_GT(NumTables(b), 0u);
+    ASSERT_GT(NumTables(a), 0u);
+
+    std::string result;
+    ASSERT_TRUE(b->Get(ReadOptions(), "b0", &result).ok());
+    ASSERT_EQ(value, result);
+    ASSERT_TRUE(a->Get(ReadOptions(), "a3999", &result).ok());
+    ASSERT_EQ(value, result);
+
+    delete a;
+    delete b;
+    ASSERT_EQ(0u, options.write_buffer_manager->memory_usage());
+    DestroyDir(name_a);
+    DestroyDir(name_b);
+}